@@ -7,6 +7,16 @@ unsigned long platform_seconds()
   return (unsigned long)millis()/1000;
 }
 
+unsigned long platform_ms()
+{
+  return (unsigned long)millis();
+}
+
+unsigned long platform_us()
+{
+  return (unsigned long)micros();
+}
+
 unsigned short platform_short(unsigned short x)
 {
    return ( ((x)<<8) | (((x)>>8)&0xFF) );
@@ -23,23 +33,29 @@ long platform_random(void)
   return random();
 }
 
-int _debugging = 0;
+int _logging = 0;
 void platform_logging(int enabled)
 {
   if(enabled < 0)
   {
-    _debugging ^= 1;
+    _logging = _logging ? 0 : LOG_LEVEL_DEBUG;
   }else{
-    _debugging = enabled;    
+    _logging = enabled ? LOG_LEVEL_DEBUG : 0;
   }
   LOG("debug output enabled");
 }
 
+int platform_log_level(int level)
+{
+  int was = _logging;
+  _logging = level;
+  return was;
+}
+
 void *platform_log(const char *file, int line, const char *function, const char * format, ...)
 {
     char buffer[256];
     va_list args;
-    if(!_debugging) return NULL;
     va_start (args, format);
     vsnprintf (buffer, 256, format, args);
     println(buffer);
@@ -2,38 +2,146 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "../lib/util.h"
+#include "../lib/base32.h"
+#include "../lib/memstat.h"
 #include "e3x.h"
 #include "platform.h"
 
 // every new channel has a unique global id
 static uint32_t _uids = 0;
 
+// out_flags per sent seq
+#define OUT_QUEUED 1 // in the resend ring
+#define OUT_RESENT 2 // went out more than once, no rtt sample from it
+#define OUT_LOST 4 // presumed lost, no longer counted in flight by the congestion controller
+
 // internal only structure, always use accessors
 struct channel3_struct
 {
   uint32_t id; // wire id (not unique)
   char c[12]; // str of id
   char uid[9]; // process hex id (unique)
-  uint32_t tsent, trecv; // last send, recv
+  uint32_t tsent, trecv; // last send, recv (ms)
   uint32_t timeout; // seconds since last trecv to auto-err
   lob_t open; // cached for convenience
   char *type;
   enum channel3_states state;
   event3_t ev;
+  lob_t timer; // our one event, reused for every (re)schedule
+  uint32_t at; // when it's scheduled, 0 if not
   
-  // reliable miss tracking
-  uint32_t miss_nextack;
-  lob_t out;
-  
-  // reliable seq tracking
-  uint32_t seq, seq_nextin, seq_seen, seq_acked;
-  lob_t in;
+  // unreliable queues, and any non-seq packets on reliable ones
+  lob_t in, in_tail, out, out_tail;
+
+  // everything buffered each way (rings included), kept as packets come and go
+  uint32_t in_bytes, in_count, out_bytes, out_count;
+  uint32_t high, low; // out_bytes watermarks, 0 is none
+  uint8_t blocked; // went over high, until back down to low
+
+  // reliable rings are window sized (power of two) and indexed by seq & (window-1)
+  uint8_t reliable, ack_due;
+  uint32_t window;
+
+  // reliable miss tracking, sent packets wait in out_ring until acked
+  lob_t *out_ring;
+  uint8_t *out_flags;
+  uint32_t *out_at; // when each was last sent
+  uint32_t *resend; // ring of seqs that were missed
+  uint32_t resend_head, resend_tail;
+  uint32_t seq, seq_sent, miss_nextack; // next to assign, next to send, oldest unacked
+
+  // reliable seq tracking, received packets wait in in_ring until popped in order
+  lob_t *in_ring;
+  uint64_t *in_have; // bit per in_ring slot, set when it holds a packet
+  uint32_t seq_nextin, seq_seen;
+
+  // shared per-link congestion control, optional
+  congest3_t cc;
 };
 
+// round up to a power of two so the rings can mask instead of mod
+static uint32_t window_size(uint32_t window)
+{
+  uint32_t size = 1;
+  while(size < window && size < 0x80000000) size <<= 1;
+  return size;
+}
+
+// what the rings for a window take
+#define RINGS_BYTES(window) ((sizeof (lob_t) * 2 + 1 + sizeof (uint32_t) * 2) * (window) + sizeof (uint64_t) * (((window) + 63) / 64))
+
+// takes everything still in flight out of the controller's count, once per packet
+static void uncount(channel3_t c)
+{
+  uint32_t seq, slot, count = 0;
+  if(!c->reliable || !c->out_flags) return;
+  for(seq = c->miss_nextack; seq < c->seq_sent; seq++)
+  {
+    slot = seq & (c->window - 1);
+    if(c->out_flags[slot] & OUT_LOST) continue;
+    c->out_flags[slot] |= OUT_LOST;
+    count++;
+  }
+  congest3_done(c->cc,count);
+}
+
+static void rings_free(channel3_t c)
+{
+  uint32_t i;
+  if(!c->reliable || !c->in_ring) return;
+  MEMSTAT_ADD(MEMSTAT_CHANNEL, 0, -(int32_t)RINGS_BYTES(c->window));
+  for(i = 0; i < c->window; i++)
+  {
+    lob_free(c->in_ring[i]);
+    lob_free(c->out_ring[i]);
+  }
+  free(c->in_ring);
+  free(c->in_have);
+  free(c->out_ring);
+  free(c->out_flags);
+  free(c->out_at);
+  free(c->resend);
+  c->in_ring = c->out_ring = NULL;
+  c->in_have = NULL;
+  c->out_flags = NULL;
+  c->out_at = c->resend = NULL;
+}
+
+static uint8_t rings_new(channel3_t c, uint32_t window)
+{
+  c->window = window_size(window);
+  c->in_ring = malloc(sizeof (lob_t) * c->window);
+  c->in_have = malloc(sizeof (uint64_t) * ((c->window + 63) / 64));
+  c->out_ring = malloc(sizeof (lob_t) * c->window);
+  c->out_flags = malloc(c->window);
+  c->out_at = malloc(sizeof (uint32_t) * c->window);
+  c->resend = malloc(sizeof (uint32_t) * c->window);
+  if(!c->in_ring || !c->in_have || !c->out_ring || !c->out_flags || !c->out_at || !c->resend)
+  {
+    free(c->in_ring);
+    free(c->in_have);
+    free(c->out_ring);
+    free(c->out_flags);
+    free(c->out_at);
+    free(c->resend);
+    c->in_ring = c->out_ring = NULL;
+    c->in_have = NULL;
+    c->out_flags = NULL;
+    c->out_at = c->resend = NULL;
+    return 1;
+  }
+  memset(c->in_ring,0,sizeof (lob_t) * c->window);
+  memset(c->in_have,0,sizeof (uint64_t) * ((c->window + 63) / 64));
+  memset(c->out_ring,0,sizeof (lob_t) * c->window);
+  memset(c->out_flags,0,c->window);
+  MEMSTAT_ADD(MEMSTAT_CHANNEL, 0, RINGS_BYTES(c->window));
+  return 0;
+}
+
 // open must be channel3_receive or channel3_send next yet
 channel3_t channel3_new(lob_t open)
 {
-  uint32_t id;
+  uint32_t id, uid;
   char *type;
   channel3_t c;
 
@@ -43,25 +151,37 @@ channel3_t channel3_new(lob_t open)
   type = lob_get(open,"type");
   if(!type) return LOG("missing channel type");
 
-  c = malloc(sizeof (struct channel3_struct));
+  if(!(c = malloc(sizeof (struct channel3_struct)))) return LOG("OOM");
   memset(c,0,sizeof (struct channel3_struct));
+  MEMSTAT_ADD(MEMSTAT_CHANNEL, 1, sizeof (struct channel3_struct));
   c->state = OPENING;
+  c->trecv = platform_ms(); // idle from creation
   c->id = id;
   sprintf(c->c,"%u",id);
   c->open = lob_copy(open);
   c->type = lob_get(open,"type");
 
   // generate a unique id in hex
-  _uids++;
-  util_hex((uint8_t*)&_uids,4,c->uid);
-
-  // reliability
+#ifdef __GNUC__
+  uid = __atomic_add_fetch(&_uids, 1, __ATOMIC_RELAXED); // channels may be made on more than one thread
+#else
+  uid = ++_uids;
+#endif
+  util_hex((uint8_t*)&uid,4,c->uid);
+
+  // reliability, the open itself is seq 0 in either direction
   if(lob_get(open,"seq"))
   {
-    c->seq = 1;
+    c->reliable = 1;
+    if(rings_new(c,CHANNEL3_WINDOW))
+    {
+      lob_free(c->open);
+      free(c);
+      return LOG("OOM");
+    }
   }
 
-  LOG("new %s channel %s %d %s",c->seq?"reliable":"unreliable",c->uid,id,type);
+  LOG("new %s channel %s %d %s",c->reliable?"reliable":"unreliable",c->uid,id,type);
   return c;
 }
 
@@ -71,6 +191,7 @@ void channel3_free(channel3_t c)
   if(!c) return;
   // cancel timeouts
   channel3_timeout(c,NULL,0);
+  lob_free(c->timer);
   // free cached packet
   lob_free(c->open);
   // free any other queued packets
@@ -86,6 +207,9 @@ void channel3_free(channel3_t c)
     c->out = tmp->next;
     lob_free(tmp);
   }
+  if(c->reliable) uncount(c);
+  rings_free(c);
+  MEMSTAT_ADD(MEMSTAT_CHANNEL, -1, -(int32_t)sizeof (struct channel3_struct));
   free(c);
 };
 
@@ -109,35 +233,122 @@ char *channel3_c(channel3_t c)
   return c->c;
 }
 
+// (re)schedules our one event for the sooner of the inactivity timeout or the oldest unacked packet's rto
+static void timer_set(channel3_t c, uint32_t now)
+{
+  uint32_t at = 0, rto, wait;
+  if(!c->ev || c->state == ENDED) return;
+
+  if(c->timeout) at = c->trecv + (c->timeout * 1000);
+  if(c->reliable && c->miss_nextack != c->seq_sent)
+  {
+    rto = congest3_rto(c->cc);
+    rto += c->out_at[c->miss_nextack & (c->window - 1)];
+    if(!at || (int32_t)(rto - at) < 0) at = rto;
+  }
+
+  // queued ones held back by pacing need a wakeup even with nothing in flight
+  if(c->reliable && (c->seq_sent != c->seq || c->resend_head != c->resend_tail))
+  {
+    wait = congest3_wait(c->cc,now);
+    wait = now + (wait ? wait : 1);
+    if(!at || (int32_t)(wait - at) < 0) at = wait;
+  }
+
+  // already scheduled for then
+  if(at == c->at) return;
+  if(!at || (!c->timer && !(c->timer = lob_new())))
+  {
+    if(c->at) event3_set(c->ev,c->timer,c->uid,0);
+    c->at = 0;
+    return;
+  }
+  if((int32_t)(at - now) <= 0) at = now;
+  if(!at) at = 1; // 0 is reserved for none
+  c->timer->arg = c;
+  event3_set(c->ev,c->timer,c->uid,at);
+  c->at = at;
+}
+
 // this will set the default inactivity timeout using this event timer and our uid
 uint32_t channel3_timeout(channel3_t c, event3_t ev, uint32_t timeout)
 {
+  uint32_t now, idle;
   if(!c) return 0;
 
   // un-set any
   if(!ev)
   {
-    // cancel any that may have been stored
-    if(c->ev) event3_set(c->ev,NULL,c->uid,0);
+    // cancel any that may have been stored, the timer stays ours
+    if(c->ev && c->at) event3_set(c->ev,c->timer,c->uid,0);
     c->ev = NULL;
     c->timeout = 0;
+    c->at = 0;
     return 0;
   }
   
+  now = platform_ms();
+
   // return how much time is left
   if(!timeout)
   {
-    // TODO calculate it
-    return c->timeout;
+    if(!c->timeout) return 0;
+    idle = (now - c->trecv) / 1000;
+    return (idle < c->timeout) ? c->timeout - idle : 0;
   }
 
-  // add/update new timeout
+  // add/update new timeout, moving the event if it's a different timer
+  if(c->ev && c->ev != ev && c->at) event3_set(c->ev,c->timer,c->uid,0);
+  if(c->ev != ev) c->at = 0;
   c->ev = ev;
   c->timeout = timeout;
-  // TODO set up a timer
+  timer_set(c,now);
   return c->timeout;
 }
 
+// our event fired, resend everything unacked past its rto, or end with an incoming {"err":"timeout"} when idle too long
+enum channel3_states channel3_expire(channel3_t c)
+{
+  uint32_t now, slot;
+  lob_t err;
+  if(!c) return ENDED;
+  c->at = 0; // our timer was already taken from the event3
+  if(c->state == ENDED) return ENDED;
+  now = platform_ms();
+
+  if(c->timeout && now - c->trecv >= c->timeout * 1000)
+  {
+    LOG("channel %s timed out",c->uid);
+    if((err = channel3_packet(c)))
+    {
+      lob_set(err,"err","timeout");
+      err->next = c->in;
+      c->in = err;
+      if(!c->in_tail) c->in_tail = err;
+      c->in_bytes += lob_len(err);
+      c->in_count++;
+    }
+    c->state = ENDED;
+    return ENDED;
+  }
+
+  // retransmit timer, everything in flight is presumed lost
+  if(c->reliable && c->miss_nextack != c->seq_sent)
+  {
+    slot = c->miss_nextack & (c->window - 1);
+    if(now - c->out_at[slot] >= congest3_rto(c->cc))
+    {
+      channel3_sync(c,1);
+      // restarts its rto (without an rtt sample) so the timer backs off until it's resent
+      c->out_flags[slot] |= OUT_RESENT;
+      c->out_at[slot] = now;
+    }
+  }
+
+  timer_set(c,now);
+  return c->state;
+}
+
 // returns the open packet (always cached)
 lob_t channel3_open(channel3_t c)
 {
@@ -151,24 +362,213 @@ enum channel3_states channel3_state(channel3_t c)
   return c->state;
 }
 
+// resize the reliable window, only before any packets are buffered
+uint32_t channel3_window(channel3_t c, uint32_t window)
+{
+  if(!c || !c->reliable) return 0;
+  if(!window || window_size(window) == c->window) return c->window;
+  if(c->seq || c->seq_nextin || c->seq_seen || c->in_ring[0]) return c->window;
+  rings_free(c);
+  if(rings_new(c,window) && rings_new(c,CHANNEL3_WINDOW))
+  {
+    c->reliable = 0;
+    return 0;
+  }
+  return c->window;
+}
+
+// use this congestion controller (usually shared by all of a link's channels) for reliable packets
+void channel3_congest(channel3_t c, congest3_t cc)
+{
+  if(!c) return;
+  if(c->reliable && c->cc) uncount(c);
+  c->cc = cc;
+}
+
+// queue a sent seq to be resent, skipped if already queued, just resent (unless forced) or the ring is full
+static void miss_queue(channel3_t c, uint32_t seq, uint32_t now, uint8_t force)
+{
+  uint32_t slot = seq & (c->window - 1);
+  if(seq < c->miss_nextack || seq >= c->seq_sent || !c->out_ring[slot] || (c->out_flags[slot] & OUT_QUEUED)) return;
+  if(!force && (c->out_flags[slot] & OUT_RESENT) && now - c->out_at[slot] < congest3_rtt(c->cc)) return;
+  if(c->resend_tail - c->resend_head >= c->window) return;
+  c->out_flags[slot] |= OUT_QUEUED;
+  c->resend[c->resend_tail++ & (c->window - 1)] = seq;
+}
+
+// frees everything up to and including the ack, queues any missed ones to resend
+static void miss_check(channel3_t c, lob_t p)
+{
+  uint32_t ack, seq, slot, i, count = 0, lost = 0, rtt = 0, queued, len;
+  uint8_t sampled = 0, bits[CHANNEL3_MISS/8];
+  uint32_t now = platform_ms();
+  uint64_t word;
+  char *miss, *end;
+
+  if(!lob_get(p,"ack")) return;
+  ack = (uint32_t)lob_get_int(p,"ack");
+  if(ack >= c->seq_sent) return; // bad data
+
+  // free the acked ones from the ring, the newest one never resent gives an rtt sample
+  while(c->miss_nextack <= ack)
+  {
+    slot = c->miss_nextack & (c->window - 1);
+    if(!(c->out_flags[slot] & OUT_RESENT))
+    {
+      rtt = now - c->out_at[slot];
+      sampled = 1;
+    }
+    if(c->out_flags[slot] & OUT_LOST) lost++;
+    c->out_bytes -= lob_len(c->out_ring[slot]);
+    c->out_count--;
+    c->out_ring[slot] = lob_free(c->out_ring[slot]);
+    c->out_flags[slot] = 0;
+    c->miss_nextack++;
+    count++;
+  }
+  // ones already presumed lost were taken out of flight then
+  if(count > lost) congest3_acked(c->cc,count - lost,sampled ? (rtt ? rtt : 1) : 0);
+
+  if(!(miss = lob_get_raw(p,"miss"))) return;
+  len = lob_get_len(p,"miss");
+  queued = c->resend_tail;
+
+  // "base32" bitmap, bit n set when ack+1+n is missing
+  if(*miss == '"' && len > 2)
+  {
+    len -= 2;
+    if((uint32_t)base32_decode_length(len) > sizeof(bits)) len = (sizeof(bits) * 8) / 5;
+    memset(bits,0,sizeof(bits));
+    len = (uint32_t)base32_decode_into(miss+1, len, bits);
+    for(i = 0; i < len; i += 8)
+    {
+      for(word = 0, seq = 0; seq < 8 && i+seq < len; seq++) word |= (uint64_t)bits[i+seq] << (seq*8);
+      while(word)
+      {
+        miss_queue(c, ack + 1 + (i*8) + __builtin_ctzll(word), now, 0);
+        word &= word - 1;
+      }
+    }
+  }
+
+  // legacy [seq,seq,...] list
+  if(*miss == '[')
+  {
+    end = miss + len;
+    for(i = 0, miss++; miss < end && i < c->window; i++)
+    {
+      seq = (uint32_t)strtoul(miss,&miss,10);
+      if(seq > ack) miss_queue(c,seq,now,0);
+      while(miss < end && (*miss < '0' || *miss > '9')) miss++;
+    }
+  }
+
+  if(c->resend_tail != queued) congest3_lost(c->cc,now,0);
+}
+
+// 64 bits of which seqs from this one on are buffered, bit 0 is seq
+static uint64_t have_bits(channel3_t c, uint32_t seq)
+{
+  uint32_t bit = seq & (c->window - 1), words, i;
+  uint64_t ret = 0;
+
+  // small windows wrap inside the one word
+  if(c->window < 64)
+  {
+    for(i = 0; i < c->window; i++) if((c->in_have[0] >> ((bit + i) & (c->window - 1))) & 1) ret |= (uint64_t)1 << i;
+    return ret;
+  }
+
+  words = c->window / 64;
+  ret = c->in_have[bit / 64] >> (bit % 64);
+  if(bit % 64) ret |= c->in_have[((bit / 64) + 1) & (words - 1)] << (64 - (bit % 64));
+  return ret;
+}
+
+// adds any ack and a bitmap of the misses after it to an outgoing packet
+static lob_t seq_ack(channel3_t c, lob_t p)
+{
+  uint8_t bits[CHANNEL3_MISS/8];
+  char miss[2+((CHANNEL3_MISS/8)*8)/5+2];
+  uint32_t span, i, len;
+  uint64_t word;
+
+  c->ack_due = 0;
+  if(!c->seq_nextin) return p; // nothing received yet
+  lob_set_int(p,"ack",(int)(c->seq_nextin-1));
+
+  // only when there's a gap before the highest seen
+  if(c->seq_seen < c->seq_nextin || c->in_ring[c->seq_nextin & (c->window - 1)]) return p;
+  span = (c->seq_seen - c->seq_nextin) + 1;
+  if(span > c->window) span = c->window;
+  if(span > CHANNEL3_MISS) span = CHANNEL3_MISS;
+
+  // bit n of the little endian bitmap is set when ack+1+n is missing
+  for(i = 0; i < span; i += 64)
+  {
+    word = ~have_bits(c, c->seq_nextin + i);
+    if(span - i < 64) word &= ((uint64_t)1 << (span - i)) - 1;
+    for(len = 0; len < 8; len++, word >>= 8) bits[(i/8)+len] = (uint8_t)word;
+  }
+  len = (span + 7) / 8;
+  while(len > 1 && !bits[len-1]) len--;
+
+  miss[0] = '"';
+  base32_encode_into(bits, len, miss+1);
+  len = base32_encode_length(len) - 1;
+  miss[len+1] = '"';
+  lob_set_raw(p,"miss",miss,len+2);
+  return p;
+}
+
 // incoming packets
 
 // usually sets/updates event timer, ret if accepted/valid into receiving queue
 uint8_t channel3_receive(channel3_t c, lob_t inner)
 {
-  lob_t end;
+  uint32_t seq, slot;
   if(!c || !inner) return 1;
-  if(!c->in)
+  c->trecv = platform_ms();
+
+  if(c->reliable && lob_get(inner,"seq"))
   {
-    c->in = inner;
+    miss_check(c,inner);
+    seq = (uint32_t)lob_get_int(inner,"seq");
+    
+    // too far ahead to buffer
+    if(seq >= c->seq_nextin && seq - c->seq_nextin >= c->window) return 1;
+
+    // already popped or already buffered, just make sure it gets acked again
+    slot = seq & (c->window - 1);
+    if(seq < c->seq_nextin || c->in_ring[slot])
+    {
+      c->ack_due = 1;
+      lob_free(inner);
+      return 0;
+    }
+
+    c->in_ring[slot] = inner;
+    c->in_have[slot / 64] |= (uint64_t)1 << (slot % 64);
+    if(seq > c->seq_seen) c->seq_seen = seq;
+    c->in_bytes += lob_len(inner);
+    c->in_count++;
     return 0;
   }
 
-  // TODO reliability
+  // ack-only packets are consumed here
+  if(c->reliable && lob_get(inner,"ack"))
+  {
+    miss_check(c,inner);
+    lob_free(inner);
+    return 0;
+  }
 
-  end = c->in;
-  while(end->next) end = end->next;
-  end->next = inner;
+  inner->next = NULL;
+  if(c->in_tail) c->in_tail->next = inner;
+  else c->in = inner;
+  c->in_tail = inner;
+  c->in_bytes += lob_len(inner);
+  c->in_count++;
 
   return 0;
 }
@@ -176,18 +576,45 @@ uint8_t channel3_receive(channel3_t c, lob_t inner)
 // false to force start timers (any new handshake), true to cancel and resend last packet (after any e3x_sync)
 void channel3_sync(channel3_t c, uint8_t sync)
 {
+  uint32_t seq, now;
   if(!c) return;
-  LOG("%s sync %d TODO",c->uid,sync);
+  LOG_TRACE("%s sync %d",c->uid,sync);
+  if(!c->reliable || !sync) return;
+
+  // everything in flight goes out again, and only this channel's packets stop counting against the link's window
+  now = platform_ms();
+  if(c->miss_nextack != c->seq_sent) congest3_lost(c->cc,now,1);
+  uncount(c);
+  for(seq = c->miss_nextack; seq < c->seq_sent; seq++) miss_queue(c,seq,now,1);
+  if(c->seq_nextin) c->ack_due = 1;
 }
 
 // get next avail packet in order, null if nothing
 lob_t channel3_receiving(channel3_t c)
 {
+  uint32_t slot;
   lob_t ret;
-  if(!c || !c->in) return NULL;
-  // TODO reliability
-  ret = c->in;
-  c->in = ret->next;
+  if(!c) return NULL;
+
+  if(c->in)
+  {
+    ret = c->in;
+    if(!(c->in = ret->next)) c->in_tail = NULL;
+    ret->next = NULL;
+    c->in_bytes -= lob_len(ret);
+    c->in_count--;
+    return ret;
+  }
+
+  if(!c->reliable) return NULL;
+  slot = c->seq_nextin & (c->window - 1);
+  if(!(ret = c->in_ring[slot])) return NULL;
+  c->in_bytes -= lob_len(ret);
+  c->in_count--;
+  c->in_ring[slot] = NULL;
+  c->in_have[slot / 64] &= ~((uint64_t)1 << (slot % 64));
+  c->seq_nextin++;
+  c->ack_due = 1;
   return ret;
 }
 
@@ -201,32 +628,42 @@ lob_t channel3_packet(channel3_t c)
   
   ret = lob_new();
   lob_set_int(ret,"c",c->id);
-  // TODO reliability
   return ret;
 }
 
 // adds to sending queue, adds json if needed
 uint8_t channel3_send(channel3_t c, lob_t inner)
 {
-  lob_t end;
   if(!c || !inner) return 1;
-  
-  if(!lob_get_int(inner,"c")) lob_set_int(inner,"c",c->id);
 
-  // if reliable, add seq
-  if(c->seq) lob_set_int(inner,"seq",c->seq++);
+  // over the high watermark holds off until drained down to the low one
+  if(c->high)
+  {
+    if(c->out_bytes >= c->high) c->blocked = 1;
+    else if(c->out_bytes <= c->low) c->blocked = 0;
+    if(c->blocked) return 2;
+  }
 
-  LOG("channel send %d %s",c->id,lob_json(inner));
+  // reliable ones wait in the ring until acked, backpressure when it's full
+  if(c->reliable && c->seq - c->miss_nextack >= c->window) return 2;
 
-  if(!c->out)
+  if(!lob_get_int(inner,"c")) lob_set_int(inner,"c",c->id);
+  if(c->reliable) lob_set_int(inner,"seq",(int)c->seq);
+  LOG_TRACE("channel send %d %s",c->id,lob_json(inner));
+  c->out_bytes += lob_len(inner);
+  c->out_count++;
+
+  if(c->reliable)
   {
-    c->out = inner;
+    c->out_ring[c->seq & (c->window - 1)] = inner;
+    c->seq++;
     return 0;
   }
 
-  end = c->out;
-  while(!end->next) end = end->next;
-  end->next = inner;
+  inner->next = NULL;
+  if(c->out_tail) c->out_tail->next = inner;
+  else c->out = inner;
+  c->out_tail = inner;
 
   return 0;
 }
@@ -234,36 +671,108 @@ uint8_t channel3_send(channel3_t c, lob_t inner)
 // must be called after every send or receive, pass pkt to e3x_encrypt before sending
 lob_t channel3_sending(channel3_t c)
 {
+  uint32_t seq, slot, now;
   lob_t ret;
-  if(!c || !c->out) return NULL;
-  // TODO reliability
-  ret = c->out;
-  c->out = ret->next;
-  return ret;
+  if(!c) return NULL;
+
+  if(c->out)
+  {
+    ret = c->out;
+    if(!(c->out = ret->next)) c->out_tail = NULL;
+    ret->next = NULL;
+    c->out_bytes -= lob_len(ret);
+    c->out_count--;
+    return ret;
+  }
+
+  if(!c->reliable) return NULL;
+  now = platform_ms();
+
+  // resends first, skipping any acked since they were queued
+  while(c->resend_head != c->resend_tail && congest3_sendable(c->cc,now,1))
+  {
+    seq = c->resend[c->resend_head++ & (c->window - 1)];
+    slot = seq & (c->window - 1);
+    if(seq < c->miss_nextack || !(c->out_flags[slot] & OUT_QUEUED)) continue;
+    c->out_flags[slot] = (c->out_flags[slot] & OUT_LOST) | OUT_RESENT;
+    c->out_at[slot] = c->tsent = now;
+    congest3_sent(c->cc,now,1);
+    timer_set(c,now);
+    return seq_ack(c,lob_copy(c->out_ring[slot]));
+  }
+
+  // then anything new the window and pacing allow, the ring keeps the original for resending
+  if(c->seq_sent != c->seq && congest3_sendable(c->cc,now,0))
+  {
+    slot = c->seq_sent++ & (c->window - 1);
+    c->out_at[slot] = c->tsent = now;
+    congest3_sent(c->cc,now,0);
+    timer_set(c,now);
+    return seq_ack(c,lob_copy(c->out_ring[slot]));
+  }
+
+  // held back, make sure the timer comes around to send it
+  if(c->seq_sent != c->seq || c->resend_head != c->resend_tail) timer_set(c,now);
+
+  // nothing to piggyback on
+  if(c->ack_due) return seq_ack(c,channel3_packet(c));
+
+  return NULL;
 }
 
 // size (in bytes) of buffered data in or out
 uint32_t channel3_size(channel3_t c)
 {
-  uint32_t size = 0;
-  lob_t cur;
   if(!c) return 0;
+  return c->in_bytes + c->out_bytes;
+}
 
-  // add up the sizes of the in and out buffers
-  cur = c->in;
-  while(cur)
-  {
-    size += lob_len(cur);
-    cur = cur->next;
-  }
-  cur = c->out;
-  while(cur)
-  {
-    size += lob_len(cur);
-    cur = cur->next;
-  }
+uint32_t channel3_memory(channel3_t c)
+{
+  if(!c) return 0;
+  return sizeof (struct channel3_struct) + ((c->reliable && c->in_ring) ? RINGS_BYTES(c->window) : 0);
+}
 
-  return size;
+// bytes buffered in one direction
+uint32_t channel3_size_in(channel3_t c)
+{
+  if(!c) return 0;
+  return c->in_bytes;
+}
+
+uint32_t channel3_size_out(channel3_t c)
+{
+  if(!c) return 0;
+  return c->out_bytes;
+}
+
+// channel3_send returns backpressure once out bytes reach high, until they drain to low
+void channel3_watermarks(channel3_t c, uint32_t high, uint32_t low)
+{
+  if(!c) return;
+  c->high = high;
+  c->low = (low < high) ? low : high;
+  c->blocked = 0;
+}
+
+// window and congestion state, new lob caller must free
+lob_t channel3_stats(channel3_t c)
+{
+  lob_t stats;
+  if(!c) return NULL;
+  stats = lob_new();
+  lob_set_int(stats,"c",(int)c->id);
+  lob_set_int(stats,"in_bytes",(int)c->in_bytes);
+  lob_set_int(stats,"in_count",(int)c->in_count);
+  lob_set_int(stats,"out_bytes",(int)c->out_bytes);
+  lob_set_int(stats,"out_count",(int)c->out_count);
+  if(!c->reliable) return stats;
+  lob_set_int(stats,"window",(int)c->window);
+  lob_set_int(stats,"unacked",(int)(c->seq_sent - c->miss_nextack));
+  lob_set_int(stats,"queued",(int)(c->seq - c->seq_sent));
+  lob_set_int(stats,"seq",(int)c->seq);
+  lob_set_int(stats,"seq_in",(int)c->seq_nextin);
+  return congest3_stats(c->cc,stats);
 }
 
 /*
@@ -537,4 +1046,4 @@ void channel3_miss_resend(channel3_t c)
   for(i=0;i<c->reliable;i++) if(m->out[i]) switch_send(c->s,lob_copy(m->out[i]));
 }
 
-*/
\ No newline at end of file
+*/
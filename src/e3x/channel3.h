@@ -5,22 +5,39 @@
 
 typedef struct channel3_struct *channel3_t; // standalone channel packet management, buffering and ordering
 
+// default number of packets a reliable channel buffers each way before backpressure (rounded to a power of two)
+#ifndef CHANNEL3_WINDOW
+#define CHANNEL3_WINDOW 32
+#endif
+
+// default seconds without any incoming packets before a link's channels time out
+#ifndef CHANNEL3_TIMEOUT
+#define CHANNEL3_TIMEOUT 10
+#endif
+
+// most seqs past the ack covered by the miss bitmap in any one ack (multiple of 64)
+#define CHANNEL3_MISS 512
+
 // caller must manage lists of channels per exchange3 based on cid
 channel3_t channel3_new(lob_t open); // open must be channel3_receive or channel3_send next yet
 void channel3_free(channel3_t c);
 
 // sets new timeout, or returns current time left if 0
+// schedules one event (arg is the channel) under its uid for the inactivity timeout and any reliable retransmit, the event lob stays the channel's (never free it)
 uint32_t channel3_timeout(channel3_t c, event3_t ev, uint32_t timeout);
 
 // incoming packets
-uint8_t channel3_receive(channel3_t c, lob_t inner); // usually sets/updates event timer, ret if accepted/valid into receiving queue
+uint8_t channel3_receive(channel3_t c, lob_t inner); // usually sets/updates event timer, 0 if accepted (takes inner), else caller still owns it
 void channel3_sync(channel3_t c, uint8_t sync); // false to force start timers (any new handshake), true to cancel and resend last packet (after any exchange3_sync)
 lob_t channel3_receiving(channel3_t c); // get next avail packet in order, null if nothing
 
 // outgoing packets
 lob_t channel3_packet(channel3_t c);  // creates a packet w/ necessary json, just a convenience
-uint8_t channel3_send(channel3_t c, lob_t inner); // adds to sending queue, adds json if needed
-lob_t channel3_sending(channel3_t c); // must be called after every send or receive, pass pkt to exchange3_encrypt before sending
+uint8_t channel3_send(channel3_t c, lob_t inner); // adds to sending queue, adds json if needed, 0 if taken, 2 if the reliable window is full or over the watermark (backpressure)
+lob_t channel3_sending(channel3_t c); // must be called after every send or receive, pass pkt to exchange3_encrypt before sending, caller frees
+
+// reliable channels only, resize the window before any packets are buffered, returns current size (0 if unreliable)
+uint32_t channel3_window(channel3_t c, uint32_t window);
 
 // convenience functions
 char *channel3_uid(channel3_t c); // process-unique string id
@@ -31,7 +48,22 @@ lob_t channel3_open(channel3_t c); // returns the open packet (always cached)
 enum channel3_states { ENDED, OPENING, OPEN };
 enum channel3_states channel3_state(channel3_t c);
 
+// call once its event is taken from the event3, resends after an rto or queues an incoming {"err":"timeout"} and ends
+enum channel3_states channel3_expire(channel3_t c);
+
 uint32_t channel3_size(channel3_t c); // size (in bytes) of buffered data in or out
+uint32_t channel3_size_in(channel3_t c); // just the incoming bytes waiting to be received
+uint32_t channel3_size_out(channel3_t c); // just the outgoing bytes waiting to be sent or acked
+uint32_t channel3_memory(channel3_t c); // bytes the channel itself and its rings take, not counting anything queued
+
+// once buffered out bytes reach high channel3_send returns 2 (backpressure) until they drain to low, 0 high disables
+void channel3_watermarks(channel3_t c, uint32_t high, uint32_t low);
+
+// reliable packets go out only when this congestion controller allows (usually one per link)
+void channel3_congest(channel3_t c, congest3_t cc);
+
+// returns new {"c":1,"in_bytes":0,"out_bytes":0,"window":32,"unacked":0,"cwnd":4,"srtt":20,...} caller must free
+lob_t channel3_stats(channel3_t c);
 
 
 /*
@@ -37,7 +37,7 @@ typedef struct cipher3_struct
   ephemeral_t (*ephemeral_new)(remote_t remote, lob_t outer);
   void (*ephemeral_free)(ephemeral_t ephemeral);
   lob_t (*ephemeral_encrypt)(ephemeral_t ephemeral, lob_t inner);
-  lob_t (*ephemeral_decrypt)(ephemeral_t ephemeral, lob_t outer);
+  lob_t (*ephemeral_decrypt)(ephemeral_t ephemeral, lob_t outer); // takes the outer, the returned inner reuses its buffer
 } *cipher3_t;
 
 
@@ -0,0 +1,183 @@
+#include <string.h>
+#include <stdlib.h>
+#include "e3x.h"
+#include "platform.h"
+
+// pacing tokens are fixed point, one packet is this many
+#define TOKEN 256
+
+struct congest3_struct
+{
+  uint32_t cwnd, ssthresh, acc; // acc counts acks toward the next additive increase
+  uint32_t inflight;
+  uint32_t srtt, rttvar, rto;
+  uint32_t tokens, refilled; // token bucket for pacing, and when it was last topped up
+  uint32_t recovered; // no more backing off until after this time
+  uint32_t sent, resent, lost, timeouts;
+};
+
+congest3_t congest3_new(void)
+{
+  congest3_t cc;
+  if(!(cc = malloc(sizeof (struct congest3_struct)))) return LOG("OOM");
+  memset(cc,0,sizeof (struct congest3_struct));
+  cc->cwnd = CONGEST3_CWND_INIT;
+  cc->ssthresh = CONGEST3_CWND_MAX;
+  cc->rto = CONGEST3_RTO_INIT;
+  cc->tokens = CONGEST3_BURST * TOKEN;
+  return cc;
+}
+
+void congest3_free(congest3_t cc)
+{
+  free(cc);
+}
+
+// tokens flow in at cwnd packets per srtt, capped at a small burst
+static void refill(congest3_t cc, uint32_t now)
+{
+  uint32_t elapsed = now - cc->refilled;
+  uint64_t add;
+  if(!elapsed) return;
+  cc->refilled = now;
+  if(!cc->srtt)
+  {
+    cc->tokens = CONGEST3_BURST * TOKEN;
+    return;
+  }
+  add = ((uint64_t)elapsed * cc->cwnd * TOKEN) / cc->srtt;
+  if(add + cc->tokens > CONGEST3_BURST * TOKEN) cc->tokens = CONGEST3_BURST * TOKEN;
+  else cc->tokens += (uint32_t)add;
+}
+
+uint8_t congest3_sendable(congest3_t cc, uint32_t now, uint8_t resend)
+{
+  if(!cc) return 1;
+  if(!resend && cc->inflight >= cc->cwnd) return 0;
+  refill(cc,now);
+  return (cc->tokens >= TOKEN) ? 1 : 0;
+}
+
+uint32_t congest3_wait(congest3_t cc, uint32_t now)
+{
+  uint32_t need;
+  if(!cc) return 0;
+  if(cc->inflight >= cc->cwnd) return cc->rto;
+  refill(cc,now);
+  if(cc->tokens >= TOKEN || !cc->srtt) return 0;
+  need = TOKEN - cc->tokens;
+  return (uint32_t)((((uint64_t)need * cc->srtt) + ((uint64_t)cc->cwnd * TOKEN) - 1) / ((uint64_t)cc->cwnd * TOKEN));
+}
+
+void congest3_sent(congest3_t cc, uint32_t now, uint8_t resend)
+{
+  if(!cc) return;
+  refill(cc,now);
+  if(cc->tokens >= TOKEN) cc->tokens -= TOKEN;
+  else cc->tokens = 0;
+  if(resend)
+  {
+    cc->resent++;
+    return;
+  }
+  cc->sent++;
+  cc->inflight++;
+}
+
+void congest3_done(congest3_t cc, uint32_t count)
+{
+  if(!cc) return;
+  cc->inflight = (count > cc->inflight) ? 0 : cc->inflight - count;
+}
+
+void congest3_acked(congest3_t cc, uint32_t count, uint32_t rtt)
+{
+  uint32_t diff;
+  if(!cc || !count) return;
+  congest3_done(cc,count);
+
+  // rfc6298 style smoothing
+  if(rtt)
+  {
+    if(!cc->srtt)
+    {
+      cc->srtt = rtt;
+      cc->rttvar = rtt / 2;
+    }else{
+      diff = (cc->srtt > rtt) ? cc->srtt - rtt : rtt - cc->srtt;
+      cc->rttvar = ((3 * cc->rttvar) + diff) / 4;
+      cc->srtt = ((7 * cc->srtt) + rtt) / 8;
+      if(!cc->srtt) cc->srtt = 1;
+    }
+    cc->rto = cc->srtt + (cc->rttvar ? cc->rttvar * 4 : 1);
+    if(cc->rto < CONGEST3_RTO_MIN) cc->rto = CONGEST3_RTO_MIN;
+    if(cc->rto > CONGEST3_RTO_MAX) cc->rto = CONGEST3_RTO_MAX;
+  }
+
+  // slow start doubles each rtt, then one more packet per window of acks
+  while(count--)
+  {
+    if(cc->cwnd >= CONGEST3_CWND_MAX) break;
+    if(cc->cwnd < cc->ssthresh)
+    {
+      cc->cwnd++;
+      continue;
+    }
+    if(++cc->acc < cc->cwnd) continue;
+    cc->acc = 0;
+    cc->cwnd++;
+  }
+}
+
+void congest3_lost(congest3_t cc, uint32_t now, uint8_t timeout)
+{
+  if(!cc) return;
+  cc->lost++;
+
+  // one back off per window of losses
+  if(cc->recovered && (int32_t)(now - cc->recovered) < 0 && !timeout) return;
+  cc->recovered = now + (cc->srtt ? cc->srtt : cc->rto);
+  if(!cc->recovered) cc->recovered = 1;
+
+  cc->ssthresh = cc->cwnd / 2;
+  if(cc->ssthresh < CONGEST3_CWND_MIN) cc->ssthresh = CONGEST3_CWND_MIN;
+  cc->acc = 0;
+  if(timeout)
+  {
+    // nothing is getting through, start over and back off the timer
+    cc->timeouts++;
+    cc->cwnd = CONGEST3_CWND_MIN;
+    cc->rto = (cc->rto * 2 > CONGEST3_RTO_MAX) ? CONGEST3_RTO_MAX : cc->rto * 2;
+    return;
+  }
+  cc->cwnd = cc->ssthresh;
+}
+
+uint32_t congest3_rto(congest3_t cc)
+{
+  if(!cc) return CONGEST3_RTO_INIT;
+  return cc->rto;
+}
+
+uint32_t congest3_rtt(congest3_t cc)
+{
+  if(!cc) return 0;
+  return cc->srtt;
+}
+
+lob_t congest3_stats(congest3_t cc, lob_t stats)
+{
+  if(!stats) stats = lob_new();
+  if(!cc) return stats;
+  lob_set_int(stats,"cwnd",(int)cc->cwnd);
+  lob_set_int(stats,"ssthresh",(int)cc->ssthresh);
+  lob_set_int(stats,"inflight",(int)cc->inflight);
+  lob_set_int(stats,"srtt",(int)cc->srtt);
+  lob_set_int(stats,"rttvar",(int)cc->rttvar);
+  lob_set_int(stats,"rto",(int)cc->rto);
+  lob_set_int(stats,"sent",(int)cc->sent);
+  lob_set_int(stats,"resent",(int)cc->resent);
+  lob_set_int(stats,"lost",(int)cc->lost);
+  lob_set_int(stats,"timeouts",(int)cc->timeouts);
+  return stats;
+}
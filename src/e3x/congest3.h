@@ -0,0 +1,51 @@
+#ifndef congest3_h
+#define congest3_h
+
+#include <stdint.h>
+#include "../lib/lob.h"
+
+// per-link congestion control (AIMD) and pacing for reliable channel packets
+// all times are in ms from platform_ms(), callers pass in now so it can be driven by any clock
+
+typedef struct congest3_struct *congest3_t;
+
+#define CONGEST3_CWND_INIT 4 // packets in flight before any acks
+#define CONGEST3_CWND_MIN 2
+#define CONGEST3_CWND_MAX 1024
+#define CONGEST3_BURST 4 // most packets sent back to back when pacing
+#define CONGEST3_RTO_INIT 1000 // before any rtt samples (or without a controller)
+#define CONGEST3_RTO_MIN 200
+#define CONGEST3_RTO_MAX 60000
+
+congest3_t congest3_new(void);
+void congest3_free(congest3_t cc);
+
+// 1 if the window and pacing allow another packet out right now, resends only wait on pacing
+uint8_t congest3_sendable(congest3_t cc, uint32_t now, uint8_t resend);
+
+// ms until the next packet may go, the rto when waiting on acks
+uint32_t congest3_wait(congest3_t cc, uint32_t now);
+
+// a packet went out, resends don't add to what's in flight
+void congest3_sent(congest3_t cc, uint32_t now, uint8_t resend);
+
+// count packets were newly acked, with an rtt sample in ms if there is one (0 if none)
+void congest3_acked(congest3_t cc, uint32_t count, uint32_t rtt);
+
+// the other side reported a miss or the rto fired, backs off at most once per rtt
+// what's in flight is left alone since other channels share it, the timed out one calls congest3_done for its own packets
+void congest3_lost(congest3_t cc, uint32_t now, uint8_t timeout);
+
+// count packets are no longer in flight without being acked (channel went away)
+void congest3_done(congest3_t cc, uint32_t count);
+
+// current retransmit timeout in ms
+uint32_t congest3_rto(congest3_t cc);
+
+// smoothed rtt in ms, 0 until there's a sample
+uint32_t congest3_rtt(congest3_t cc);
+
+// adds cwnd/ssthresh/inflight/srtt/rttvar/rto/sent/resent/lost to the stats (new if NULL)
+lob_t congest3_stats(congest3_t cc, lob_t stats);
+
+#endif
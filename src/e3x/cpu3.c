@@ -0,0 +1,119 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "cpu3.h"
+#include "../lib/chacha.h"
+#include "../lib/base32.h"
+#include "../platform.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CPU3_X86
+#endif
+
+#define CPU3_BINDS 8
+
+static uint32_t _features = 0;
+
+// every bound primitive, for reporting
+static struct cpu3_bind_struct
+{
+  char *primitive;
+  cpu3_select_t select;
+} _binds[CPU3_BINDS];
+
+static struct
+{
+  uint32_t bit;
+  char *name;
+} _names[] = {
+  {CPU3_SSE2, "sse2"},
+  {CPU3_SSSE3, "ssse3"},
+  {CPU3_SSE41, "sse4.1"},
+  {CPU3_AVX2, "avx2"},
+  {CPU3_AES, "aes"},
+  {CPU3_SHA, "sha"}
+};
+
+static uint32_t cpu3_detect(void)
+{
+  uint32_t features = 0;
+#ifdef CPU3_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("sse2")) features |= CPU3_SSE2;
+  if(__builtin_cpu_supports("ssse3")) features |= CPU3_SSSE3;
+  if(__builtin_cpu_supports("sse4.1")) features |= CPU3_SSE41;
+  if(__builtin_cpu_supports("avx2")) features |= CPU3_AVX2;
+  if(__builtin_cpu_supports("aes")) features |= CPU3_AES;
+  if(__builtin_cpu_supports("sha")) features |= CPU3_SHA;
+#endif
+  return features;
+}
+
+uint8_t cpu3_init(lob_t options)
+{
+  _features = cpu3_detect();
+  memset(_binds, 0, sizeof(_binds));
+
+  cpu3_bind(options, "chacha20", chacha20_impl);
+  cpu3_bind(options, "base32", base32_impl);
+
+  return 0;
+}
+
+uint32_t cpu3_features(void)
+{
+  return _features;
+}
+
+const char *cpu3_bind(lob_t options, char *primitive, cpu3_select_t select)
+{
+  char key[32];
+  char *name;
+  const char *ret;
+  int i;
+
+  if(!primitive || !select) return LOG("bad args");
+
+  // a specific override wins over the general one
+  snprintf(key, sizeof(key), "cpu_%s", primitive);
+  if(!(name = lob_get(options, key))) name = lob_get(options, "cpu");
+
+  if(!(ret = select(name)))
+  {
+    LOG("no %s kernel for %s, using the best available",name,primitive);
+    ret = select(NULL);
+  }
+
+  for(i = 0; i < CPU3_BINDS; i++)
+  {
+    if(_binds[i].primitive && strcmp(_binds[i].primitive, primitive) != 0) continue;
+    _binds[i].primitive = primitive;
+    _binds[i].select = select;
+    break;
+  }
+
+  LOG("%s bound to %s",primitive,ret);
+  return ret;
+}
+
+lob_t cpu3_report(void)
+{
+  char features[64];
+  lob_t report;
+  unsigned int i, len;
+
+  for(features[0] = 0, len = i = 0; i < sizeof(_names)/sizeof(_names[0]); i++)
+  {
+    if(!(_features & _names[i].bit)) continue;
+    len += snprintf(features+len, sizeof(features)-len, "%s%s", len ? " " : "", _names[i].name);
+  }
+
+  report = lob_new();
+  lob_set(report, "features", features);
+  for(i = 0; i < CPU3_BINDS && _binds[i].primitive; i++)
+  {
+    lob_set(report, _binds[i].primitive, (char*)_binds[i].select(NULL));
+  }
+
+  return report;
+}
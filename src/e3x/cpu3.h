@@ -0,0 +1,33 @@
+#ifndef cpu3_h
+#define cpu3_h
+
+#include <stdint.h>
+#include "../lib/lob.h"
+
+// runtime cpu feature detection and kernel selection for the crypto primitives
+// features are detected once by e3x_init(), each primitive is then bound to the best kernel for them
+
+#define CPU3_SSE2   0x01
+#define CPU3_SSSE3  0x02
+#define CPU3_SSE41  0x04
+#define CPU3_AVX2   0x08
+#define CPU3_AES    0x10
+#define CPU3_SHA    0x20
+
+// a primitive's kernel selector, NULL picks the best available, returns the active kernel name or NULL if unavailable
+typedef const char *(*cpu3_select_t)(const char *name);
+
+// detect features and bind the library primitives (chacha20, base32)
+// options "cpu":"portable" forces every primitive portable, "cpu_<primitive>":"<kernel>" overrides just one
+uint8_t cpu3_init(lob_t options);
+
+// the detected CPU3_* bits
+uint32_t cpu3_features(void);
+
+// bind a primitive to a kernel honoring any options override, cipher sets call this for the primitives they own
+const char *cpu3_bind(lob_t options, char *primitive, cpu3_select_t select);
+
+// returns new json of the features and the kernel bound to each primitive, e.g. {"features":"sse2 aes","aes":"aesni"}
+lob_t cpu3_report(void);
+
+#endif
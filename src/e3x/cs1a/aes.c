@@ -1,6 +1,15 @@
+#include <string.h>
+#include <stdint.h>
 #include "aes128.h"
+#include "aes.h"
 
-void aes_128_ctr(unsigned char *key, size_t length, unsigned char iv[16], const unsigned char *input, unsigned char *output)
+// x86 builds with gcc/clang get an AES-NI kernel, picked at runtime
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(NOAES_NI)
+#define AES_X86
+#include <immintrin.h>
+#endif
+
+static void ctr_portable(unsigned char *key, size_t length, unsigned char iv[16], const unsigned char *input, unsigned char *output)
 {
   aes_context ctx;
   size_t off = 0;
@@ -10,3 +19,148 @@ void aes_128_ctr(unsigned char *key, size_t length, unsigned char iv[16], const
   aes_crypt_ctr(&ctx,length,&off,iv,block,input,output);
 }
 
+#ifdef AES_X86
+
+#define AESNI_EXPAND(k,rcon) aesni_expand(k, _mm_aeskeygenassist_si128(k, rcon))
+
+__attribute__((target("aes,sse2")))
+static __m128i aesni_expand(__m128i key, __m128i gen)
+{
+  gen = _mm_shuffle_epi32(gen, 0xff);
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  return _mm_xor_si128(key, gen);
+}
+
+// big endian 128bit counter, same stepping as aes_crypt_ctr()
+static uint64_t ctr_load(const unsigned char *b)
+{
+  uint64_t v = 0;
+  int i;
+  for(i = 0; i < 8; i++) v = (v << 8) | b[i];
+  return v;
+}
+
+static void ctr_store(unsigned char *b, uint64_t v)
+{
+  int i;
+  for(i = 7; i >= 0; i--, v >>= 8) b[i] = (unsigned char)v;
+}
+
+__attribute__((target("aes,sse2")))
+static __m128i ctr_block(uint64_t hi, uint64_t lo)
+{
+  return _mm_set_epi64x((long long)__builtin_bswap64(lo), (long long)__builtin_bswap64(hi));
+}
+
+__attribute__((target("aes,sse2")))
+static void ctr_aesni(unsigned char *key, size_t length, unsigned char iv[16], const unsigned char *input, unsigned char *output)
+{
+  __m128i rk[11], b[4];
+  unsigned char last[16];
+  uint64_t hi, lo;
+  size_t i;
+  int r, j;
+
+  rk[0] = _mm_loadu_si128((const __m128i*)key);
+  rk[1] = AESNI_EXPAND(rk[0], 0x01);
+  rk[2] = AESNI_EXPAND(rk[1], 0x02);
+  rk[3] = AESNI_EXPAND(rk[2], 0x04);
+  rk[4] = AESNI_EXPAND(rk[3], 0x08);
+  rk[5] = AESNI_EXPAND(rk[4], 0x10);
+  rk[6] = AESNI_EXPAND(rk[5], 0x20);
+  rk[7] = AESNI_EXPAND(rk[6], 0x40);
+  rk[8] = AESNI_EXPAND(rk[7], 0x80);
+  rk[9] = AESNI_EXPAND(rk[8], 0x1b);
+  rk[10] = AESNI_EXPAND(rk[9], 0x36);
+
+  hi = ctr_load(iv);
+  lo = ctr_load(iv+8);
+
+  // four blocks in flight to keep the aes unit busy
+  for(i = 0; i + 64 <= length; i += 64)
+  {
+    for(j = 0; j < 4; j++)
+    {
+      b[j] = _mm_xor_si128(ctr_block(hi, lo), rk[0]);
+      if(++lo == 0) hi++;
+    }
+    for(r = 1; r < 10; r++) for(j = 0; j < 4; j++) b[j] = _mm_aesenc_si128(b[j], rk[r]);
+    for(j = 0; j < 4; j++)
+    {
+      b[j] = _mm_aesenclast_si128(b[j], rk[10]);
+      _mm_storeu_si128((__m128i*)(output+i+(16*j)), _mm_xor_si128(b[j], _mm_loadu_si128((const __m128i*)(input+i+(16*j)))));
+    }
+  }
+
+  for(; i < length; i += 16)
+  {
+    b[0] = _mm_xor_si128(ctr_block(hi, lo), rk[0]);
+    if(++lo == 0) hi++;
+    for(r = 1; r < 10; r++) b[0] = _mm_aesenc_si128(b[0], rk[r]);
+    b[0] = _mm_aesenclast_si128(b[0], rk[10]);
+    if(length - i >= 16)
+    {
+      _mm_storeu_si128((__m128i*)(output+i), _mm_xor_si128(b[0], _mm_loadu_si128((const __m128i*)(input+i))));
+      continue;
+    }
+    _mm_storeu_si128((__m128i*)last, b[0]);
+    for(j = 0; i + j < length; j++) output[i+j] = input[i+j] ^ last[j];
+  }
+
+  ctr_store(iv, hi);
+  ctr_store(iv+8, lo);
+}
+
+#endif // AES_X86
+
+static struct aes_impl_struct
+{
+  const char *name;
+  void (*ctr)(unsigned char *key, size_t length, unsigned char iv[16], const unsigned char *input, unsigned char *output);
+} _impls[] = {
+#ifdef AES_X86
+  {"aesni", ctr_aesni},
+#endif
+  {"portable", ctr_portable}
+};
+
+static struct aes_impl_struct *_impl = 0;
+
+static int impl_supported(struct aes_impl_struct *impl)
+{
+#ifdef AES_X86
+  __builtin_cpu_init();
+  if(impl->ctr == ctr_aesni) return __builtin_cpu_supports("aes") && __builtin_cpu_supports("sse2");
+#endif
+  return 1;
+}
+
+const char *aes_128_ctr_impl(const char *name)
+{
+  unsigned int i;
+
+  if(!name && _impl) return _impl->name;
+  for(i = 0; i < sizeof(_impls)/sizeof(_impls[0]); i++)
+  {
+    if(name && strcmp(name,_impls[i].name) != 0) continue;
+    if(!impl_supported(&_impls[i])) continue;
+    _impl = &_impls[i];
+    return _impl->name;
+  }
+
+  return 0;
+}
+
+void aes_128_init(void)
+{
+  aes_init();
+  if(!_impl) aes_128_ctr_impl(0);
+}
+
+void aes_128_ctr(unsigned char *key, size_t length, unsigned char iv[16], const unsigned char *input, unsigned char *output)
+{
+  if(!_impl) aes_128_ctr_impl(0);
+  _impl->ctr(key,length,iv,input,output);
+}
@@ -3,6 +3,14 @@
 
 #include <stddef.h>
 
+// select the ctr kernel ("aesni" or "portable"), NULL reports the active one (the best this cpu supports unless set)
+// returns the active kernel name, or NULL if the named one isn't available here
+const char *aes_128_ctr_impl(const char *name);
+
+// builds the shared tables and picks a kernel, before any threads start (cs1a_init does it)
+void aes_128_init(void);
+
+// output may be input or anywhere before it (decrypting down in place), never after it
 void aes_128_ctr(unsigned char *key, size_t length, unsigned char nonce_counter[16], const unsigned char *input, unsigned char *output);
 
 #endif
@@ -173,21 +173,28 @@ static void aes_gen_tables( void )
 
 
 /*
- * AES key schedule (encryption)
+ * Table generation, done once up front so threads never race to do it
  */
-int aes_setkey_enc( aes_context *ctx, const unsigned char *key, unsigned int keysize )
+void aes_init( void )
 {
-    unsigned int i;
-    uint32_t *RK;
-
 #if !defined(POLARSSL_AES_ROM_TABLES)
     if( aes_init_done == 0 )
     {
         aes_gen_tables();
         aes_init_done = 1;
-
     }
 #endif
+}
+
+/*
+ * AES key schedule (encryption)
+ */
+int aes_setkey_enc( aes_context *ctx, const unsigned char *key, unsigned int keysize )
+{
+    unsigned int i;
+    uint32_t *RK;
+
+    aes_init();
 
     switch( keysize )
     {
@@ -58,6 +58,11 @@ typedef struct
 }
 aes_context;
 
+/**
+ * \brief          Generate the AES tables, call once before any threads use them
+ */
+void aes_init( void );
+
 /**
  * \brief          AES key schedule (encryption)
  *
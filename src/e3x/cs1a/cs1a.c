@@ -77,6 +77,11 @@ cipher3_t cs1a_init(lob_t options)
   // normal init stuff
   uECC_set_rng(&RNG);
 
+  // pick the aes and sha256 kernels for this cpu
+  cpu3_bind(options,"aes",aes_128_ctr_impl);
+  cpu3_bind(options,"sha256",sha256_impl);
+  aes_128_init();
+
   // configure our callbacks (no RNG, default to platform's)
   ret->hash = cipher_hash;
   ret->err = cipher_err;
@@ -168,7 +173,8 @@ void local_free(local_t local)
 lob_t local_decrypt(local_t local, lob_t outer)
 {
   uint8_t key[uECC_BYTES*2], shared[uECC_BYTES], iv[16], hash[32];
-  lob_t inner, tmp;
+  uint32_t len;
+  lob_t inner;
 
 //  * `KEY` - 21 bytes, the sender's ephemeral exchange public key in compressed format
 //  * `IV` - 4 bytes, a random but unique value determined by the sender
@@ -176,23 +182,22 @@ lob_t local_decrypt(local_t local, lob_t outer)
 //  * `HMAC` - 4 bytes, the calculated HMAC of all of the previous KEY+INNER bytes
 
   if(outer->body_len <= (21+4+0+4)) return NULL;
-  tmp = lob_new();
-  if(!lob_body(tmp,NULL,outer->body_len-(4+21+4))) return lob_free(tmp);
+  len = outer->body_len-(4+21+4);
 
   // get the shared secret to create the iv+key for the open aes
   uECC_decompress(outer->body,key);
-  if(!uECC_shared_secret(key, local->secret, shared)) return lob_free(tmp);
+  if(!uECC_shared_secret(key, local->secret, shared)) return NULL;
   e3x_hash(shared,uECC_BYTES,hash);
   fold1(hash,hash);
   memset(iv,0,16);
   memcpy(iv,outer->body+21,4);
 
-  // decrypt the inner
-  aes_128_ctr(hash,tmp->body_len,iv,outer->body+4+21,tmp->body);
+  // decrypt straight into the inner's buffer and parse it there
+  inner = lob_new();
+  if(!lob_body(inner,NULL,len)) return lob_free(inner);
+  aes_128_ctr(hash,len,iv,outer->body+4+21,inner->raw);
+  if(!lob_reparse(inner,0,len)) return lob_free(inner);
 
-  // load inner packet
-  inner = lob_parse(tmp->body,tmp->body_len);
-  lob_free(tmp);
   return inner;
 }
 
@@ -358,6 +363,14 @@ lob_t ephemeral_encrypt(ephemeral_t ephem, lob_t inner)
 lob_t ephemeral_decrypt(ephemeral_t ephem, lob_t outer)
 {
   uint8_t iv[16], hmac[32];
+  uint32_t len;
+
+  if(outer->body_len <= (16+4+4))
+  {
+    LOG("outer too small");
+    return lob_free(outer);
+  }
+  len = outer->body_len-(16+4+4);
 
   memset(iv,0,16);
   memcpy(iv,outer->body+16,4);
@@ -365,14 +378,18 @@ lob_t ephemeral_decrypt(ephemeral_t ephem, lob_t outer)
   memcpy(hmac,ephem->deckey,16);
   memcpy(hmac+16,iv,4);
   // mac just the ciphertext
-  hmac_256(hmac,16+4,outer->body+16+4,outer->body_len-(4+16+4),hmac);
+  hmac_256(hmac,16+4,outer->body+16+4,len,hmac);
   fold3(hmac,hmac);
 
-  if(memcmp(hmac,outer->body+(outer->body_len-4),4) != 0) return LOG("hmac failed");
+  if(memcmp(hmac,outer->body+(outer->body_len-4),4) != 0)
+  {
+    LOG("hmac failed");
+    return lob_free(outer);
+  }
 
-  // decrypt in place
-  aes_128_ctr(ephem->deckey,outer->body_len-(16+4+4),iv,outer->body+16+4,outer->body+16+4);
+  // decrypt down to the front of the outer's buffer, it becomes the inner
+  aes_128_ctr(ephem->deckey,len,iv,outer->body+16+4,outer->raw);
+  if(!lob_reparse(outer,0,len)) return lob_free(outer);
 
-  // return parse attempt
-  return lob_parse(outer->body+16+4, outer->body_len-(16+4+4));
+  return outer;
 }
@@ -30,6 +30,8 @@
 
 #include "sha256.h"
 
+#include <string.h>
+
 /*
  * 32-bit integer manipulation macros (big endian)
  */
@@ -89,7 +91,7 @@ void sha256_starts( sha256_context *ctx, int is224 )
     ctx->is224 = is224;
 }
 
-void sha256_process( sha256_context *ctx, const unsigned char data[64] )
+static void sha256_process_portable( sha256_context *ctx, const unsigned char data[64] )
 {
     uint32_t temp1, temp2, W[64];
     uint32_t A, B, C, D, E, F, G, H;
@@ -220,6 +222,106 @@ void sha256_process( sha256_context *ctx, const unsigned char data[64] )
     ctx->state[7] += H;
 }
 
+/*
+ * SHA-NI kernel for x86 builds with gcc/clang, picked at runtime
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(NOSHA_NI)
+#define SHA256_X86
+#include <immintrin.h>
+
+static const uint32_t K256[64] =
+{
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+};
+
+__attribute__((target("sha,sse4.1,ssse3")))
+static void sha256_process_shani( sha256_context *ctx, const unsigned char data[64] )
+{
+    __m128i state0, state1, msg, tmp, abef, cdgh, w[4];
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    int i;
+
+    /* state is kept as ABEF/CDGH for the round instructions */
+    tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) &ctx->state[0]), 0xB1);
+    state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) &ctx->state[4]), 0x1B);
+    state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+    abef = state0;
+    cdgh = state1;
+
+    for( i = 0; i < 16; i++ )
+    {
+        if( i < 4 )
+            w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (data + 16 * i)), mask);
+        else
+        {
+            /* W[t] = W[t-16] + s0(W[t-15]) + W[t-7] + s1(W[t-2]) */
+            tmp = _mm_sha256msg1_epu32(w[i & 3], w[(i + 1) & 3]);
+            tmp = _mm_add_epi32(tmp, _mm_alignr_epi8(w[(i + 3) & 3], w[(i + 2) & 3], 4));
+            w[i & 3] = _mm_sha256msg2_epu32(tmp, w[(i + 3) & 3]);
+        }
+
+        msg = _mm_add_epi32(w[i & 3], _mm_loadu_si128((const __m128i*) &K256[4 * i]));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+        msg = _mm_shuffle_epi32(msg, 0x0E);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+    }
+
+    state0 = _mm_add_epi32(state0, abef);
+    state1 = _mm_add_epi32(state1, cdgh);
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    _mm_storeu_si128((__m128i*) &ctx->state[0], state0);
+    _mm_storeu_si128((__m128i*) &ctx->state[4], state1);
+}
+#endif /* SHA256_X86 */
+
+static void (*sha256_kernel)( sha256_context *ctx, const unsigned char data[64] ) = NULL;
+static const char *sha256_kernel_name = NULL;
+
+/*
+ * SHA-256 kernel selection
+ */
+const char *sha256_impl( const char *name )
+{
+    if( name == NULL && sha256_kernel != NULL )
+        return( sha256_kernel_name );
+
+#if defined(SHA256_X86)
+    __builtin_cpu_init();
+    if( ( name == NULL || strcmp( name, "shani" ) == 0 ) &&
+        __builtin_cpu_supports( "sha" ) && __builtin_cpu_supports( "sse4.1" ) )
+    {
+        sha256_kernel = sha256_process_shani;
+        return( sha256_kernel_name = "shani" );
+    }
+#endif
+
+    if( name != NULL && strcmp( name, "portable" ) != 0 )
+        return( NULL );
+
+    sha256_kernel = sha256_process_portable;
+    return( sha256_kernel_name = "portable" );
+}
+
+void sha256_process( sha256_context *ctx, const unsigned char data[64] )
+{
+    if( sha256_kernel == NULL )
+        sha256_impl( NULL );
+
+    sha256_kernel( ctx, data );
+}
+
 /*
  * SHA-256 process buffer
  */
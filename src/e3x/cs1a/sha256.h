@@ -42,6 +42,7 @@ extern "C" {
 
 // namespace conflict avoidance
 #define sha256_process _sha256_process
+#define sha256_impl _sha256_impl
 
 /**
  * \brief          SHA-256 context structure
@@ -86,6 +87,17 @@ void sha256_finish( sha256_context *ctx, unsigned char output[32] );
 /* Internal use */
 void sha256_process( sha256_context *ctx, const unsigned char data[64] );
 
+/**
+ * \brief          Select the block kernel ("shani" or "portable")
+ *
+ * \param name     kernel name, NULL reports the active one (the best
+ *                 this cpu supports unless set)
+ *
+ * \return         the active kernel name, or NULL if the named one
+ *                 isn't available here
+ */
+const char *sha256_impl( const char *name );
+
 /**
  * \brief          Output = SHA-256( input buffer )
  *
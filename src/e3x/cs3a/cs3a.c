@@ -0,0 +1,355 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <sodium.h>
+
+#include "cipher3.h"
+#include "e3x.h"
+#include "platform.h"
+
+// undefine the void* aliases so we can define them locally
+#undef local_t
+#undef remote_t
+#undef ephemeral_t
+
+typedef struct local_struct
+{
+  uint8_t secret[crypto_box_SECRETKEYBYTES], key[crypto_box_PUBLICKEYBYTES];
+} *local_t;
+
+typedef struct remote_struct
+{
+  uint8_t key[crypto_box_PUBLICKEYBYTES];
+  uint8_t esecret[crypto_box_SECRETKEYBYTES], ekey[crypto_box_PUBLICKEYBYTES];
+} *remote_t;
+
+typedef struct ephemeral_struct
+{
+  uint8_t enckey[crypto_secretbox_KEYBYTES], deckey[crypto_secretbox_KEYBYTES], token[16];
+} *ephemeral_t;
+
+// these are all the locally implemented handlers defined in cipher3.h
+
+static uint8_t *cipher_rand(uint8_t *s, uint32_t len);
+static uint8_t *cipher_hash(uint8_t *input, uint32_t len, uint8_t *output);
+static uint8_t *cipher_err(void);
+static uint8_t cipher_generate(lob_t keys, lob_t secrets);
+
+static local_t local_new(lob_t keys, lob_t secrets);
+static void local_free(local_t local);
+static lob_t local_decrypt(local_t local, lob_t outer);
+
+static remote_t remote_new(lob_t key, uint8_t *token);
+static void remote_free(remote_t remote);
+static uint8_t remote_verify(remote_t remote, local_t local, lob_t outer);
+static lob_t remote_encrypt(remote_t remote, local_t local, lob_t inner);
+
+static ephemeral_t ephemeral_new(remote_t remote, lob_t outer);
+static void ephemeral_free(ephemeral_t ephemeral);
+static lob_t ephemeral_encrypt(ephemeral_t ephemeral, lob_t inner);
+static lob_t ephemeral_decrypt(ephemeral_t ephemeral, lob_t outer);
+
+cipher3_t cs3a_init(lob_t options)
+{
+  cipher3_t ret;
+
+  if(sodium_init() == -1)
+  {
+    lob_set(options,"err","sodium_init failed");
+    return LOG("sodium_init failed");
+  }
+
+  if(!(ret = malloc(sizeof(struct cipher3_struct)))) return NULL;
+  memset(ret,0,sizeof (struct cipher3_struct));
+
+  // identifying markers
+  ret->id = CS_3a;
+  ret->csid = 0x3a;
+  memcpy(ret->hex,"3a",3);
+
+  // configure our callbacks
+  ret->rand = cipher_rand;
+  ret->hash = cipher_hash;
+  ret->err = cipher_err;
+  ret->generate = cipher_generate;
+
+  // need to cast these to map our struct types to voids
+  ret->local_new = (void *(*)(lob_t, lob_t))local_new;
+  ret->local_free = (void (*)(void *))local_free;
+  ret->local_decrypt = (lob_t (*)(void *, lob_t))local_decrypt;
+  ret->remote_new = (void *(*)(lob_t, uint8_t *))remote_new;
+  ret->remote_free = (void (*)(void *))remote_free;
+  ret->remote_verify = (uint8_t (*)(void *, void *, lob_t))remote_verify;
+  ret->remote_encrypt = (lob_t (*)(void *, void *, lob_t))remote_encrypt;
+  ret->ephemeral_new = (void *(*)(void *, lob_t))ephemeral_new;
+  ret->ephemeral_free = (void (*)(void *))ephemeral_free;
+  ret->ephemeral_encrypt = (lob_t (*)(void *, lob_t))ephemeral_encrypt;
+  ret->ephemeral_decrypt = (lob_t (*)(void *, lob_t))ephemeral_decrypt;
+
+  return ret;
+}
+
+uint8_t *cipher_rand(uint8_t *s, uint32_t len)
+{
+  randombytes_buf((void * const)s, (const size_t)len);
+  return s;
+}
+
+uint8_t *cipher_hash(uint8_t *input, uint32_t len, uint8_t *output)
+{
+  crypto_hash_sha256(output,input,(unsigned long)len);
+  return output;
+}
+
+uint8_t *cipher_err(void)
+{
+  return 0;
+}
+
+uint8_t cipher_generate(lob_t keys, lob_t secrets)
+{
+  uint8_t secret[crypto_box_SECRETKEYBYTES], key[crypto_box_PUBLICKEYBYTES];
+
+  if(crypto_box_keypair(key,secret)) return 1;
+  lob_set_base32(keys,"3a",key,crypto_box_PUBLICKEYBYTES);
+  lob_set_base32(secrets,"3a",secret,crypto_box_SECRETKEYBYTES);
+
+  return 0;
+}
+
+local_t local_new(lob_t keys, lob_t secrets)
+{
+  local_t local;
+  lob_t key, secret;
+
+  if(!keys) keys = lob_linked(secrets); // for convenience
+  key = lob_get_base32(keys,"3a");
+  if(!key || key->body_len != crypto_box_PUBLICKEYBYTES) return LOG("invalid key %d != %d",(key)?key->body_len:0,crypto_box_PUBLICKEYBYTES);
+
+  secret = lob_get_base32(secrets,"3a");
+  if(!secret || secret->body_len != crypto_box_SECRETKEYBYTES) return LOG("invalid secret len %d",(secret)?secret->body_len:0);
+
+  if(!(local = malloc(sizeof(struct local_struct)))) return NULL;
+  memset(local,0,sizeof (struct local_struct));
+
+  // copy in key/secret data
+  memcpy(local->key,key->body,key->body_len);
+  memcpy(local->secret,secret->body,secret->body_len);
+  lob_free(key);
+  lob_free(secret);
+
+  return local;
+}
+
+void local_free(local_t local)
+{
+  free(local);
+  return;
+}
+
+lob_t local_decrypt(local_t local, lob_t outer)
+{
+  uint8_t secret[crypto_box_BEFORENMBYTES];
+  uint32_t len;
+  lob_t inner;
+
+//  * `KEY` - 32 bytes, the sending exchange's ephemeral public key
+//  * `NONCE` - 24 bytes, randomly generated
+//  * `CIPHERTEXT` - the inner packet bytes encrypted using secretbox() using the `NONCE` as the nonce and the shared secret (derived from the recipients endpoint key and the included ephemeral key) as the key
+//  * `AUTH` - 16 bytes, the calculated onetimeauth(`KEY` + `INNER`, SHA256(`NONCE` + secret)) using the shared secret derived from both endpoint keys, the hashing is to minimize the chance that the same key input is ever used twice
+
+  if(outer->body_len <= (32+24+crypto_secretbox_MACBYTES+16)) return NULL;
+  len = outer->body_len-(32+24+crypto_secretbox_MACBYTES+16);
+
+  // get the shared secret, fails for a low-order key
+  if(crypto_box_beforenm(secret, outer->body, local->secret) != 0) return LOG("box_beforenm failed");
+
+  // decrypt straight into the inner's buffer and parse it there
+  inner = lob_new();
+  if(!lob_body(inner,NULL,len)) return lob_free(inner);
+  if(crypto_secretbox_open_easy(inner->raw,
+    outer->body+32+24,
+    len+crypto_secretbox_MACBYTES,
+    outer->body+32,
+    secret) != 0) return lob_free(inner);
+  if(!lob_reparse(inner,0,len)) return lob_free(inner);
+
+  return inner;
+}
+
+remote_t remote_new(lob_t key, uint8_t *token)
+{
+  uint8_t hash[32];
+  remote_t remote;
+  if(!key || key->body_len != crypto_box_PUBLICKEYBYTES) return LOG("invalid key %d != %d",(key)?key->body_len:0,crypto_box_PUBLICKEYBYTES);
+
+  if(!(remote = malloc(sizeof(struct remote_struct)))) return NULL;
+  memset(remote,0,sizeof (struct remote_struct));
+
+  // copy in key and make ephemeral ones
+  memcpy(remote->key,key->body,key->body_len);
+  crypto_box_keypair(remote->ekey,remote->esecret);
+  if(token)
+  {
+    cipher_hash(remote->ekey,16,hash);
+    memcpy(token,hash,16);
+  }
+
+  return remote;
+}
+
+void remote_free(remote_t remote)
+{
+  free(remote);
+}
+
+uint8_t remote_verify(remote_t remote, local_t local, lob_t outer)
+{
+  uint8_t secret[crypto_box_BEFORENMBYTES], shared[24+crypto_box_BEFORENMBYTES], hash[32];
+
+  if(!remote || !local || !outer) return 1;
+  if(outer->head_len != 1 || outer->head[0] != 0x3a) return 2;
+  if(outer->body_len <= (32+24+crypto_secretbox_MACBYTES+16)) return 3;
+
+  // generate the key for the auth, combining the nonce and the shared secret
+  if(crypto_box_beforenm(secret, remote->key, local->secret) != 0)
+  {
+    LOG("box_beforenm failed");
+    return 5;
+  }
+  memcpy(shared,outer->body+32,24);
+  memcpy(shared+24,secret,crypto_box_BEFORENMBYTES);
+  cipher_hash(shared,24+crypto_box_BEFORENMBYTES,hash);
+
+  // verify
+  if(crypto_onetimeauth_verify(outer->body+(outer->body_len-crypto_onetimeauth_BYTES),outer->body,outer->body_len-crypto_onetimeauth_BYTES,hash) != 0)
+  {
+    LOG("onetimeauth failed");
+    return 4;
+  }
+
+  return 0;
+}
+
+lob_t remote_encrypt(remote_t remote, local_t local, lob_t inner)
+{
+  uint8_t secret[crypto_box_BEFORENMBYTES], shared[24+crypto_box_BEFORENMBYTES], hash[32], csid = 0x3a;
+  lob_t outer;
+  uint32_t inner_len;
+
+  outer = lob_new();
+  lob_head(outer,&csid,1);
+  inner_len = lob_len(inner);
+  if(!lob_body(outer,NULL,32+24+inner_len+crypto_secretbox_MACBYTES+16)) return lob_free(outer);
+
+  // copy in the ephemeral public key and a fresh nonce
+  memcpy(outer->body, remote->ekey, crypto_box_PUBLICKEYBYTES);
+  randombytes_buf(outer->body+32,24);
+
+  // get the shared secret to encrypt the inner
+  if(crypto_box_beforenm(secret, remote->key, remote->esecret) != 0) return lob_free(outer);
+  if(crypto_secretbox_easy(outer->body+32+24,
+    lob_raw(inner),
+    inner_len,
+    outer->body+32,
+    secret) != 0) return lob_free(outer);
+
+  // generate secret for the auth, the nonce and shared secret from both endpoint keys
+  if(crypto_box_beforenm(secret, remote->key, local->secret) != 0) return lob_free(outer);
+  memcpy(shared,outer->body+32,24);
+  memcpy(shared+24,secret,crypto_box_BEFORENMBYTES);
+  cipher_hash(shared,24+crypto_box_BEFORENMBYTES,hash);
+  crypto_onetimeauth(outer->body+32+24+inner_len+crypto_secretbox_MACBYTES,outer->body,32+24+inner_len+crypto_secretbox_MACBYTES,hash);
+
+  return outer;
+}
+
+ephemeral_t ephemeral_new(remote_t remote, lob_t outer)
+{
+  uint8_t shared[crypto_box_BEFORENMBYTES+(crypto_box_PUBLICKEYBYTES*2)], hash[32];
+  ephemeral_t ephem;
+
+  if(!remote) return NULL;
+  if(!outer || outer->body_len < crypto_box_PUBLICKEYBYTES) return LOG("invalid outer");
+
+  if(!(ephem = malloc(sizeof(struct ephemeral_struct)))) return NULL;
+  memset(ephem,0,sizeof (struct ephemeral_struct));
+
+  // create and copy in the exchange routing token
+  cipher_hash(outer->body,16,hash);
+  memcpy(ephem->token,hash,16);
+
+  // get the shared secret from the incoming exchange key
+  if(crypto_box_beforenm(shared, outer->body, remote->esecret) != 0)
+  {
+    free(ephem);
+    return LOG("box_beforenm failed");
+  }
+
+  // combine inputs to create the digest
+  memcpy(shared+crypto_box_BEFORENMBYTES,remote->ekey,crypto_box_PUBLICKEYBYTES);
+  memcpy(shared+crypto_box_BEFORENMBYTES+crypto_box_PUBLICKEYBYTES,outer->body,crypto_box_PUBLICKEYBYTES);
+  cipher_hash(shared,crypto_box_BEFORENMBYTES+(crypto_box_PUBLICKEYBYTES*2),ephem->enckey);
+
+  memcpy(shared+crypto_box_BEFORENMBYTES,outer->body,crypto_box_PUBLICKEYBYTES);
+  memcpy(shared+crypto_box_BEFORENMBYTES+crypto_box_PUBLICKEYBYTES,remote->ekey,crypto_box_PUBLICKEYBYTES);
+  cipher_hash(shared,crypto_box_BEFORENMBYTES+(crypto_box_PUBLICKEYBYTES*2),ephem->deckey);
+
+  return ephem;
+}
+
+void ephemeral_free(ephemeral_t ephem)
+{
+  free(ephem);
+}
+
+lob_t ephemeral_encrypt(ephemeral_t ephem, lob_t inner)
+{
+  lob_t outer;
+  uint32_t inner_len;
+
+  outer = lob_new();
+  inner_len = lob_len(inner);
+  if(!lob_body(outer,NULL,16+24+inner_len+crypto_secretbox_MACBYTES)) return lob_free(outer);
+
+  // copy in token and create nonce
+  memcpy(outer->body,ephem->token,16);
+  randombytes_buf(outer->body+16,24);
+
+  if(crypto_secretbox_easy(outer->body+16+24,
+    lob_raw(inner),
+    inner_len,
+    outer->body+16,
+    ephem->enckey) != 0) return lob_free(outer);
+
+  return outer;
+}
+
+lob_t ephemeral_decrypt(ephemeral_t ephem, lob_t outer)
+{
+  uint32_t len;
+
+  if(outer->body_len <= (16+24+crypto_secretbox_MACBYTES))
+  {
+    LOG("outer too small");
+    return lob_free(outer);
+  }
+  len = outer->body_len-(16+24+crypto_secretbox_MACBYTES);
+
+  // decrypt in place
+  if(crypto_secretbox_open_easy(outer->body+16+24,
+    outer->body+16+24,
+    len+crypto_secretbox_MACBYTES,
+    outer->body+16,
+    ephem->deckey) != 0)
+  {
+    LOG("secretbox failed");
+    return lob_free(outer);
+  }
+
+  // the outer's buffer becomes the inner
+  if(!lob_reparse(outer,(outer->body-outer->raw)+16+24,len)) return lob_free(outer);
+
+  return outer;
+}
@@ -1,5 +1,6 @@
 #include "e3x.h"
 #include "cipher3.h"
+#include "cpu3.h"
 #include "../platform.h"
 #include <string.h>
 
@@ -11,6 +12,8 @@ uint8_t e3x_init(lob_t options)
   uint8_t err;
   if(_initialized) return 0;
   platform_random_init();
+  err = cpu3_init(options);
+  if(err) return err;
   err = cipher3_init(options);
   if(err) return err;
   _initialized = 1;
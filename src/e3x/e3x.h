@@ -39,6 +39,9 @@ uint8_t *e3x_rand(uint8_t *bytes, uint32_t len);
 uint8_t *e3x_hash(uint8_t *in, uint32_t len, uint8_t *out32);
 
 
+// cpu feature detection and the kernel chosen for each crypto primitive
+#include "cpu3.h"
+
 // local endpoint state management
 #include "self3.h"
 
@@ -48,6 +51,9 @@ uint8_t *e3x_hash(uint8_t *in, uint32_t len, uint8_t *out32);
 // standalone timer event utility for channels
 #include "event3.h"
 
+// per-link congestion control and pacing for reliable channels
+#include "congest3.h"
+
 // standalone channel packet buffer/ordering utility
 #include "channel3.h"
 
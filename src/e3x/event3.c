@@ -1,14 +1,227 @@
 #include <string.h>
 #include "event3.h"
-#include "../lib/xht.h"
+#include "../lib/util.h"
 #include "platform.h"
 
+// hierarchical timing wheel, each level's slots cover 64x the time of the level below
+// an event sits at the level of the highest 6 bits of its at that differ from the cursor, so inserts/cancels are O(1)
+#define LEVELS 4
+#define BITS 6
+#define SLOTS (1 << BITS)
+#define MASK (SLOTS - 1)
+
+// times wrap (a ms clock does every ~49 days), so they're compared as serial numbers within 2^31 of each other
+#define BEFORE(a,b) ((int32_t)((uint32_t)(a) - (uint32_t)(b)) < 0)
+
+// open addressed id index
+typedef struct event3_id_struct
+{
+  char *id;
+  lob_t event;
+} *event3_id_t;
+
 struct event3_struct
 {
-  lob_t events;
-  xht_t ids;
+  uint32_t cursor; // every scheduled event is at or after this (except the due ones)
+  lob_t wheel[LEVELS][SLOTS]; // lists of events linked through their next/prev, head->prev is the tail
+  uint64_t used[LEVELS]; // bit per non-empty slot
+  lob_t due; // sorted, set for before the cursor
+  lob_t far; // past the top level
+  uint32_t count;
+  uint32_t soon; // cached soonest at on the wheel, 0 if it needs looking for
+
+  event3_id_t ids;
+  uint32_t ids_size, ids_count; // size is a power of two, 0 if no ids
 };
 
+static uint32_t id_hash(char *id)
+{
+  uint32_t hash = 2166136261u;
+  while(*id) hash = (hash ^ (uint8_t)*id++) * 16777619u;
+  return hash;
+}
+
+// the slot for an id, or the empty one it'd go in
+static event3_id_t id_find(event3_t ev, char *id)
+{
+  uint32_t i = id_hash(id) & (ev->ids_size - 1);
+  while(ev->ids[i].id && strcmp(ev->ids[i].id,id) != 0) i = (i + 1) & (ev->ids_size - 1);
+  return &ev->ids[i];
+}
+
+static void id_set(event3_t ev, char *id, lob_t event)
+{
+  struct event3_id_struct *old;
+  uint32_t size, i;
+
+  // keep it under half full
+  if((ev->ids_count + 1) * 2 > ev->ids_size)
+  {
+    old = ev->ids;
+    size = ev->ids_size;
+    if(!(ev->ids = malloc(sizeof (struct event3_id_struct) * size * 2)))
+    {
+      ev->ids = old;
+      LOG("OOM");
+      return;
+    }
+    memset(ev->ids,0,sizeof (struct event3_id_struct) * size * 2);
+    ev->ids_size = size * 2;
+    for(i = 0; i < size; i++) if(old[i].id) *id_find(ev,old[i].id) = old[i];
+    free(old);
+  }
+
+  old = id_find(ev,id);
+  if(!old->id) ev->ids_count++;
+  old->id = id;
+  old->event = event;
+}
+
+// backward shift so lookups never need tombstones
+static void id_del(event3_t ev, event3_id_t slot)
+{
+  uint32_t mask = ev->ids_size - 1, i = (uint32_t)(slot - ev->ids), j = i, home;
+  ev->ids_count--;
+  for(;;)
+  {
+    ev->ids[i].id = NULL;
+    ev->ids[i].event = NULL;
+    for(;;)
+    {
+      j = (j + 1) & mask;
+      if(!ev->ids[j].id) return;
+      home = id_hash(ev->ids[j].id) & mask;
+      // move it back if its home isn't between the hole and here
+      if(i <= j ? (home <= i || home > j) : (home <= i && home > j)) break;
+    }
+    ev->ids[i] = ev->ids[j];
+    i = j;
+  }
+}
+
+// append to a list
+static void list_add(lob_t *list, lob_t event)
+{
+  event->next = NULL;
+  if(!*list)
+  {
+    *list = event;
+    event->prev = event;
+    return;
+  }
+  event->prev = (*list)->prev;
+  (*list)->prev->next = event;
+  (*list)->prev = event;
+}
+
+static void list_rem(lob_t *list, lob_t event)
+{
+  if(*list == event)
+  {
+    if((*list = event->next)) (*list)->prev = event->prev;
+  }else{
+    event->prev->next = event->next;
+    if(event->next) event->next->prev = event->prev;
+    else (*list)->prev = event->prev;
+  }
+  event->next = event->prev = NULL;
+}
+
+// which list the event belongs in for the current cursor, and its level (LEVELS for due/far)
+static lob_t *list_for(event3_t ev, uint32_t at, uint32_t *level)
+{
+  uint32_t diff, l;
+  *level = LEVELS;
+  if(BEFORE(at, ev->cursor)) return &ev->due;
+  diff = at ^ ev->cursor;
+  for(l = 0; l < LEVELS; l++) if(diff < ((uint32_t)1 << (BITS * (l + 1)))) break;
+  if(l == LEVELS) return &ev->far;
+  *level = l;
+  return &ev->wheel[l][(at >> (BITS * l)) & MASK];
+}
+
+static void place(event3_t ev, lob_t event)
+{
+  uint32_t level;
+  lob_t *list = list_for(ev, event->id, &level), cur;
+
+  // due ones are in order (rare, set for a time already passed)
+  if(list == &ev->due && *list && BEFORE(event->id, (*list)->prev->id))
+  {
+    for(cur = *list; !BEFORE(event->id, cur->id); cur = cur->next);
+    event->next = cur;
+    event->prev = cur->prev;
+    if(cur == *list) *list = event;
+    else cur->prev->next = event;
+    cur->prev = event;
+    return;
+  }
+
+  list_add(list, event);
+  if(level < LEVELS) ev->used[level] |= (uint64_t)1 << ((event->id >> (BITS * level)) & MASK);
+}
+
+static void unplace(event3_t ev, lob_t event)
+{
+  uint32_t level, slot;
+  lob_t *list = list_for(ev, event->id, &level);
+  list_rem(list, event);
+  if(level == LEVELS || *list) return;
+  slot = (event->id >> (BITS * level)) & MASK;
+  ev->used[level] &= ~((uint64_t)1 << slot);
+}
+
+// re-place the events in a list, they move down as the cursor gets closer
+static void cascade(event3_t ev, lob_t *list, uint32_t level, uint32_t slot)
+{
+  lob_t event = *list, next;
+  if(!event) return;
+  *list = NULL;
+  if(level < LEVELS) ev->used[level] &= ~((uint64_t)1 << slot);
+  for(; event; event = next)
+  {
+    next = event->next;
+    place(ev, event);
+  }
+}
+
+// move the cursor forward to at, which must be no later than any event on the wheel
+static void advance(event3_t ev, uint32_t at)
+{
+  uint32_t old = ev->cursor, l, slot;
+  if(!BEFORE(old, at)) return;
+  ev->cursor = at;
+
+  // anything past the top level that's in range now (or wrapped around to)
+  if((old >> (BITS * LEVELS)) != (at >> (BITS * LEVELS))) cascade(ev, &ev->far, LEVELS, 0);
+
+  // from the top down, the slots the cursor just entered
+  for(l = LEVELS - 1; l > 0; l--)
+  {
+    if((old >> (BITS * l)) == (at >> (BITS * l))) continue;
+    slot = (at >> (BITS * l)) & MASK;
+    cascade(ev, &ev->wheel[l][slot], l, slot);
+  }
+}
+
+// the soonest at on the wheel (not due), 0 if none
+static uint32_t soonest(event3_t ev)
+{
+  uint32_t l;
+  lob_t list, event;
+  if(ev->soon) return ev->soon;
+
+  // the lowest level used always has the soonest, in its lowest slot
+  for(l = 0; l < LEVELS; l++) if(ev->used[l]) break;
+  if(l < LEVELS) list = ev->wheel[l][__builtin_ctzll(ev->used[l])];
+  else if(!(list = ev->far)) return 0;
+
+  // lowest level ones are all the same at, otherwise look
+  ev->soon = list->id;
+  if(l) for(event = list->next; event; event = event->next) if(BEFORE(event->id, ev->soon)) ev->soon = event->id;
+  return ev->soon;
+}
+
 // track a list of of future-scheduled events
 event3_t event3_new(uint32_t prime)
 {
@@ -16,22 +229,26 @@ event3_t event3_new(uint32_t prime)
 
   if(!(ev = malloc(sizeof (struct event3_struct)))) return NULL;
   memset(ev,0,sizeof (struct event3_struct));
-  
-  if(prime) ev->ids = xht_new(prime);
-  
-  // leave a blank at the start
-  ev->events = lob_new();
-  ev->events->id = 0;
+
+  // ids are only tracked when sized
+  if(prime)
+  {
+    ev->ids_size = 8;
+    while(ev->ids_size < prime * 2) ev->ids_size <<= 1;
+    if(!(ev->ids = malloc(sizeof (struct event3_id_struct) * ev->ids_size)))
+    {
+      free(ev);
+      return LOG("OOM");
+    }
+    memset(ev->ids,0,sizeof (struct event3_id_struct) * ev->ids_size);
+  }
 
   return ev;
 }
 
-void event3_free(event3_t ev)
+static void free_list(lob_t event)
 {
-  lob_t event, old;
-  if(!ev) return;
-  // free all events in the list
-  event = ev->events;
+  lob_t old;
   while(event)
   {
     old = event;
@@ -39,70 +256,95 @@ void event3_free(event3_t ev)
     LOG("unused event %s",lob_get(old,"id"));
     lob_free(old);
   }
-  if(ev->ids) xht_free(ev->ids);
+}
+
+void event3_free(event3_t ev)
+{
+  uint32_t l, s;
+  if(!ev) return;
+  // free all events still scheduled
+  for(l = 0; l < LEVELS; l++) for(s = 0; s < SLOTS; s++) free_list(ev->wheel[l][s]);
+  free_list(ev->due);
+  free_list(ev->far);
+  free(ev->ids);
   free(ev);
 }
 
 // the next lowest at value, or 0 if none
 uint32_t event3_at(event3_t ev)
 {
-  if(!ev || !ev->events->next) return 0;
-  return ev->events->next->id;
+  if(!ev || !ev->count) return 0;
+  if(ev->due) return ev->due->id;
+  return soonest(ev);
 }
 
 // remove and return the lowest lob packet below the given at
 lob_t event3_get(event3_t ev, uint32_t at)
 {
   lob_t ret;
-  if(!ev || !ev->events->next || !at) return NULL;
-  ret = ev->events->next;
-  
-  // if it's not up yet
-  if(ret->id > at) return NULL;
-  
-  // repair the links
-  ev->events->next = ret->next;
-  if(ret->next) ret->next->prev = ev->events;
-  
-  // isolate the one we're returning
-  ret->next = ret->prev = NULL;
+  uint32_t next;
+  event3_id_t slot;
+  char *id;
+  if(!ev || !at) return NULL;
+
+  if(ev->due && !BEFORE(at, ev->due->id))
+  {
+    ret = ev->due;
+    list_rem(&ev->due, ret);
+  }else{
+    // nothing up yet, catch the cursor up to now
+    if(!(next = soonest(ev)) || BEFORE(at, next))
+    {
+      advance(ev, at);
+      return NULL;
+    }
+
+    // bring the soonest down to the bottom level and take the first there
+    advance(ev, next);
+    ret = ev->wheel[0][next & MASK];
+    unplace(ev, ret);
+    if(!ev->wheel[0][next & MASK]) ev->soon = 0;
+  }
+  ev->count--;
+
+  // it's no longer scheduled under its id
+  if(ev->ids_count && (id = lob_get(ret,"id")) && (slot = id_find(ev,id))->id && slot->event == ret) id_del(ev, slot);
   return ret;
 }
 
 // 0 is delete, event is unique per id
 void event3_set(event3_t ev, lob_t event, char *id, uint32_t at)
 {
+  event3_id_t slot;
   lob_t existing;
   if(!ev) return;
-  if(event) event->id = at;
 
-  // if given an id, and there's a different existing lob, free it
-  if(id)
+  // if given an id, unschedule any existing one and free it if it's a different lob
+  if(id && ev->ids && (slot = id_find(ev,id))->id)
   {
-    existing = xht_get(ev->ids,id);
-    if(existing && existing != event)
-    {
-      // unlink in place
-      if(existing->next) existing->next->prev = existing->prev;
-      existing->prev->next = existing->next;
-      lob_free(existing);
-    }
+    existing = slot->event;
+    id_del(ev, slot);
+    unplace(ev, existing);
+    if(existing->id == ev->soon) ev->soon = 0;
+    ev->count--;
+    if(existing != event) lob_free(existing);
   }
 
   // save new one if requested
   if(event && at)
   {
-    // save id ref if requested
-    if(id) xht_set(ev->ids,id,(void*)event);
-    
-    // place in sorted linked list
-    existing = ev->events;
-    while(existing->next && existing->next->id < at) existing = existing->next;
-    event->next = existing->next;
-    event->next->prev = event;
-    existing->next = event;
-    event->prev = existing;
+    event->id = at;
+
+    // save id ref if requested, copied in too so get can clear it
+    if(id && ev->ids)
+    {
+      if(util_cmp(lob_get(event,"id"),id) != 0) lob_set(event,"id",id);
+      id_set(ev, id, event);
+    }
+
+    place(ev, event);
+    if(ev->soon && !BEFORE(at, ev->cursor) && BEFORE(at, ev->soon)) ev->soon = at;
+    ev->count++;
   }
-  
-}
 
+}
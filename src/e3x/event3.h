@@ -4,22 +4,24 @@
 #include "../lib/lob.h"
 
 // simple timer eventing (for channels) that can be replaced by different backends
-// an event is just a lob packet and ordering value
+// an event is just a lob packet and ordering value, kept on a timing wheel so set/delete are O(1) with any number pending
+// same at values come out in the order they were set
+// at is usually (uint32_t)platform_ms() plus a delay (not the seconds based handshake at), compared so it can wrap
 
 typedef struct event3_struct *event3_t;
 
-// create a list/group of events, give prime number to create a hashtable of that size for faster id lookups
+// create a list/group of events, give the expected number of ids to size their index (grows as needed), 0 to not use ids
 event3_t event3_new(uint32_t prime);
 void event3_free(event3_t ev);
 
 // the next lowest at value, or 0 if none
 uint32_t event3_at(event3_t ev);
 
-// remove and return the lowest lob packet below the given at
+// remove and return the lowest lob packet below the given at, caller owns it (no longer under its id)
 lob_t event3_get(event3_t ev, uint32_t at);
 
-// 0 is delete, event is unique per id
-// id must be stored in the event somewhere, and this uses the event->quota, next, and chain values only
+// 0 is delete (any different event under the id is freed, a given event stays the caller's), event is unique per id
+// the id is referenced while scheduled and copied into the event as "id", and this uses the event->id, next, and prev values only
 void event3_set(event3_t ev, lob_t event, char *id, uint32_t at);
 
 
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "exchange3.h"
+#include "../lib/memstat.h"
 #include "platform.h"
 
 // make a new exchange
@@ -30,6 +31,7 @@ exchange3_t exchange3_new(self3_t self, uint8_t csid, lob_t key)
 
   if(!(x = malloc(sizeof (struct exchange3_struct)))) return NULL;
   memset(x,0,sizeof (struct exchange3_struct));
+  MEMSTAT_ADD(MEMSTAT_EXCHANGE, 1, sizeof (struct exchange3_struct));
 
   x->csid = csid;
   x->remote = remote;
@@ -54,6 +56,7 @@ void exchange3_free(exchange3_t x)
   if(!x) return;
   x->cs->remote_free(x->remote);
   x->cs->ephemeral_free(x->ephem);
+  MEMSTAT_ADD(MEMSTAT_EXCHANGE, -1, -(int32_t)sizeof (struct exchange3_struct));
   free(x);
 }
 
@@ -130,6 +133,12 @@ exchange3_t exchange3_sync(exchange3_t x, lob_t outer)
 
 // just a convenience, generates handshake w/ current exchange3_at value
 lob_t exchange3_handshake(exchange3_t x)
+{
+  return exchange3_handshake_json(x, NULL);
+}
+
+// any extra json goes in first so it can't replace the at or keys
+lob_t exchange3_handshake_json(exchange3_t x, lob_t json)
 {
   lob_t inner, key;
   uint8_t i;
@@ -138,6 +147,7 @@ lob_t exchange3_handshake(exchange3_t x)
 
   // create new handshake inner from all supported csets
   inner = lob_new();
+  if(json) lob_set_json(inner,json);
   lob_set_int(inner,"at",x->out);
   
   // loop through all ciphersets for any keys
@@ -160,11 +170,16 @@ lob_t exchange3_handshake(exchange3_t x)
 lob_t exchange3_receive(exchange3_t x, lob_t outer)
 {
   lob_t inner;
-  if(!x || !outer) return LOG("invalid args");
-  if(!x->ephem) return LOG("no handshake");
+  // the outer is always consumed, on success the inner reuses its buffer
+  if(!x || !x->ephem)
+  {
+    lob_free(outer);
+    return LOG(x ? "no handshake" : "invalid args");
+  }
+  if(!outer) return LOG("invalid args");
   inner = x->cs->ephemeral_decrypt(x->ephem,outer);
   if(!inner) return LOG("decryption failed %s",x->cs->err());
-  LOG("decrypted head %d body %d",inner->head_len,inner->body_len);
+  LOG_TRACE("decrypted head %d body %d",inner->head_len,inner->body_len);
   return inner;
 }
 
@@ -174,7 +189,7 @@ lob_t exchange3_send(exchange3_t x, lob_t inner)
   lob_t outer;
   if(!x || !inner) return LOG("invalid args");
   if(!x->ephem) return LOG("no handshake");
-  LOG("encrypting head %d body %d",inner->head_len,inner->body_len);
+  LOG_TRACE("encrypting head %d body %d",inner->head_len,inner->body_len);
   outer = x->cs->ephemeral_encrypt(x->ephem,inner);
   if(!outer) return LOG("encryption failed %s",x->cs->err());
   return outer;
@@ -40,8 +40,11 @@ exchange3_t exchange3_sync(exchange3_t x, lob_t outer);
 // generates handshake w/ current exchange3_out value and ephemeral key
 lob_t exchange3_handshake(exchange3_t x);
 
+// same, also sending any keys in json (features the other side may use)
+lob_t exchange3_handshake_json(exchange3_t x, lob_t json);
+
 // simple synchronous encrypt/decrypt conversion of any packet for channels
-lob_t exchange3_receive(exchange3_t x, lob_t outer); // goes to channel, validates cid
+lob_t exchange3_receive(exchange3_t x, lob_t outer); // goes to channel, validates cid, takes the outer (the inner reuses it)
 lob_t exchange3_send(exchange3_t x, lob_t inner); // comes from channel 
 
 // validate the next incoming channel id from the packet, or return the next avail outgoing channel id
@@ -2,36 +2,177 @@
 
 #define MUID "ext_block"
 
-// individual pipe local info
+// per link block channels, both directions
 typedef struct ext_block_struct
 {
   link_t link;
-  channel3_t chan;
-  uint32_t min;
-  lob_t cache;
+  channel3_t in, out;
+  lob_t building; // incoming block being reassembled, its whole body is allocated from the first packet
+  uint32_t at;
+  lob_t pending, pending_tail; // outgoing blocks, the first is partially sent
+  uint32_t sent;
+  uint8_t pumping;
   struct ext_block_struct *next;
 } *ext_block_t;
 
-// handle incoming packets for the built-in block channel
+// per mesh state, completed blocks wait here to be received
+typedef struct ext_blocks_struct
+{
+  ext_block_t blocks;
+  lob_t ready, ready_tail;
+} *ext_blocks_t;
+
+static void pending_free(ext_block_t block)
+{
+  lob_t tmp;
+  while((tmp = block->pending))
+  {
+    block->pending = tmp->next;
+    lob_free(tmp);
+  }
+  block->pending_tail = NULL;
+  block->sent = 0;
+}
+
+// returns existing or new per link state
+static ext_block_t block_get(link_t link)
+{
+  ext_block_t block;
+  ext_blocks_t blocks;
+
+  if((block = xht_get(link->index, "block"))) return block;
+  if(!(blocks = xht_get(link->mesh->index, "blocks"))) return LOG("ext_block not enabled");
+
+  if(!(block = malloc(sizeof (struct ext_block_struct)))) return LOG("OOM");
+  memset(block,0,sizeof (struct ext_block_struct));
+  block->link = link;
+  // add to list of all blocks
+  block->next = blocks->blocks;
+  blocks->blocks = block;
+  xht_set(link->index, "block", block);
+  return block;
+}
+
+// send as much of the pending blocks as the channel's window will take
+static void block_pump(ext_block_t block)
+{
+  lob_t head, packet;
+  uint32_t len;
+
+  // acks handled while flushing come back through here, the outer loop picks up the opened window
+  if(block->pumping) return;
+  block->pumping = 1;
+
+  while(block->out && (head = block->pending))
+  {
+    len = lob_len(head) - block->sent;
+    if(len > EXT_BLOCK_FRAG) len = EXT_BLOCK_FRAG;
+    packet = channel3_packet(block->out);
+    if(!block->sent) lob_set_int(packet,"len",(int)lob_len(head));
+    lob_body(packet, lob_raw(head)+block->sent, len);
+    if(channel3_send(block->out, packet))
+    {
+      lob_free(packet); // window is full, resumes on the next ack
+      break;
+    }
+
+    block->sent += len;
+    if(block->sent == lob_len(head))
+    {
+      if(!(block->pending = head->next)) block->pending_tail = NULL;
+      lob_free(head);
+      block->sent = 0;
+    }
+    link_flush(block->link, block->out, NULL);
+  }
+
+  block->pumping = 0;
+}
+
+// copy in the next part of the incoming block, queue it once complete
+static void block_build(ext_block_t block, lob_t packet)
+{
+  ext_blocks_t blocks;
+  uint32_t len;
+
+  if(!block->building)
+  {
+    // the open or anything else before a block starts
+    if(!lob_get(packet,"len")) return;
+    len = (uint32_t)lob_get_int(packet,"len");
+    if(len < 2 || len > EXT_BLOCK_MAX)
+    {
+      LOG("invalid block len %u",len);
+      return;
+    }
+    if(!(block->building = lob_new()) || !lob_body(block->building, NULL, len))
+    {
+      block->building = lob_free(block->building);
+      LOG("OOM");
+      return;
+    }
+    block->at = 0;
+  }
+
+  if(packet->body_len > block->building->body_len - block->at)
+  {
+    LOG("block overrun, dropping %u of %u",block->at,block->building->body_len);
+    block->building = lob_free(block->building);
+    return;
+  }
+  memcpy(block->building->body + block->at, packet->body, packet->body_len);
+  block->at += packet->body_len;
+  if(block->at < block->building->body_len) return;
+
+  // parse in place, the head is empty so the block starts right after the length bytes
+  len = block->building->body_len;
+  if(!lob_reparse(block->building, 2, len))
+  {
+    LOG("invalid block of %u",len);
+    block->building = lob_free(block->building);
+    return;
+  }
+
+  blocks = xht_get(block->link->mesh->index, "blocks");
+  block->building->arg = block->link;
+  block->building->next = NULL;
+  if(blocks->ready_tail) blocks->ready_tail->next = block->building;
+  else blocks->ready = block->building;
+  blocks->ready_tail = block->building;
+  block->building = NULL;
+}
+
+// handle incoming packets for the built-in block channels
 void block_chan_handler(link_t link, channel3_t chan, void *arg)
 {
-  lob_t packet, last;
+  lob_t packet;
   ext_block_t block = arg;
-  if(!link) return;
+  if(!link || !block) return;
 
-  // just append all packets, processed during block_receive()
-  last = block->cache;
-  while(last && last->next) last = last->next;
   while((packet = channel3_receiving(chan)))
   {
-    if(!last)
+    // channel is going away
+    if(lob_get(packet,"err"))
     {
-      block->cache = last = packet;
-      continue;
+      LOG("block channel %s error %s",channel3_uid(chan),lob_get(packet,"err"));
+      if(chan == block->in)
+      {
+        block->building = lob_free(block->building);
+        block->in = NULL;
+      }
+      if(chan == block->out)
+      {
+        pending_free(block);
+        block->out = NULL;
+      }
+    }else if(chan == block->in){
+      block_build(block, packet);
     }
-    last->next = packet;
-    last = packet;
+    lob_free(packet);
   }
+
+  // acks may have opened the window
+  if(chan == block->out) block_pump(block);
 }
 
 // new incoming block channel, set up handler
@@ -39,27 +180,21 @@ lob_t block_on_open(link_t link, lob_t open)
 {
   ext_block_t block;
   if(!link) return open;
-  if(lob_get_cmp(open,"type","block")) return open;
 
-  if((block = xht_get(link->index, "block")))
+  if(!(block = block_get(link))) return open;
+  if(block->in)
   {
     LOG("note: new incoming block channel replacing existing one");
-    // TODO delete old channel
+    block->building = lob_free(block->building);
   }else{
     LOG("incoming block channel open");
-
-    // create new block
-    if(!(block = malloc(sizeof (struct ext_block_struct)))) return LOG("OOM");
-    memset(block,0,sizeof (struct ext_block_struct));
-    block->link = link;
-    // add to list of all blocks
-    block->next = xht_get(link->mesh->index, "blocks");
-    xht_set(link->mesh->index, "blocks", block);
   }
 
   // create new channel for this block handler
-  block->chan = link_channel(link, open);
-  link_handle(link,block->chan,block_chan_handler,block);
+  if(!(block->in = link_channel(link, open))) return open;
+  link_handle(link,block->in,block_chan_handler,block);
+  channel3_receive(block->in,open);
+  block_chan_handler(link,block->in,block);
 
   return NULL;
 }
@@ -67,37 +202,116 @@ lob_t block_on_open(link_t link, lob_t open)
 // get the next incoming block, if any, packet->arg is the link it came from
 lob_t ext_block_receive(mesh_t mesh)
 {
-  ext_block_t block;
+  ext_blocks_t blocks;
+  lob_t ret;
   if(!mesh) return LOG("bad args");
-  block = xht_get(mesh->index, "blocks");
-  for(;block && block->cache; block = block->next)
-  {
-    // TODO get next block and remove/return it
-  }
+  if(!(blocks = xht_get(mesh->index, "blocks")) || !(ret = blocks->ready)) return NULL;
 
-  return NULL;
+  if(!(blocks->ready = ret->next)) blocks->ready_tail = NULL;
+  ret->next = NULL;
+  return ret;
 }
 
 // creates/reuses a single default block channel on the link
 link_t ext_block_send(link_t link, lob_t block)
 {
-  channel3_t chan;
-  if(!link || !block) return LOG("bad args");
-  
-  if(!(chan = xht_get(link->index,"block")))
+  ext_block_t eb;
+  lob_t open;
+  if(!link || !block)
   {
-    // TODO create outgoing channel
-    xht_set(link->index,"block",chan);
+    lob_free(block);
+    return LOG("bad args");
+  }
+  if(!(eb = block_get(link)))
+  {
+    lob_free(block);
+    return NULL;
   }
-  
-  // break block into packets and send
+
+  if(!eb->out)
+  {
+    open = lob_new();
+    lob_set(open,"type","block");
+    lob_set_int(open,"seq",0); // reliable
+    if(!(eb->out = link_channel(link,open)))
+    {
+      lob_free(open);
+      lob_free(block);
+      return NULL;
+    }
+    link_handle(link,eb->out,block_chan_handler,eb);
+    link_flush(link,eb->out,open);
+  }
+
+  // queue it and stream out what fits
+  block->next = NULL;
+  if(eb->pending_tail) eb->pending_tail->next = block;
+  else eb->pending = block;
+  eb->pending_tail = block;
+  block_pump(eb);
 
   return link;
 }
 
+// the link's channels are already going, drop its state and forget it on any waiting blocks
+void block_on_unlink(link_t link)
+{
+  ext_blocks_t blocks;
+  ext_block_t block, *prev;
+  lob_t tmp;
+  if(!(blocks = xht_get(link->mesh->index, "blocks"))) return;
+  for(tmp = blocks->ready; tmp; tmp = tmp->next) if(tmp->arg == link) tmp->arg = NULL;
+  if(!(block = xht_get(link->index, "block"))) return;
+  xht_set(link->index, "block", NULL);
+
+  for(prev = &blocks->blocks; *prev; prev = &(*prev)->next) if(*prev == block)
+  {
+    *prev = block->next;
+    break;
+  }
+  lob_free(block->building);
+  pending_free(block);
+  free(block);
+}
+
+void block_on_free(mesh_t mesh)
+{
+  ext_blocks_t blocks;
+  ext_block_t block;
+  lob_t tmp;
+  if(!(blocks = xht_get(mesh->index, "blocks"))) return;
+  xht_set(mesh->index, "blocks", NULL);
+
+  while((block = blocks->blocks))
+  {
+    blocks->blocks = block->next;
+    lob_free(block->building);
+    pending_free(block);
+    free(block);
+  }
+  while((tmp = blocks->ready))
+  {
+    blocks->ready = tmp->next;
+    lob_free(tmp);
+  }
+  free(blocks);
+}
+
 mesh_t ext_block(mesh_t mesh)
 {
+  ext_blocks_t blocks;
+  if(!mesh) return LOG("bad args");
+
+  if(!xht_get(mesh->index, "blocks"))
+  {
+    if(!(blocks = malloc(sizeof (struct ext_blocks_struct)))) return LOG("OOM");
+    memset(blocks,0,sizeof (struct ext_blocks_struct));
+    xht_set(mesh->index, "blocks", blocks);
+  }
+
   // set up built-in block channel handler
-  mesh_on_open(mesh, MUID, block_on_open);
+  mesh_on_open_type(mesh, MUID, "block", block_on_open);
+  mesh_on_unlink(mesh, MUID, block_on_unlink);
+  mesh_on_free(mesh, MUID, block_on_free);
   return mesh;
 }
@@ -3,13 +3,24 @@
 
 #include "mesh.h"
 
+// most block bytes carried in each channel packet, keeps them under a typical mtu after encryption
+#ifndef EXT_BLOCK_FRAG
+#define EXT_BLOCK_FRAG 1000
+#endif
+
+// largest incoming block accepted, its whole buffer is allocated up front
+#ifndef EXT_BLOCK_MAX
+#define EXT_BLOCK_MAX (16*1024*1024)
+#endif
+
 // add block channel support
 mesh_t ext_block(mesh_t mesh);
 
-// get the next incoming block, if any, packet->arg is the link it came from
+// get the next incoming block, if any, packet->arg is the link it came from (NULL if that link has since been freed)
 lob_t ext_block_receive(mesh_t mesh);
 
-// creates/reuses a single default block channel on the link
+// creates/reuses a single default block channel on the link, block is always taken and sent in EXT_BLOCK_FRAG sized packets
+// the first packet of each block has its total "len", the rest are just the next bytes of it
 link_t ext_block_send(link_t link, lob_t block);
 
 // TODO, handle multiple block channels per link, and custom packets on open
@@ -32,7 +32,6 @@ lob_t link_on_open(link_t link, lob_t open)
 {
   channel3_t chan;
   if(!link) return open;
-  if(lob_get_cmp(open,"type","link")) return open;
   
   if(xht_get(link->index, "link")) LOG("note: new incoming link channel replacing existing one");
 
@@ -115,6 +114,6 @@ mesh_t ext_link_auto(mesh_t mesh)
 mesh_t ext_link(mesh_t mesh)
 {
   // set up built-in link channel handler
-  mesh_on_open(mesh, MUID, link_on_open);
+  mesh_on_open_type(mesh, MUID, "link", link_on_open);
   return mesh;
 }
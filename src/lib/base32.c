@@ -11,6 +11,8 @@
 #include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include "base32.h"
 
 #define BASE32_LOOKUP_MAX 43
 static char *base32Chars = "abcdefghijklmnopqrstuvwxyz234567";
@@ -71,7 +73,7 @@ int base32_decode_length(int base32Length)
     return ((base32Length * 5) / 8);
 }
 
-void base32_encode_into(const void *_buffer, unsigned int bufLen, char *base32Buffer)
+static void encode_portable(const void *_buffer, unsigned int bufLen, char *base32Buffer)
 {
     unsigned int i, index;
     unsigned char word;
@@ -112,20 +114,21 @@ char *base32_encode(const void *buf, unsigned int len)
     return tmp;
 }
 
-int base32_decode_into(const char *base32Buffer, unsigned int base32BufLen, void *_buffer)
+static int decode_portable(const char *base32Buffer, unsigned int base32BufLen, void *_buffer)
 {
-    int i, index, max, lookup, offset;
+    int i, index, max, lookup, offset, len;
     unsigned char  word;
     unsigned char *buffer = _buffer;
 
     max = base32BufLen ? base32BufLen : strlen(base32Buffer);
-    memset(buffer, 0, base32_decode_length(max));
+    len = base32_decode_length(max);
+    memset(buffer, 0, len);
     for(i = 0, index = 0, offset = 0; i < max; i++)
     {
         lookup = toupper(base32Buffer[i]) - '0';
         /* Check to make sure that the given word falls inside
            a valid range */
-        if ( lookup < 0 && lookup >= BASE32_LOOKUP_MAX)
+        if ( lookup < 0 || lookup >= BASE32_LOOKUP_MAX)
             word = 0xFF;
         else
             word = base32Lookup[lookup][1];
@@ -151,12 +154,112 @@ int base32_decode_into(const char *base32Buffer, unsigned int base32BufLen, void
             buffer[offset] |= (word >> index);
             offset++;
 
-            buffer[offset] |= word << (8 - index);
+            /* The trailing bits of the last word are only padding */
+            if (offset < len)
+                buffer[offset] |= word << (8 - index);
         }
     }
     return offset;
 }
 
+/* 64-bit block kernels, 5 bytes <-> 8 characters per step, the
+   portable code above finishes any partial group */
+
+static void encode_block(const void *_buffer, unsigned int bufLen, char *base32Buffer)
+{
+    const unsigned char *buffer = _buffer;
+    uint64_t v;
+    unsigned int i;
+    int k;
+
+    for(i = 0; i + 5 <= bufLen; i += 5)
+    {
+        v = ((uint64_t)buffer[i] << 32) | ((uint64_t)buffer[i + 1] << 24) |
+            ((uint64_t)buffer[i + 2] << 16) | ((uint64_t)buffer[i + 3] << 8) |
+            (uint64_t)buffer[i + 4];
+        for(k = 7; k >= 0; k--, v >>= 5)
+            base32Buffer[k] = base32Chars[v & 0x1F];
+        base32Buffer += 8;
+    }
+
+    encode_portable(buffer + i, bufLen - i, base32Buffer);
+}
+
+static int decode_block(const char *base32Buffer, unsigned int base32BufLen, void *_buffer)
+{
+    unsigned char *buffer = _buffer;
+    int i, k, max, lookup, offset;
+    uint64_t v;
+    unsigned char word;
+
+    max = base32BufLen ? base32BufLen : strlen(base32Buffer);
+    for(i = 0, offset = 0; i + 8 <= max; i += 8, offset += 5)
+    {
+        for(k = 0, v = 0; k < 8; k++)
+        {
+            lookup = toupper(base32Buffer[i + k]) - '0';
+            if ( lookup < 0 || lookup >= BASE32_LOOKUP_MAX)
+                break;
+            word = base32Lookup[lookup][1];
+            if (word == 0xFF)
+                break;
+            v = (v << 5) | word;
+        }
+
+        /* anything to skip in this group is left to the portable code */
+        if (k < 8)
+            break;
+
+        buffer[offset] = (unsigned char)(v >> 32);
+        buffer[offset + 1] = (unsigned char)(v >> 24);
+        buffer[offset + 2] = (unsigned char)(v >> 16);
+        buffer[offset + 3] = (unsigned char)(v >> 8);
+        buffer[offset + 4] = (unsigned char)v;
+    }
+
+    if (i == max)
+        return offset;
+    return offset + decode_portable(base32Buffer + i, max - i, buffer + offset);
+}
+
+static void (*encode_kernel)(const void *, unsigned int, char *) = NULL;
+static int (*decode_kernel)(const char *, unsigned int, void *) = NULL;
+static const char *kernel_name = NULL;
+
+const char *base32_impl(const char *name)
+{
+    if (!name && kernel_name)
+        return kernel_name;
+
+    if (!name || strcmp(name, "block") == 0)
+    {
+        encode_kernel = encode_block;
+        decode_kernel = decode_block;
+        return kernel_name = "block";
+    }
+
+    if (strcmp(name, "portable") != 0)
+        return NULL;
+
+    encode_kernel = encode_portable;
+    decode_kernel = decode_portable;
+    return kernel_name = "portable";
+}
+
+void base32_encode_into(const void *_buffer, unsigned int bufLen, char *base32Buffer)
+{
+    if (!kernel_name)
+        base32_impl(NULL);
+    encode_kernel(_buffer, bufLen, base32Buffer);
+}
+
+int base32_decode_into(const char *base32Buffer, unsigned int base32BufLen, void *_buffer)
+{
+    if (!kernel_name)
+        base32_impl(NULL);
+    return decode_kernel(base32Buffer, base32BufLen, _buffer);
+}
+
 void *base32_decode(const char *buf, unsigned int *outlen)
 {
     unsigned int len = strlen(buf);
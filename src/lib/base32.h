@@ -7,5 +7,8 @@ void base32_encode_into(const void *_buffer, unsigned int bufLen, char *base32Bu
 char *base32_encode(const void *buf, unsigned int len);
 int base32_decode_into(const char *base32Buffer, unsigned int base32BufLen, void *_buffer);
 void *base32_decode(const char *buf, unsigned int *outlen);
+
+/* select the kernel ("block" or "portable"), NULL reports the active one (block unless set) */
+const char *base32_impl(const char *name);
 #endif
 
@@ -1,7 +1,17 @@
+#include <string.h>
 #include "chacha.h"
 
 // public domain, original source: https://gist.github.com/thoughtpolice/2b36e168d2d7582ad58b
 
+// x86 builds with gcc/clang get 4-way sse2 and 8-way avx2 block kernels, picked at runtime
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(NOCHACHA_SIMD)
+#define CHACHA_X86
+#include <immintrin.h>
+#endif
+
+// processes whole 64 byte blocks in parallel, returns how many were done and advances the counter
+typedef unsigned long long (*chacha20_blocks_t)(unsigned char *c, const unsigned char *m, unsigned long long blocks, unsigned int *st);
+
 static unsigned int
 L32(unsigned int x,unsigned int n)
 {
@@ -87,6 +97,189 @@ chacha20_kexp(unsigned int* st,
   st[15] = ld32(n+4);
 }
 
+#ifdef CHACHA_X86
+
+#define SSE_ROTL(x,n) _mm_or_si128(_mm_slli_epi32(x,n),_mm_srli_epi32(x,32-n))
+#define SSE_QR(a,b,c,d) \
+  a = _mm_add_epi32(a,b); d = SSE_ROTL(_mm_xor_si128(d,a),16); \
+  c = _mm_add_epi32(c,d); b = SSE_ROTL(_mm_xor_si128(b,c),12); \
+  a = _mm_add_epi32(a,b); d = SSE_ROTL(_mm_xor_si128(d,a), 8); \
+  c = _mm_add_epi32(c,d); b = SSE_ROTL(_mm_xor_si128(b,c), 7);
+
+// 4x4 transpose so each vector holds four consecutive state words of one block, then xor out
+__attribute__((target("sse2")))
+static void sse2_out(unsigned char *c, const unsigned char *m, __m128i *x)
+{
+  __m128i t0, t1, t2, t3, r[4];
+  int b;
+
+  t0 = _mm_unpacklo_epi32(x[0],x[1]);
+  t1 = _mm_unpacklo_epi32(x[2],x[3]);
+  t2 = _mm_unpackhi_epi32(x[0],x[1]);
+  t3 = _mm_unpackhi_epi32(x[2],x[3]);
+  r[0] = _mm_unpacklo_epi64(t0,t1);
+  r[1] = _mm_unpackhi_epi64(t0,t1);
+  r[2] = _mm_unpacklo_epi64(t2,t3);
+  r[3] = _mm_unpackhi_epi64(t2,t3);
+  for(b = 0; b < 4; b++)
+  {
+    _mm_storeu_si128((__m128i*)(c+(64*b)),_mm_xor_si128(r[b],_mm_loadu_si128((const __m128i*)(m+(64*b)))));
+  }
+}
+
+__attribute__((target("sse2")))
+static unsigned long long blocks_sse2(unsigned char *c, const unsigned char *m, unsigned long long blocks, unsigned int *st)
+{
+  __m128i in[16], x[16];
+  unsigned long long done = 0;
+  int i;
+
+  for(;blocks >= 4; blocks -= 4, done += 4, c += 256, m += 256)
+  {
+    // the lanes can't carry into st[13], leave a wrapping batch to the scalar path
+    if(st[12] > 0xffffffff - 4) break;
+    for(i = 0; i < 16; i++) in[i] = _mm_set1_epi32((int)st[i]);
+    in[12] = _mm_add_epi32(in[12],_mm_setr_epi32(0,1,2,3));
+    for(i = 0; i < 16; i++) x[i] = in[i];
+    for(i = 0; i < 10; i++)
+    {
+      SSE_QR(x[0], x[4], x[8],  x[12]);
+      SSE_QR(x[1], x[5], x[9],  x[13]);
+      SSE_QR(x[2], x[6], x[10], x[14]);
+      SSE_QR(x[3], x[7], x[11], x[15]);
+      SSE_QR(x[0], x[5], x[10], x[15]);
+      SSE_QR(x[1], x[6], x[11], x[12]);
+      SSE_QR(x[2], x[7], x[8],  x[13]);
+      SSE_QR(x[3], x[4], x[9],  x[14]);
+    }
+    for(i = 0; i < 16; i++) x[i] = _mm_add_epi32(x[i],in[i]);
+    for(i = 0; i < 16; i += 4) sse2_out(c+(4*i),m+(4*i),x+i);
+    st[12] += 4;
+  }
+  return done;
+}
+
+#define AVX_ROTL(x,n) _mm256_or_si256(_mm256_slli_epi32(x,n),_mm256_srli_epi32(x,32-n))
+#define AVX_QR(a,b,c,d) \
+  a = _mm256_add_epi32(a,b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d,a),rot16); \
+  c = _mm256_add_epi32(c,d); b = AVX_ROTL(_mm256_xor_si256(b,c),12); \
+  a = _mm256_add_epi32(a,b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d,a),rot8); \
+  c = _mm256_add_epi32(c,d); b = AVX_ROTL(_mm256_xor_si256(b,c), 7);
+
+// per 128 bit lane transpose, leaves block b in the low half and block b+4 in the high half
+__attribute__((target("avx2")))
+static void avx2_transpose(__m256i *x, __m256i *r)
+{
+  __m256i t0, t1, t2, t3;
+  t0 = _mm256_unpacklo_epi32(x[0],x[1]);
+  t1 = _mm256_unpacklo_epi32(x[2],x[3]);
+  t2 = _mm256_unpackhi_epi32(x[0],x[1]);
+  t3 = _mm256_unpackhi_epi32(x[2],x[3]);
+  r[0] = _mm256_unpacklo_epi64(t0,t1);
+  r[1] = _mm256_unpackhi_epi64(t0,t1);
+  r[2] = _mm256_unpacklo_epi64(t2,t3);
+  r[3] = _mm256_unpackhi_epi64(t2,t3);
+}
+
+// xor out 32 bytes of every block from two groups of four state words
+__attribute__((target("avx2")))
+static void avx2_out(unsigned char *c, const unsigned char *m, __m256i *x)
+{
+  __m256i a[4], b[4], o;
+  int i;
+
+  avx2_transpose(x,a);
+  avx2_transpose(x+4,b);
+  for(i = 0; i < 4; i++)
+  {
+    o = _mm256_permute2x128_si256(a[i],b[i],0x20);
+    _mm256_storeu_si256((__m256i*)(c+(64*i)),_mm256_xor_si256(o,_mm256_loadu_si256((const __m256i*)(m+(64*i)))));
+    o = _mm256_permute2x128_si256(a[i],b[i],0x31);
+    _mm256_storeu_si256((__m256i*)(c+(64*(i+4))),_mm256_xor_si256(o,_mm256_loadu_si256((const __m256i*)(m+(64*(i+4))))));
+  }
+}
+
+__attribute__((target("avx2")))
+static unsigned long long blocks_avx2(unsigned char *c, const unsigned char *m, unsigned long long blocks, unsigned int *st)
+{
+  __m256i in[16], x[16];
+  __m256i rot16 = _mm256_setr_epi8(2,3,0,1,6,7,4,5,10,11,8,9,14,15,12,13,2,3,0,1,6,7,4,5,10,11,8,9,14,15,12,13);
+  __m256i rot8 = _mm256_setr_epi8(3,0,1,2,7,4,5,6,11,8,9,10,15,12,13,14,3,0,1,2,7,4,5,6,11,8,9,10,15,12,13,14);
+  unsigned long long done = 0;
+  int i;
+
+  for(;blocks >= 8; blocks -= 8, done += 8, c += 512, m += 512)
+  {
+    if(st[12] > 0xffffffff - 8) break;
+    for(i = 0; i < 16; i++) in[i] = _mm256_set1_epi32((int)st[i]);
+    in[12] = _mm256_add_epi32(in[12],_mm256_setr_epi32(0,1,2,3,4,5,6,7));
+    for(i = 0; i < 16; i++) x[i] = in[i];
+    for(i = 0; i < 10; i++)
+    {
+      AVX_QR(x[0], x[4], x[8],  x[12]);
+      AVX_QR(x[1], x[5], x[9],  x[13]);
+      AVX_QR(x[2], x[6], x[10], x[14]);
+      AVX_QR(x[3], x[7], x[11], x[15]);
+      AVX_QR(x[0], x[5], x[10], x[15]);
+      AVX_QR(x[1], x[6], x[11], x[12]);
+      AVX_QR(x[2], x[7], x[8],  x[13]);
+      AVX_QR(x[3], x[4], x[9],  x[14]);
+    }
+    for(i = 0; i < 16; i++) x[i] = _mm256_add_epi32(x[i],in[i]);
+    avx2_out(c,m,x);
+    avx2_out(c+32,m+32,x+8);
+    st[12] += 8;
+  }
+
+  // finish any 4 block remainder without another trip through the dispatch
+  return done + blocks_sse2(c,m,blocks,st);
+}
+
+#endif // CHACHA_X86
+
+static struct chacha20_impl_struct
+{
+  const char *name;
+  chacha20_blocks_t blocks;
+} _impls[] = {
+#ifdef CHACHA_X86
+  {"avx2", blocks_avx2},
+  {"sse2", blocks_sse2},
+#endif
+  {"portable", 0}
+};
+
+static struct chacha20_impl_struct *_impl = 0;
+
+static int impl_supported(struct chacha20_impl_struct *impl)
+{
+#ifdef CHACHA_X86
+  __builtin_cpu_init();
+  if(impl->blocks == blocks_avx2) return __builtin_cpu_supports("avx2");
+  if(impl->blocks == blocks_sse2) return __builtin_cpu_supports("sse2");
+#endif
+  return 1;
+}
+
+const char *chacha20_impl(const char *name)
+{
+  unsigned int i;
+
+  if(name && _impl && strcmp(name,_impl->name) == 0) return _impl->name;
+  if(!name && _impl) return _impl->name;
+
+  // best supported by default, else the named one if supported here
+  for(i = 0; i < sizeof(_impls)/sizeof(_impls[0]); i++)
+  {
+    if(name && strcmp(name,_impls[i].name) != 0) continue;
+    if(!impl_supported(&_impls[i])) continue;
+    _impl = &_impls[i];
+    return _impl->name;
+  }
+
+  return 0;
+}
+
 int
 chacha20_xor(unsigned char* c,
                            const unsigned char* m,
@@ -99,8 +292,16 @@ chacha20_xor(unsigned char* c,
   unsigned char blk[64];
 
   chacha20_kexp(st, n, k);
+  if(!_impl) chacha20_impl(0);
 
   for(;;) {
+    /* Bulk path */
+    if (b >= 64 && _impl->blocks) {
+      i = _impl->blocks(c, m, b/64, st);
+      b -= i*64;
+      m += i*64;
+      c += i*64;
+    }
     /* Advance state */
     core(blk, st);
     st[12] = st[12]+1;
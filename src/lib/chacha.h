@@ -21,6 +21,10 @@ int chacha20_base(
   unsigned char*, unsigned long long,
   const unsigned char*, const unsigned char*);
 
+// select the block kernel ("avx2", "sse2" or "portable"), NULL reports the active one (the best this cpu supports unless set)
+// returns the active kernel name, or NULL if the named one isn't available here
+const char *chacha20_impl(const char *name);
+
 // a convert-in-place utility
 uint8_t *chacha20(uint8_t *key, uint8_t *nonce, uint8_t *bytes, uint32_t len);
 
@@ -10,6 +10,7 @@
 struct chunks_struct
 {
   uint8_t space;
+  uint8_t cloak; // rounds to cloak outgoing packets with
 
   uint8_t *writing;
   uint32_t writelen, writeat;
@@ -69,6 +70,14 @@ chunks_t _chunks_gc(chunks_t chunks)
   return _chunks_gc(chunks);
 }
 
+// cloak outgoing packets, 0 disables
+chunks_t chunks_cloak(chunks_t chunks, uint8_t rounds)
+{
+  if(!chunks) return NULL;
+  chunks->cloak = rounds;
+  return chunks;
+}
+
 // turn this packet into chunks
 chunks_t chunks_send(chunks_t chunks, lob_t out)
 {
@@ -77,6 +86,7 @@ chunks_t chunks_send(chunks_t chunks, lob_t out)
   
   // validate and gc first
   if(!_chunks_gc(chunks) || !(len = lob_len(out))) return chunks;
+  if(chunks->cloak) len += 8*chunks->cloak;
 
   start = chunks->writelen;
   chunks->writelen += len;
@@ -89,12 +99,18 @@ chunks_t chunks_send(chunks_t chunks, lob_t out)
   }
   
   raw = lob_raw(out);
+  if(chunks->cloak)
+  {
+    // cloak into the tail of the new space, the chunks written from it always trail the reads
+    raw = chunks->writing+(chunks->writelen-len);
+    lob_cloak_into(out, chunks->cloak, raw);
+  }
   for(at = 0; at < len;)
   {
     size = ((len-at) < chunks->space) ? (len-at) : chunks->space;
     chunks->writing[start] = size;
     start++;
-    memcpy(chunks->writing+start,raw+at,size);
+    memmove(chunks->writing+start,raw+at,size);
     at += size;
     start += size;
   }
@@ -106,24 +122,28 @@ chunks_t chunks_send(chunks_t chunks, lob_t out)
 // get any packets that have been reassembled from incoming chunks
 lob_t chunks_receive(chunks_t chunks)
 {
-  uint32_t at, len;
-  uint8_t *buf, *append;
+  uint32_t at, len, end;
+  uint8_t size;
   lob_t ret;
 
   if(!chunks || !chunks->reading) return NULL;
   // check for complete packet and get its length
   for(len = at = 0;at < chunks->readlen && chunks->reading[at]; at += chunks->reading[at]+1) len += chunks->reading[at];
   if(!len || at >= chunks->readlen) return NULL;
-  
-  if(!(buf = malloc(len))) return LOG("OOM %d",len);
-  // copy in the body of each chunk
-  for(at = 0, append = buf; chunks->reading[at]; append += chunks->reading[at], at += chunks->reading[at]+1)
+  end = at;
+
+  // pack the body of each chunk down to the front of the buffer, in place
+  for(at = len = 0; at < end; at += size+1, len += size)
   {
-    memcpy(append, chunks->reading+(at+1), chunks->reading[at]);
+    size = chunks->reading[at];
+    memmove(chunks->reading+len, chunks->reading+(at+1), size);
   }
-  ret = lob_parse(buf,len);
-  free(buf);
-  
+
+  // a cloaked packet starts with a non-zero nonce, mirror it back
+  if(chunks->reading[0] && !chunks->cloak) chunks->cloak = 1;
+  ret = lob_decloak(chunks->reading,len);
+  at = end;
+
   // advance the reading buffer the whole packet, shrink
   at++;
   chunks->readlen -= at;
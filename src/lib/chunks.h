@@ -11,6 +11,9 @@ chunks_t chunks_new(uint8_t size);
 
 chunks_t chunks_free(chunks_t chunks);
 
+// cloak outgoing packets with this many rounds (0 disables), set automatically when a cloaked packet is received
+chunks_t chunks_cloak(chunks_t chunks, uint8_t rounds);
+
 // turn this packet into chunks and append
 chunks_t chunks_send(chunks_t chunks, lob_t out);
 
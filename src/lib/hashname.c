@@ -13,7 +13,7 @@
 // validate a str is a base32 hashname
 uint8_t hashname_valid(char *str)
 {
-  static uint8_t buf[32];
+  uint8_t buf[32];
   if(!str) return 0;
   if(strlen(str) != 52) return 0;
   if(base32_decode_into(str,52,buf) != 32) return 0;
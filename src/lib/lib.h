@@ -3,6 +3,7 @@
 #include "hashname.h"
 #include "js0n.h"
 #include "lob.h"
+#include "memstat.h"
 #include "murmur.h"
 #include "util.h"
 #include "xht.h"
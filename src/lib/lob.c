@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdarg.h>
 #include "js0n.h"
+#include "memstat.h"
 #include "../platform.h" // platform_short()
 #include "util.h" // util_sort()
 #include "base32.h"
@@ -16,6 +17,7 @@ lob_t lob_new()
   lob_t p;
   if(!(p = malloc(sizeof (struct lob_struct)))) return LOG("OOM");
   memset(p,0,sizeof (struct lob_struct));
+  MEMSTAT_ADD(MEMSTAT_LOB, 1, sizeof (struct lob_struct) + 2);
   if(!(p->raw = malloc(2))) return lob_free(p);
   memset(p->raw,0,2);
 //  DEBUG_PRINTF("packet +++ %d",p);
@@ -67,6 +69,7 @@ lob_t lob_free(lob_t p)
   if(!p) return NULL;
 //  DEBUG_PRINTF("packet --- %d",p);
   if(p->chain) lob_free(p->chain);
+  MEMSTAT_ADD(MEMSTAT_LOB, -1, -(int32_t)(sizeof (struct lob_struct) + lob_len(p)));
   if(p->cache) free(p->cache);
   if(p->raw) free(p->raw);
   free(p);
@@ -100,6 +103,7 @@ lob_t lob_parse(uint8_t *raw, uint32_t len)
   // copy in and update pointers
   p = lob_new();
   if(!(p->raw = realloc(p->raw,len))) return lob_free(p);
+  MEMSTAT_ADD(MEMSTAT_LOB, 0, len - 2);
   memcpy(p->raw,raw,len);
   p->head_len = hlen;
   p->head = p->raw+2;
@@ -114,6 +118,35 @@ lob_t lob_parse(uint8_t *raw, uint32_t len)
   return p;
 }
 
+// reuse the existing buffer, the len bytes at raw+offset become the whole packet
+lob_t lob_reparse(lob_t p, uint32_t offset, uint32_t len)
+{
+  uint16_t nlen, hlen;
+  int jtest;
+
+  if(!p || !p->raw || len < 2 || offset+len > lob_len(p)) return NULL;
+  if(offset) memmove(p->raw,p->raw+offset,len);
+  memcpy(&nlen,p->raw,2);
+  hlen = platform_short(nlen);
+  if(hlen > len-2) return NULL;
+
+  // any edited json is stale now, the buffer is counted as just the new length
+  if(p->cache) free(p->cache);
+  p->cache = NULL;
+  MEMSTAT_ADD(MEMSTAT_LOB, 0, (int32_t)len - (int32_t)lob_len(p));
+  p->head_len = hlen;
+  p->head = p->raw+2;
+  p->body_len = len-(2+p->head_len);
+  p->body = p->raw+(2+p->head_len);
+
+  // validate any json
+  jtest = 0;
+  if(p->head_len >= 2) js0n("\0",1,(char*)p->head,p->head_len,&jtest);
+  if(jtest) return NULL;
+
+  return p;
+}
+
 uint8_t *lob_head(lob_t p, uint8_t *head, uint16_t len)
 {
   uint16_t nlen;
@@ -122,6 +155,7 @@ uint8_t *lob_head(lob_t p, uint8_t *head, uint16_t len)
 
   // new space and update pointers
   if(!(ptr = realloc(p->raw,2+len+p->body_len))) return NULL;
+  MEMSTAT_ADD(MEMSTAT_LOB, 0, (int32_t)len - (int32_t)p->head_len);
   p->raw = (uint8_t *)ptr;
   p->head = p->raw+2;
   p->body = p->raw+(2+len);
@@ -142,6 +176,7 @@ uint8_t *lob_body(lob_t p, uint8_t *body, uint32_t len)
   void *ptr;
   if(!p) return NULL;
   if(!(ptr = realloc(p->raw,2+len+p->head_len))) return NULL;
+  MEMSTAT_ADD(MEMSTAT_LOB, 0, (int32_t)len - (int32_t)p->body_len);
   p->raw = (uint8_t *)ptr;
   p->head = p->raw+2;
   p->body = p->raw+(2+p->head_len);
@@ -155,6 +190,7 @@ lob_t lob_append(lob_t p, uint8_t *chunk, uint32_t len)
   void *ptr;
   if(!p || !chunk || !len) return LOG("bad args");
   if(!(ptr = realloc(p->raw,2+len+p->body_len+p->head_len))) return NULL;
+  MEMSTAT_ADD(MEMSTAT_LOB, 0, len);
   p->raw = (unsigned char *)ptr;
   p->head = p->raw+2;
   p->body = p->raw+(2+p->head_len);
@@ -243,6 +279,15 @@ lob_t lob_set_int(lob_t p, char *key, int val)
   return p;
 }
 
+lob_t lob_set_uint(lob_t p, char *key, uint32_t val)
+{
+  char num[32];
+  if(!p || !key) return LOG("bad args");
+  sprintf(num,"%u",val);
+  lob_set_raw(p, key, num, 0);
+  return p;
+}
+
 lob_t lob_set(lob_t p, char *key, char *val)
 {
   char *escaped;
@@ -273,6 +318,7 @@ lob_t lob_set_base32(lob_t p, char *key, uint8_t *bin, uint16_t blen)
   base32_encode_into(bin, blen, val+1);
   val[vlen+1] = '"';
   lob_set_raw(p,key,val,vlen+2);
+  free(val);
   return p;
 }
 
@@ -529,26 +575,50 @@ lob_t lob_set_json(lob_t p, lob_t json)
 // sha256("telehash")
 static const uint8_t _cloak_key[32] = {0xd7, 0xf0, 0xe5, 0x55, 0x54, 0x62, 0x41, 0xb2, 0xa9, 0x44, 0xec, 0xd6, 0xd0, 0xde, 0x66, 0x85, 0x6a, 0xc5, 0x0b, 0x0b, 0xab, 0xa7, 0x6a, 0x6f, 0x5a, 0x47, 0x82, 0x95, 0x6c, 0xa9, 0x45, 0x9a};
 
+// cloaks into buf, which must have lob_len()+(8*rounds) space, returns that length
+uint32_t lob_cloak_into(lob_t p, uint8_t rounds, uint8_t *buf)
+{
+  uint32_t len, at;
+  if(!p || !buf) return 0;
+  len = lob_len(p);
+  memmove(buf+(8*rounds),lob_raw(p),len);
+  len += 8*rounds;
+
+  // innermost round first, each one is a fresh nonce that must not start with 0x00
+  for(at = 8*rounds; at > 0; at -= 8)
+  {
+    e3x_rand(buf+(at-8), 8);
+    while(!buf[at-8]) e3x_rand(buf+(at-8), 1);
+    chacha20((uint8_t*)_cloak_key, buf+(at-8), buf+at, len-at);
+  }
+
+  return len;
+}
+
 // handles cloaking conveniently, len is lob_len()+(8*rounds)
 uint8_t *lob_cloak(lob_t p, uint8_t rounds)
 {
-  uint8_t *ret, len;
+  uint8_t *ret;
+  uint32_t len;
   if(!p || !rounds) return lob_raw(p);
-  len = lob_len(p);
-  len += 8*rounds;
+  len = lob_len(p) + (8*rounds);
   if(!(ret = malloc(len))) return LOG("OOM needed %d",len);
-  // TODO rounds
-  e3x_rand(ret, 8);
-  memcpy(ret+8,lob_raw(p),lob_len(p));
-  chacha20((uint8_t*)_cloak_key, ret, ret+8, lob_len(p));
+  lob_cloak_into(p, rounds, ret);
   return ret;
 }
 
-// decloaks and parses
+// decloaks in place (modifies cloaked) and parses, uncloaked packets are just parsed
 lob_t lob_decloak(uint8_t *cloaked, uint32_t len)
 {
   if(!cloaked || !len) return LOG("bad args");
-  // TODO
-  return NULL;
-}
 
+  // a packet always starts with a 0x00 (head length), anything else is a nonce
+  while(len > 8 && cloaked[0])
+  {
+    chacha20((uint8_t*)_cloak_key, cloaked, cloaked+8, len-8);
+    cloaked += 8;
+    len -= 8;
+  }
+
+  return lob_parse(cloaked, len);
+}
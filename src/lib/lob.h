@@ -41,6 +41,9 @@ lob_t lob_unlink(lob_t parent);
 // initialize head/body from raw, parses json
 lob_t lob_parse(uint8_t *raw, uint32_t len);
 
+// parses len bytes at offset in the existing raw buffer in place (moved to the front), no copy, NULL if invalid
+lob_t lob_reparse(lob_t p, uint32_t offset, uint32_t len);
+
 // return full encoded packet
 uint8_t *lob_raw(lob_t p);
 uint32_t lob_len(lob_t p);
@@ -57,6 +60,7 @@ lob_t lob_append(lob_t p, uint8_t *chunk, uint32_t len);
 lob_t lob_set_raw(lob_t p, char *key, char *val, uint16_t vlen); // raw
 lob_t lob_set(lob_t p, char *key, char *val); // escapes value
 lob_t lob_set_int(lob_t p, char *key, int val);
+lob_t lob_set_uint(lob_t p, char *key, uint32_t val);
 lob_t lob_set_printf(lob_t p, char *key, const char *format, ...);
 lob_t lob_set_base32(lob_t p, char *key, uint8_t *val, uint16_t vlen);
 
@@ -92,7 +96,10 @@ lob_t lob_get_base32(lob_t p, char *key); // decoded binary is the return body
 // handles cloaking conveniently, len is lob_len()+(8*rounds)
 uint8_t *lob_cloak(lob_t p, uint8_t rounds);
 
-// decloaks and parses
+// cloaks into a caller buffer of at least lob_len()+(8*rounds), returns that length
+uint32_t lob_cloak_into(lob_t p, uint8_t rounds, uint8_t *buf);
+
+// decloaks in place (modifies the buffer) and parses, uncloaked packets are just parsed
 lob_t lob_decloak(uint8_t *cloaked, uint32_t len);
 
 // TODO, this would be handy, js syntax to get a json value
@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include "memstat.h"
+
+static int32_t _counts[MEMSTAT_KINDS];
+static int64_t _bytes[MEMSTAT_KINDS];
+static char *_names[MEMSTAT_KINDS] = {"lob","xht","pipe","link","exchange","channel"};
+
+void memstat_add(enum memstat_kind kind, int32_t count, int32_t bytes)
+{
+  if(kind >= MEMSTAT_KINDS) return;
+#ifdef __GNUC__
+  __atomic_add_fetch(&_counts[kind], count, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&_bytes[kind], (int64_t)bytes, __ATOMIC_RELAXED);
+#else
+  _counts[kind] += count;
+  _bytes[kind] += bytes;
+#endif
+}
+
+int32_t memstat_count(enum memstat_kind kind)
+{
+  if(kind >= MEMSTAT_KINDS) return 0;
+#ifdef __GNUC__
+  return __atomic_load_n(&_counts[kind], __ATOMIC_RELAXED);
+#else
+  return _counts[kind];
+#endif
+}
+
+int64_t memstat_bytes(enum memstat_kind kind)
+{
+  if(kind >= MEMSTAT_KINDS) return 0;
+#ifdef __GNUC__
+  return __atomic_load_n(&_bytes[kind], __ATOMIC_RELAXED);
+#else
+  return _bytes[kind];
+#endif
+}
+
+char *memstat_name(enum memstat_kind kind)
+{
+  if(kind >= MEMSTAT_KINDS) return NULL;
+  return _names[kind];
+}
+
+lob_t memstat_stats(lob_t stats)
+{
+  char key[32];
+  int kind;
+  if(!stats && !(stats = lob_new())) return NULL;
+  for(kind = 0; kind < MEMSTAT_KINDS; kind++)
+  {
+    snprintf(key,sizeof(key),"%s_count",_names[kind]);
+    lob_set_int(stats,key,(int)memstat_count(kind));
+    snprintf(key,sizeof(key),"%s_bytes",_names[kind]);
+    lob_set_int(stats,key,(int)memstat_bytes(kind));
+  }
+  return stats;
+}
@@ -0,0 +1,29 @@
+#ifndef memstat_h
+#define memstat_h
+
+#include <stdint.h>
+#include "lob.h"
+
+// opt-in process-wide accounting of live objects and their bytes by kind, only counted when built with -DMEMSTAT
+enum memstat_kind { MEMSTAT_LOB, MEMSTAT_XHT, MEMSTAT_PIPE, MEMSTAT_LINK, MEMSTAT_EXCHANGE, MEMSTAT_CHANNEL, MEMSTAT_KINDS };
+
+#ifdef MEMSTAT
+#define MEMSTAT_ADD(kind,count,bytes) memstat_add(kind,count,bytes)
+#else
+#define MEMSTAT_ADD(kind,count,bytes) do{}while(0)
+#endif
+
+// adjust the live count and bytes of a kind (negative when freed), safe from any thread
+void memstat_add(enum memstat_kind kind, int32_t count, int32_t bytes);
+
+// current totals for a kind
+int32_t memstat_count(enum memstat_kind kind);
+int64_t memstat_bytes(enum memstat_kind kind);
+
+// lowercase name of the kind, "lob" "xht" "pipe" "link" "exchange" "channel"
+char *memstat_name(enum memstat_kind kind);
+
+// adds name_count/name_bytes of every kind to the stats (new if NULL)
+lob_t memstat_stats(lob_t stats);
+
+#endif
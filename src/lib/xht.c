@@ -1,4 +1,5 @@
 #include "xht.h"
+#include "memstat.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -63,6 +64,7 @@ xht_t xht_new(int prime)
       return NULL;
     }
     memset(xnew->zen,0,sizeof(struct xhashname_struct)*prime);
+    MEMSTAT_ADD(MEMSTAT_XHT, 1, sizeof(struct xht_struct) + sizeof(struct xhashname_struct)*prime);
     return xnew;
 }
 
@@ -87,6 +89,7 @@ void _xht_set(xht_t h, const char *key, void *val, char flag)
         n = (xhn)malloc(sizeof(struct xhashname_struct));
         if(!n) return;
         memset(n,0,sizeof(struct xhashname_struct));
+        MEMSTAT_ADD(MEMSTAT_XHT, 0, sizeof(struct xhashname_struct));
         n->next = h->zen[i].next;
         h->zen[i].next = n;
     }
@@ -98,8 +101,9 @@ void _xht_set(xht_t h, const char *key, void *val, char flag)
         free(n->val);
     }
 
+    /* a cleared entry doesn't keep a ref to the caller's key */
     n->flag = flag;
-    n->key = key;
+    n->key = val ? key : 0;
     n->val = val;
 }
 
@@ -159,9 +163,11 @@ void xht_free(xht_t h)
                 free(n->val);
             }
             free(n);
+            MEMSTAT_ADD(MEMSTAT_XHT, 0, -(int32_t)sizeof(struct xhashname_struct));
             n = f;
         }
 
+    MEMSTAT_ADD(MEMSTAT_XHT, -1, -(int32_t)(sizeof(struct xht_struct) + sizeof(struct xhashname_struct)*h->prime));
     free(h->zen);
     free(h);
 }
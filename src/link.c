@@ -11,6 +11,14 @@ typedef struct seen_struct
 {
   pipe_t pipe;
   uint32_t at;
+  uint32_t recv; // ms of the last packet in on it
+  uint32_t waiting; // ms of the first send since then, 0 if answered
+  uint32_t synced; // ms our handshake went out, 0 once it's been answered
+  uint32_t srtt; // smoothed handshake round trip ms, 0 if none yet
+  uint32_t delivered; // bytes in on it lately, aged by every delivery on the link so pipes compare by share
+  uint32_t errs; // the pipe's errs as of the last receive
+  int32_t credit; // its share of striped sends, smooth weighted round robin
+  uint8_t tries; // handshakes resent without an answer
   struct seen_struct *next;
 } *seen_t;
 
@@ -20,47 +28,150 @@ typedef struct chan_struct
   channel3_t c3;
   void *arg;
   void (*handle)(link_t link, channel3_t c3, void *arg);
+  uint8_t held; // on the link's deferred list
+  uint8_t dup; // sent on the runner up pipe too
+  struct chan_struct *next;
 } *chan_t;
 
+static void batch_send(link_t link);
+static link_t outer_send(link_t link, lob_t outer, uint8_t dup);
+static void chan_free(link_t link, chan_t chan);
+
+// takes it off the mesh's idle list if it's there
+static void idle_remove(link_t link)
+{
+  mesh_t mesh = link->mesh;
+  if(link->idle_prev) link->idle_prev->idle_next = link->idle_next;
+  else if(mesh->idle == link) mesh->idle = link->idle_next;
+  else return;
+  if(link->idle_next) link->idle_next->idle_prev = link->idle_prev;
+  else mesh->idle_tail = link->idle_prev;
+  link->idle_prev = link->idle_next = NULL;
+}
+
+void link_dirty(link_t link)
+{
+  if(!link || link->dirty) return;
+  link->dirty = 1;
+  link->dirty_next = link->mesh->dirty;
+  link->mesh->dirty = link;
+}
+
+// marks it just used, ones without channels move to the front of the idle list so the tail is always the lru
+static void link_used(link_t link)
+{
+  mesh_t mesh = link->mesh;
+  link->used = platform_ms();
+  link_dirty(link);
+  if(link->chans) return;
+  idle_remove(link);
+  if((link->idle_next = mesh->idle)) mesh->idle->idle_prev = link;
+  else mesh->idle_tail = link;
+  mesh->idle = link;
+}
+
+// frees the least recently used link without channels, 0 if there's none
+static uint8_t link_evict(mesh_t mesh)
+{
+  link_t lru;
+  for(lru = mesh->idle_tail; lru && lru->held; lru = lru->idle_prev);
+  if(!lru) return 0;
+  LOG_INFO("evicting least recently used link %s",lru->id->hashname);
+  link_free(lru);
+  return 1;
+}
+
+static void chan_walk_free(xht_t h, const char *key, void *val, void *arg)
+{
+  chan_free((link_t)arg, (chan_t)val);
+}
+
 link_t link_new(mesh_t mesh, hashname_t id)
 {
   link_t link;
 
   if(!mesh || !id) return LOG("invalid args");
 
+  if(mesh->links_max && mesh->links_count >= mesh->links_max && !link_evict(mesh))
+  {
+    hashname_free(id);
+    return LOG_WARN("at the limit of %u links, none can be evicted",mesh->links_max);
+  }
+
   LOG("adding link %s",id->hashname);
   if(!(link = malloc(sizeof (struct link_struct)))) return (link_t)hashname_free(id);
   memset(link,0,sizeof (struct link_struct));
+  MEMSTAT_ADD(MEMSTAT_LINK, 1, sizeof (struct link_struct));
   
   link->id = id;
   link->mesh = mesh;
   xht_set(mesh->index,id->hashname,link);
+  if((link->next = mesh->links)) mesh->links->prev = link;
+  mesh->links = link;
+  mesh->links_count++;
+  link_used(link);
 
   // to size larger, app can xht_free(); link->channels = xht_new(BIGGER) at start itself
   link->channels = xht_new(5); // index of all channels
   link->index = xht_new(5); // index for active channels and extensions
+  link->cc = congest3_new();
+  link->ev = event3_new(5); // channel timers by uid
+  if((link->due = lob_new())) link->due->arg = link;
 
   return link;
 }
 
 void link_free(link_t link)
 {
+  lob_t tmp;
+  link_t *prev;
+  seen_t seen;
   if(!link) return;
   LOG("dropping link %s",link->id->hashname);
+  mesh_unlink(link->mesh, link);
   xht_set(link->mesh->index,link->id->hashname,NULL);
+  if(link->prev) link->prev->next = link->next;
+  else link->mesh->links = link->next;
+  if(link->next) link->next->prev = link->prev;
+  link->mesh->links_count--;
+
+  // no longer scheduled or waiting to be
+  event3_set(link->mesh->due, link->due, link->id->hashname, 0);
+  lob_free(link->due);
+  if(link->dirty) for(prev = &link->mesh->dirty; *prev; prev = &(*prev)->dirty_next) if(*prev == link)
+  {
+    *prev = link->dirty_next;
+    break;
+  }
 
-  // TODO go through ->pipes
+  // the pipes belong to their transports, just our state about them goes
+  while((seen = link->pipes))
+  {
+    link->pipes = seen->next;
+    free(seen);
+  }
 
-  // TODO go through link->channels
+  // channels cancel their timers so have to go before the events, the last one puts it back on the idle list
+  xht_walk(link->channels, chan_walk_free, link);
+  idle_remove(link);
   xht_free(link->channels);
   xht_free(link->index);
+  congest3_free(link->cc);
+  event3_free(link->ev);
+  while((tmp = link->batched))
+  {
+    link->batched = tmp->next;
+    lob_free(tmp);
+  }
 
   hashname_free(link->id);
+  lob_free(link->key);
   if(link->x)
   {
     xht_set(link->mesh->index,link->token,NULL);
     exchange3_free(link->x);
   }
+  MEMSTAT_ADD(MEMSTAT_LINK, -1, -(int32_t)sizeof (struct link_struct));
   free(link);
 }
 
@@ -84,11 +195,16 @@ link_t link_get(mesh_t mesh, char *hashname)
 link_t link_keys(mesh_t mesh, lob_t keys)
 {
   uint8_t csid;
+  lob_t key;
+  link_t link;
 
   if(!mesh || !keys) return LOG("invalid args");
   csid = hashname_id(mesh->keys,keys);
   if(!csid) return LOG("no supported key");
-  return link_key(mesh, hashname_im(keys,csid));
+  key = hashname_im(keys,csid);
+  link = link_key(mesh, key);
+  lob_free(key);
+  return link;
 }
 
 link_t link_key(mesh_t mesh, lob_t key)
@@ -109,7 +225,7 @@ link_t link_key(mesh_t mesh, lob_t key)
   {
     hashname_free(hn);
   }else{
-    link = link_new(mesh,hn);
+    if(!(link = link_new(mesh,hn))) return NULL;
   }
 
   // load key if it's not yet
@@ -191,6 +307,110 @@ link_t link_pipe(link_t link, pipe_t pipe)
   return link_sync(link);
 }
 
+// something came in on this pipe, it's trusted and alive, handshakes answer our last one for an rtt
+static void pipe_heard(link_t link, pipe_t pipe, uint8_t handshake, uint32_t len)
+{
+  seen_t seen, s;
+  uint32_t now, rtt;
+
+  if(!pipe) return;
+  link_dirty(link);
+  link_pipe(link,pipe);
+  for(seen = link->pipes; seen && seen->pipe != pipe; seen = seen->next);
+  if(!seen) return;
+
+  now = platform_ms();
+  if(handshake && seen->synced)
+  {
+    rtt = now - seen->synced;
+    seen->srtt = seen->srtt ? ((seen->srtt * 7) + rtt) / 8 : (rtt ? rtt : 1);
+    seen->synced = 0;
+  }
+  seen->recv = now;
+  seen->waiting = 0;
+
+  // about the last 16 deliveries, a pipe carrying more of them has the room to
+  if(len)
+  {
+    for(s = link->pipes; s; s = s->next) s->delivered -= s->delivered >> 4;
+    seen->delivered += len;
+  }
+  seen->tries = 0;
+  seen->errs = PIPE_GET(pipe, errs);
+}
+
+// failing worst, then gone quiet, else fine
+static uint8_t pipe_health(seen_t seen, uint32_t now)
+{
+  if(PIPE_GET(seen->pipe, errs) != seen->errs) return 2;
+  if(seen->waiting && now - seen->waiting >= LINK_PIPE_SILENT) return 1;
+  return 0;
+}
+
+// the healthiest pipe, then fastest, then most recently heard from (other than skip)
+static seen_t pipe_best(link_t link, seen_t skip)
+{
+  seen_t seen, best = NULL;
+  uint32_t now = platform_ms();
+  uint8_t health, best_health = 0;
+
+  for(seen = link->pipes; seen; seen = seen->next)
+  {
+    if(seen == skip || !seen->pipe || !seen->pipe->send) continue;
+    health = pipe_health(seen, now);
+    if(best)
+    {
+      if(health > best_health) continue;
+      if(health == best_health)
+      {
+        // no rtt yet ranks after any known one
+        if(seen->srtt != best->srtt && (!seen->srtt || (best->srtt && seen->srtt > best->srtt))) continue;
+        if(seen->srtt == best->srtt && now - seen->recv >= now - best->recv) continue;
+      }
+    }
+    best = seen;
+    best_health = health;
+  }
+
+  return best;
+}
+
+// healthy and answered at least once, any rtt (even under a ms) is fine
+static uint8_t pipe_stripes(seen_t seen, uint32_t now)
+{
+  return seen->pipe && seen->pipe->send && seen->srtt && !pipe_health(seen, now);
+}
+
+// spread across the answered healthy pipes in proportion to what each has delivered lately, the best one if none are
+static seen_t pipe_stripe(link_t link)
+{
+  seen_t seen, best = NULL;
+  uint32_t now = platform_ms(), measured = 0, sum = 0, avg;
+  int32_t weight, total = 0;
+
+  for(seen = link->pipes; seen; seen = seen->next)
+  {
+    if(!pipe_stripes(seen, now) || !seen->delivered) continue;
+    sum += seen->delivered;
+    measured++;
+  }
+
+  // ones nothing has come in on yet (new, or the other side isn't using them) get an average share to find out
+  avg = measured ? sum / measured : 1;
+  for(seen = link->pipes; seen; seen = seen->next)
+  {
+    if(!pipe_stripes(seen, now)) continue;
+    weight = (int32_t)(seen->delivered ? seen->delivered : avg);
+    seen->credit += weight;
+    total += weight;
+    if(!best || seen->credit > best->credit) best = seen;
+  }
+  if(!best) return pipe_best(link, NULL);
+
+  best->credit -= total;
+  return best;
+}
+
 // can channel data be sent/received
 link_t link_ready(link_t link)
 {
@@ -201,11 +421,42 @@ link_t link_ready(link_t link)
   return link;
 }
 
+// every outer goes out through here to be counted
+static void pipe_out(link_t link, pipe_t pipe, lob_t outer, uint8_t hs)
+{
+  if(!outer) return;
+  link_dirty(link);
+  MESH_COUNT(link->stats, packets_out, 1);
+  MESH_COUNT(link->stats, bytes_out, lob_len(outer));
+  MESH_COUNT(link->mesh->stats, packets_out, 1);
+  MESH_COUNT(link->mesh->stats, bytes_out, lob_len(outer));
+  if(hs)
+  {
+    MESH_COUNT(link->stats, handshakes_out, 1);
+    MESH_COUNT(link->mesh->stats, handshakes_out, 1);
+  }
+  pipe->send(pipe, outer, link);
+}
+
+// our current handshake, advertising any features
+static lob_t handshake(link_t link)
+{
+  lob_t json, ret;
+  if(!link->batch && link->paths != LINK_DUP) return exchange3_handshake(link->x);
+  json = lob_new();
+  if(link->batch) lob_set_int(json,"batch",link->batch);
+  if(link->paths == LINK_DUP) lob_set_int(json,"dup",1);
+  ret = exchange3_handshake_json(link->x, json);
+  lob_free(json);
+  return ret;
+}
+
 // process an incoming handshake
 link_t link_handshake(link_t link, lob_t inner, lob_t outer, pipe_t pipe)
 {
   link_t ready;
   uint32_t out;
+  int batch;
 
   if(!link || !inner || !outer) return LOG("bad args");
   if(!link->key && link_key(link->mesh,inner) != link) return LOG("invalid/mismatch handshake key");
@@ -216,15 +467,20 @@ link_t link_handshake(link_t link, lob_t inner, lob_t outer, pipe_t pipe)
   if(exchange3_in(link->x, lob_get_int(inner,"at")) < out)
   {
     LOG("old/bad at: %s (%d,%d,%d)",lob_json(inner),lob_get_int(inner,"at"),exchange3_in(link->x,0),exchange3_out(link->x,0));
-    if(pipe) pipe->send(pipe,exchange3_handshake(link->x),link);
+    if(pipe) pipe_out(link, pipe, handshake(link), 1);
     return NULL;
   }
 
   // trust/add this pipe
-  if(pipe) link_pipe(link,pipe);
+  pipe_heard(link,pipe,1,0);
 
   // try to sync ephemeral key
   if(!exchange3_sync(link->x,outer)) return LOG("sync failed");
+
+  // features they support, from their latest handshake
+  batch = lob_get_int(inner,"batch");
+  link->batch_remote = (batch > 0xffff) ? 0xffff : (batch < 0) ? 0 : (uint16_t)batch;
+  link->dedupe = lob_get_int(inner,"dup") ? 1 : 0;
   
   // we may need to re-sync
   if(out != exchange3_out(link->x,0)) link_sync(link);
@@ -232,7 +488,7 @@ link_t link_handshake(link_t link, lob_t inner, lob_t outer, pipe_t pipe)
   // notify of ready state change
   if(!ready && link_ready(link))
   {
-    LOG("link ready");
+    LOG_INFO("link ready");
     mesh_link(link->mesh, link);
   }
   
@@ -243,14 +499,64 @@ link_t link_handshake(link_t link, lob_t inner, lob_t outer, pipe_t pipe)
 link_t link_receive(link_t link, lob_t inner, pipe_t pipe)
 {
   chan_t chan;
+  lob_t one;
+  uint32_t at, len;
 
   if(!link || !inner) return LOG("bad args");
 
+  // coalesced packets are each handled in turn, any replies get batched together too
+  if(!lob_get(inner,"c") && lob_get(inner,"batch"))
+  {
+    link->corked++;
+    for(at = 0; at + 2 <= inner->body_len; at += 2 + len)
+    {
+      len = ((uint32_t)inner->body[at] << 8) | inner->body[at+1];
+      if(at + 2 + len > inner->body_len)
+      {
+        LOG("invalid batch framing at %u of %u",at,inner->body_len);
+        break;
+      }
+      if(!(one = lob_parse(inner->body+at+2, len))) continue;
+      if(!lob_get(one,"c") && lob_get(one,"batch"))
+      {
+        lob_free(one); // no nesting
+        continue;
+      }
+      link_receive(link, one, pipe);
+    }
+    lob_free(inner);
+    if(!--link->corked) batch_send(link);
+    return link;
+  }
+
+  link_used(link);
+
   // see if existing channel and send there
   if((chan = xht_get(link->index, lob_get(inner,"c"))))
   {
-    if(channel3_receive(chan->c3, inner)) return LOG("channel receive error, dropping %s",lob_json(inner));
-    link_pipe(link,pipe); // we trust the pipe at this point
+    len = lob_len(inner); // the channel takes it
+    if(channel3_receive(chan->c3, inner))
+    {
+      LOG("channel receive error, dropping %s",lob_json(inner));
+      lob_free(inner);
+      return NULL;
+    }
+    pipe_heard(link,pipe,0,len); // we trust the pipe at this point
+
+    // held links run the handler once on release
+    if(link->held)
+    {
+      if(!chan->held)
+      {
+        chan->held = 1;
+        chan->next = NULL;
+        if(!link->deferred) link->deferred = chan;
+        else link->deferred_tail->next = chan;
+        link->deferred_tail = chan;
+      }
+      return link;
+    }
+
     if(chan->handle) chan->handle(link, chan->c3, chan->arg);
     // check if there's any packets to be sent back
     return link_flush(link, chan->c3, NULL);
@@ -260,9 +566,13 @@ link_t link_receive(link_t link, lob_t inner, pipe_t pipe)
   if(!lob_get(inner,"type")) return LOG("invalid channel open, no type %s",lob_json(inner));
   if(!exchange3_cid(link->x, inner)) return LOG("invalid channel open id %s",lob_json(inner));
   link_pipe(link,pipe); // we trust the pipe at this point
+  MESH_COUNT(link->stats, opens, 1);
+  MESH_COUNT(link->mesh->stats, opens, 1);
   inner = mesh_open(link->mesh,link,inner);
   if(inner)
   {
+   MESH_COUNT(link->stats, opens_unhandled, 1);
+   MESH_COUNT(link->mesh->stats, opens_unhandled, 1);
    LOG("unhandled channel open %s",lob_json(inner));
    lob_free(inner);
    return NULL;
@@ -271,38 +581,177 @@ link_t link_receive(link_t link, lob_t inner, pipe_t pipe)
   return link;
 }
 
+// most a batch inner's head and framing add
+#define BATCH_OVERHEAD 16
+
+// encrypts and sends one inner now, always takes it
+static void inner_send(link_t link, lob_t inner, uint8_t dup)
+{
+  link_used(link);
+  outer_send(link, exchange3_send(link->x, inner), dup);
+  lob_free(inner);
+}
+
+// the held inners go out together as one (or as is if just one)
+static void batch_send(link_t link)
+{
+  lob_t inner, batch;
+  uint32_t count = 0, at = 0, len;
+  uint8_t *body, dup = link->batched_dup;
+
+  if(!(inner = link->batched)) return;
+  link->batched_dup = 0;
+  for(batch = inner; batch; batch = batch->next) count++;
+  batch = NULL;
+  if(count > 1)
+  {
+    batch = lob_set_int(lob_new(),"batch",(int)count);
+    if(!(body = lob_body(batch,NULL,link->batched_len))) batch = lob_free(batch);
+  }
+  link->batched_len = 0;
+
+  // out of memory just sends them one at a time
+  for(; inner; inner = link->batched)
+  {
+    link->batched = inner->next;
+    inner->next = NULL;
+    if(!batch)
+    {
+      inner_send(link, inner, dup);
+      continue;
+    }
+    len = lob_len(inner);
+    body[at] = (uint8_t)(len >> 8);
+    body[at+1] = (uint8_t)len;
+    memcpy(body+at+2, lob_raw(inner), len);
+    at += 2 + len;
+    lob_free(inner);
+  }
+
+  if(batch) inner_send(link, batch, dup);
+}
+
+// sends or holds onto it to go out with others, always takes it
+static void inner_queue(link_t link, lob_t inner, uint8_t dup)
+{
+  uint32_t max = (link->batch < link->batch_remote) ? link->batch : link->batch_remote;
+  uint32_t len = lob_len(inner) + 2;
+
+  // send any held ones first to keep the order
+  if(link->batched && (!max || link->batched_len + len + BATCH_OVERHEAD > max)) batch_send(link);
+  if(!max || len + BATCH_OVERHEAD > max)
+  {
+    inner_send(link, inner, dup);
+    return;
+  }
+
+  inner->next = NULL;
+  if(!link->batched) link->batched = inner;
+  else link->batched_tail->next = inner;
+  link->batched_tail = inner;
+  link->batched_len += len;
+  link->batched_dup |= dup;
+}
+
+link_t link_batch(link_t link, uint16_t size)
+{
+  if(!link) return LOG("bad args");
+  link->batch = size;
+  if(!size) batch_send(link);
+  return link;
+}
+
 // send this packet to the best pipe
 link_t link_send(link_t link, lob_t outer)
 {
-  pipe_t pipe;
-  
+  return outer_send(link, outer, 0);
+}
+
+// dup is only honored for LINK_DUP, where the other side is dropping repeats
+static link_t outer_send(link_t link, lob_t outer, uint8_t dup)
+{
+  seen_t seen, also;
+  uint32_t now;
+
   if(!link) return LOG("bad args");
-  if(!link->pipes || !(pipe = link->pipes->pipe)) return LOG("no network");
+  if(!(seen = (link->paths == LINK_STRIPE) ? pipe_stripe(link) : pipe_best(link, NULL)))
+  {
+    lob_free(outer);
+    return LOG("no network");
+  }
 
-  pipe->send(pipe, outer, link);
+  // the same outer on the runner up too, the other side drops whichever comes second
+  if(dup && link->paths == LINK_DUP && (also = pipe_best(link, seen)) && pipe_health(also, platform_ms()) < 2)
+  {
+    if(!also->waiting && (now = platform_ms())) also->waiting = now;
+    pipe_out(link, also->pipe, lob_copy(outer), 0);
+  }
+
+  // starts the clock on it going quiet
+  if(!seen->waiting && (now = platform_ms())) seen->waiting = now;
+  pipe_out(link, seen->pipe, outer, 0);
   return link;
 }
 
+link_t link_dup(link_t link, channel3_t c3, uint8_t dup)
+{
+  chan_t chan;
+  if(!link || !c3) return LOG("bad args");
+  if(!(chan = xht_get(link->channels, channel3_uid(c3)))) return LOG("unknown channel %s",channel3_uid(c3));
+  chan->dup = dup ? 1 : 0;
+  return link;
+}
+
+link_t link_paths(link_t link, enum link_paths paths)
+{
+  if(!link) return LOG("bad args");
+  if(link->paths == paths) return link;
+  link->paths = paths;
+
+  // the other side learns to dedupe from our handshake
+  if(link->x) link_resync(link);
+  return link;
+}
+
+// a short hash of each recent outer, encryption makes every send unique so any repeat is a duplicate
+uint8_t link_duplicate(link_t link, lob_t outer)
+{
+  uint32_t hash, i;
+  if(!link || !outer || !link->dedupe) return 0;
+
+  // cipher suites put their nonces and macs at the ends, fnv-1a over those
+  hash = 2166136261u ^ outer->body_len;
+  for(i = 0; i < outer->body_len && i < 32; i++) hash = (hash ^ outer->body[i]) * 16777619u;
+  for(i = (outer->body_len > 64) ? outer->body_len - 32 : 32; i < outer->body_len; i++) hash = (hash ^ outer->body[i]) * 16777619u;
+
+  for(i = 0; i < LINK_DEDUPE; i++) if(link->dups[i] == hash) return 1;
+  link->dups[link->dups_at++ % LINK_DEDUPE] = hash;
+  return 0;
+}
+
 // make sure all pipes have the current handshake
 link_t link_sync(link_t link)
 {
-  uint32_t at;
+  uint32_t at, now;
   seen_t seen;
-  lob_t handshake = NULL;
+  lob_t hs = NULL;
   if(!link) return LOG("bad args");
   if(!link->x) return LOG("no exchange");
 
   at = exchange3_out(link->x,0);
-  LOG("link sync at %d",at);
+  LOG_TRACE("link sync at %d",at);
   for(seen = link->pipes;seen;seen = seen->next)
   {
     if(!seen->pipe || !seen->pipe->send || seen->at == at) continue;
-    if(!handshake) handshake = exchange3_handshake(link->x); // only create if we have to
+    if(!hs) hs = handshake(link); // only create if we have to
     seen->at = at;
-    seen->pipe->send(seen->pipe,lob_copy(handshake),link);
+    now = platform_ms();
+    if(now) seen->synced = now;
+    if(!seen->waiting && now) seen->waiting = now;
+    pipe_out(link, seen->pipe, lob_copy(hs), 1);
   }
 
-  lob_free(handshake);
+  lob_free(hs);
   return link;
 }
 
@@ -338,8 +787,12 @@ channel3_t link_channel(link_t link, lob_t open)
   }
   memset(chan,0,sizeof (struct chan_struct));
   chan->c3 = c3;
+  channel3_congest(c3, link->cc);
+  channel3_timeout(c3, link->ev, CHANNEL3_TIMEOUT);
   xht_set(link->channels, channel3_uid(c3), chan);
   xht_set(link->index, channel3_c(c3), chan);
+  if(!link->chans++) idle_remove(link);
+  link_dirty(link);
 
   return c3;
 }
@@ -359,19 +812,193 @@ link_t link_handle(link_t link, channel3_t c3, void (*handle)(link_t link, chann
 }
 
 // process any outgoing packets for this channel, optionally send given packet too
+// removes a channel from the link's indexes and frees it
+static void chan_free(link_t link, chan_t chan)
+{
+  chan_t *prev, last = NULL;
+  if(chan->held) for(prev = &link->deferred; *prev; last = *prev, prev = &(*prev)->next) if(*prev == chan)
+  {
+    *prev = chan->next;
+    if(link->deferred_tail == chan) link->deferred_tail = last;
+    break;
+  }
+  if(xht_get(link->index, channel3_c(chan->c3)) == chan) xht_set(link->index, channel3_c(chan->c3), NULL);
+  xht_set(link->channels, channel3_uid(chan->c3), NULL);
+  channel3_free(chan->c3);
+  free(chan);
+  if(!--link->chans) link_used(link);
+}
+
+// how long to wait on a pipe's handshake before sending it again
+static uint32_t retry_ms(seen_t seen)
+{
+  return LINK_RETRY << ((seen->tries < 5) ? seen->tries : 5);
+}
+
+// ms from now until at, 0 if it's passed
+static uint32_t until(uint32_t now, uint32_t at)
+{
+  return ((int32_t)(at - now) > 0) ? at - now : 0;
+}
+
+uint32_t link_next(link_t link, uint32_t now)
+{
+  seen_t seen;
+  uint32_t next = LINK_KEEPALIVE, at, wait;
+  if(!link) return next;
+
+  if((at = event3_at(link->ev)) && (wait = until(now, at)) < next) next = wait;
+  for(seen = link->pipes; seen; seen = seen->next)
+  {
+    if(seen->synced) wait = until(now, seen->synced + retry_ms(seen));
+    else if(seen->recv && link_ready(link)) wait = until(now, seen->recv + LINK_KEEPALIVE);
+    else continue;
+    if(wait < next) next = wait;
+  }
+
+  return next;
+}
+
+link_t link_process(link_t link, uint32_t now)
+{
+  lob_t event;
+  chan_t chan;
+  channel3_t c3;
+  seen_t seen;
+  uint8_t resend = 0, quiet = 0;
+  if(!link) return LOG("bad args");
+  if(!now) now = platform_ms();
+
+  // everything it flushes can go out together
+  link->corked++;
+  while((event = event3_get(link->ev, now)))
+  {
+    c3 = event->arg; // the channel's own timer
+    if(!(chan = xht_get(link->channels, channel3_uid(c3)))) continue;
+
+    // resends go right out
+    if(channel3_expire(c3) != ENDED)
+    {
+      link_flush(link, c3, NULL);
+      continue;
+    }
+
+    // handler gets the {"err":"timeout"} and then it's gone
+    LOG("channel %s ended, removing",channel3_uid(c3));
+    if(chan->handle) chan->handle(link, c3, chan->arg);
+    chan_free(link, chan);
+  }
+  if(!--link->corked) batch_send(link);
+
+  // unanswered handshakes go out again backing off, answered pipes that went quiet get a fresh one
+  for(seen = link->pipes; seen; seen = seen->next)
+  {
+    if(!seen->synced)
+    {
+      if(seen->recv && now - seen->recv >= LINK_KEEPALIVE) quiet = 1;
+      continue;
+    }
+    if(now - seen->synced < retry_ms(seen)) continue;
+    LOG("resending handshake to %s",seen->pipe->id);
+    if(seen->tries < 0xff) seen->tries++;
+    seen->at = 0;
+    resend = 1;
+  }
+  if(quiet && link_ready(link))
+  {
+    LOG_TRACE("keepalive to %s",link->id->hashname);
+    link_resync(link); // the other side answers a new one
+  }else if(resend && link->x){
+    link_sync(link);
+  }
+
+  return link;
+}
+
+static void chan_walk_size(xht_t h, const char *key, void *val, void *arg)
+{
+  *(uint32_t*)arg += channel3_size(((chan_t)val)->c3);
+}
+
+static void chan_walk_memory(xht_t h, const char *key, void *val, void *arg)
+{
+  *(uint32_t*)arg += sizeof (struct chan_struct) + channel3_memory(((chan_t)val)->c3);
+}
+
+lob_t link_stats(link_t link)
+{
+  if(!link) return LOG("bad args");
+  return mesh_stats_lob(&link->stats);
+}
+
+uint32_t link_queued(link_t link)
+{
+  uint32_t size = 0;
+  if(!link) return 0;
+  xht_walk(link->channels, chan_walk_size, &size);
+  return size;
+}
+
+uint32_t link_memory(link_t link)
+{
+  uint32_t size = 0;
+  if(!link) return 0;
+  xht_walk(link->channels, chan_walk_memory, &size);
+  return size;
+}
+
+link_t link_hold(link_t link)
+{
+  if(!link) return LOG("bad args");
+  if(!link->held++) link->corked++;
+  return link;
+}
+
+link_t link_release(link_t link)
+{
+  chan_t chan;
+  if(!link || !link->held) return LOG("bad args");
+  if(--link->held) return link;
+
+  while((chan = link->deferred))
+  {
+    link->deferred = chan->next;
+    chan->next = NULL;
+    chan->held = 0;
+    if(chan->handle) chan->handle(link, chan->c3, chan->arg);
+    link_flush(link, chan->c3, NULL);
+  }
+  if(!--link->corked) batch_send(link);
+
+  return link;
+}
+
 link_t link_flush(link_t link, channel3_t c3, lob_t inner)
 {
-  if(!link || !c3) return LOG("bad args");
+  link_t ret = link;
+  chan_t chan;
+  uint8_t dup;
+  if(!link || !c3)
+  {
+    lob_free(inner);
+    return LOG("bad args");
+  }
+  link_dirty(link); // sending or not, its timers moved
   
-  if(inner) channel3_send(c3, inner);
-
-  while((inner = channel3_sending(c3)))
+  // a full reliable window drops it, anything already queued still goes out
+  if(inner && channel3_send(c3, inner))
   {
-    link_send(link, exchange3_send(link->x, inner));
+    LOG_WARN("channel backpressure, dropping %s",lob_json(inner));
     lob_free(inner);
+    ret = NULL;
   }
+
+  // stops early when the link's congestion window or pacing says to wait
+  dup = (link->paths == LINK_DUP && (chan = xht_get(link->channels, channel3_uid(c3))) && chan->dup);
+  while((inner = channel3_sending(c3))) inner_queue(link, inner, dup);
+  if(!link->corked) batch_send(link);
   
   // TODO if channel is now ended, remove from link->index
 
-  return link;
+  return ret;
 }
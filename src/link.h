@@ -6,6 +6,15 @@ typedef struct link_struct *link_t;
 
 #include "mesh.h"
 
+// how many recent outers are remembered to drop duplicates
+#ifndef LINK_DEDUPE
+#define LINK_DEDUPE 32
+#endif
+
+// how a link with multiple pipes sends, always the best one, striped across the healthy ones weighted by what each has delivered lately,
+// or the best one with link_dup channels also sent on the runner up (the other side drops the repeats)
+enum link_paths { LINK_BEST, LINK_STRIPE, LINK_DUP };
+
 struct link_struct
 {
   // public link data
@@ -16,17 +25,58 @@ struct link_struct
   uint8_t csid;
   xht_t index, channels;
   char token[33];
+  congest3_t cc; // shared by all reliable channels
+  event3_t ev; // channel timeouts and retransmits
+  uint16_t batch, batch_remote; // largest coalesced inner we'll send and the other side will take, 0 is off
+  uint8_t paths; // enum link_paths, how sends use multiple pipes
+  uint8_t dedupe; // the other side duplicates its sends, drop repeats
+  uint32_t used; // ms of the last channel packet in or out, for idle reaping and eviction
+  uint32_t chans; // open channels, only links without any are evicted
+  struct mesh_stats_struct stats; // just this link's packets
   
   // these are for internal link management only
   struct seen_struct *pipes;
+  lob_t batched, batched_tail; // small inners waiting to go out together, tail only valid when batched
+  uint32_t batched_len;
+  uint8_t batched_dup; // one of them is from a link_dup channel
+  uint8_t corked; // > 0 holds batched ones until uncorked
+  uint8_t held; // > 0 defers channel handlers until link_release
+  struct chan_struct *deferred, *deferred_tail; // channels with packets waiting on their handler
+  link_t next, prev; // the mesh's list of them
+  link_t idle_prev, idle_next; // on the mesh's idle list while it has no channels
+  lob_t due; // its event in mesh->due, arg is the link
+  link_t dirty_next; // on the mesh's dirty list
+  uint8_t dirty;
+  uint32_t dups[LINK_DEDUPE]; // recent outer hashes when deduping
+  uint32_t dups_at;
 };
 
-// these all create or return existing one from the mesh
+// ms a pipe can go unanswered before the link prefers its others
+#ifndef LINK_PIPE_SILENT
+#define LINK_PIPE_SILENT 1000
+#endif
+
+// ms before an unanswered handshake is resent on a pipe, doubling with each try
+#ifndef LINK_RETRY
+#define LINK_RETRY 1000
+#endif
+
+// ms a ready link can go without hearing anything before it sends a keepalive handshake
+#ifndef LINK_KEEPALIVE
+#define LINK_KEEPALIVE 25000
+#endif
+
+// default largest coalesced inner, stays under a typical mtu after encryption
+#ifndef LINK_BATCH
+#define LINK_BATCH 1200
+#endif
+
+// these all create or return existing one from the mesh, NULL when at the mesh_cap limit and no link can be evicted
 link_t link_get(mesh_t mesh, char *hashname);
 link_t link_keys(mesh_t mesh, lob_t keys); // adds in the right key
 link_t link_key(mesh_t mesh, lob_t key); // adds in from the body
 
-// removes from mesh
+// removes from mesh and frees its channels (their handlers aren't called) and pipe state, extensions are told with mesh_unlink first
 void link_free(link_t link);
 
 // load in the key to existing link
@@ -44,9 +94,18 @@ link_t link_handshake(link_t link, lob_t inner, lob_t outer, pipe_t pipe);
 // process a decrypted channel packet
 link_t link_receive(link_t link, lob_t inner, pipe_t pipe);
 
-// try to deliver this packet to the best pipe
+// deliver this packet on the best pipe, healthiest (no new send errors, answered within LINK_PIPE_SILENT) then lowest handshake rtt
 link_t link_send(link_t link, lob_t inner);
 
+// change how multiple pipes are used, LINK_DUP is sent in the handshake so the other side drops the repeats
+link_t link_paths(link_t link, enum link_paths paths);
+
+// a latency-critical channel whose packets go out on the best two pipes while the link is LINK_DUP
+link_t link_dup(link_t link, channel3_t c3, uint8_t dup);
+
+// 1 if this channel outer is a duplicate of a recent one (only checked when the other side is sending LINK_DUP)
+uint8_t link_duplicate(link_t link, lob_t outer);
+
 // make sure current handshake is sent to all pipes
 link_t link_sync(link_t link);
 
@@ -62,7 +121,36 @@ channel3_t link_channel(link_t link, lob_t open);
 // set up internal handler for all incoming packets on this channel
 link_t link_handle(link_t link, channel3_t c3, void (*handle)(link_t link, channel3_t c3, void *arg), void *arg);
 
-// encrpt and send any outgoing packets for this channel, send the inner if given
+// fire any due channel timers, resend unanswered handshakes and send keepalives as of now (0 is platform_ms())
+// ended channels are removed and freed once their handler has seen the err, mesh_process calls this when it's due
+link_t link_process(link_t link, uint32_t now);
+
+// ms from now until link_process has something to do, 0 if it does already (never more than LINK_KEEPALIVE)
+uint32_t link_next(link_t link, uint32_t now);
+
+// its timers may have moved, mesh_process recomputes its deadline on the next call (internal, cheap to repeat)
+void link_dirty(link_t link);
+
+// coalesce small channel packets sent together into one outer up to size bytes (0 is off), only once both sides handshake it
+// the inner is {"batch":count} with each packet framed in the body as a two byte (network order) length and the encoded packet
+link_t link_batch(link_t link, uint16_t size);
+
+// this link's counters as json, see mesh_stats_lob
+lob_t link_stats(link_t link);
+
+// bytes waiting in all of this link's channels, in and out
+uint32_t link_queued(link_t link);
+
+// bytes this link's channels take themselves (structs and rings), not what's queued in them
+uint32_t link_memory(link_t link);
+
+// hold off running channel handlers and flushing while many incoming packets are received together
+link_t link_hold(link_t link);
+
+// each held channel's handler runs once for all its new packets, then everything goes out together
+link_t link_release(link_t link);
+
+// encrpt and send any outgoing packets for this channel, send the inner if given (always taken, NULL if it was dropped for backpressure)
 link_t link_flush(link_t link, channel3_t c3, lob_t inner);
 
 /*
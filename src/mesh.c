@@ -14,10 +14,12 @@ typedef struct on_struct
   
   void (*free)(mesh_t mesh); // relese resources
   void (*link)(link_t link); // when a link is created, and again when exchange is created
+  void (*unlink)(link_t link); // when a link is being freed
   pipe_t (*path)(link_t link, lob_t path); // convert path->pipe
   lob_t (*open)(link_t link, lob_t open); // incoming channel requests
   link_t (*discover)(mesh_t mesh, lob_t discovered, pipe_t pipe); // incoming unknown hashnames
-  
+  char *path_type, *open_type; // only for this type, indexed in the mesh's typed tables
+
   struct on_struct *next;
 } *on_t;
 on_t on_get(mesh_t mesh, char *id);
@@ -29,14 +31,15 @@ mesh_t mesh_new(uint32_t prime)
   mesh_t mesh;
   
   // make sure we've initialized
-  if(e3x_init(NULL)) return LOG("e3x init failed");
+  if(e3x_init(NULL)) return LOG_ERROR("e3x init failed");
 
   if(!(mesh = malloc(sizeof (struct mesh_struct)))) return NULL;
   memset(mesh, 0, sizeof(struct mesh_struct));
   mesh->index = xht_new(prime?prime:MAXPRIME);
-  if(!mesh->index) return mesh_free(mesh);
+  mesh->due = event3_new(prime?prime:MAXPRIME);
+  if(!mesh->index || !mesh->due) return mesh_free(mesh);
   
-  LOG("mesh created version %d.%d.%d",TELEHASH_VERSION_MAJOR,TELEHASH_VERSION_MINOR,TELEHASH_VERSION_PATCH);
+  LOG_INFO("mesh created version %d.%d.%d",TELEHASH_VERSION_MAJOR,TELEHASH_VERSION_MINOR,TELEHASH_VERSION_PATCH);
 
   return mesh;
 }
@@ -46,6 +49,9 @@ mesh_t mesh_free(mesh_t mesh)
   on_t on;
   if(!mesh) return NULL;
 
+  // links go first so extensions can release what they keep for each
+  while(mesh->links) link_free(mesh->links);
+
   // free any triggers first
   while(mesh->on)
   {
@@ -53,12 +59,18 @@ mesh_t mesh_free(mesh_t mesh)
     mesh->on = on->next;
     if(on->free) on->free(mesh);
     free(on->id);
+    free(on->path_type);
+    free(on->open_type);
     free(on);
   }
+  xht_free(mesh->opens);
+  xht_free(mesh->paths);
 
+  event3_free(mesh->due);
   xht_free(mesh->index);
   lob_free(mesh->keys);
   self3_free(mesh->self);
+  hashname_free(mesh->id);
 
   free(mesh);
   return NULL;
@@ -92,7 +104,7 @@ link_t mesh_add(mesh_t mesh, lob_t json, pipe_t pipe)
   uint8_t csid;
 
   if(!mesh || !json) return LOG("bad args");
-  LOG("mesh add %s",lob_json(json));
+  LOG_TRACE("mesh add %s",lob_json(json));
   link = link_get(mesh, lob_get(json,"hashname"));
   keys = lob_get_json(json,"keys");
   paths = lob_get_array(json,"paths");
@@ -124,6 +136,18 @@ on_t on_get(mesh_t mesh, char *id)
   return on;
 }
 
+// indexes the trigger under a new type, or none to make it untyped again
+static void on_type(xht_t *types, char **current, char *type, on_t on)
+{
+  if(*current && xht_get(*types, *current) == on) xht_set(*types, *current, NULL);
+  free(*current);
+  *current = NULL;
+  if(!type) return;
+  if(!*types) *types = xht_new(11);
+  *current = strdup(type);
+  xht_set(*types, *current, on);
+}
+
 void mesh_on_free(mesh_t mesh, char *id, void (*free)(mesh_t mesh))
 {
   on_t on = on_get(mesh, id);
@@ -133,19 +157,32 @@ void mesh_on_free(mesh_t mesh, char *id, void (*free)(mesh_t mesh))
 void mesh_on_path(mesh_t mesh, char *id, pipe_t (*path)(link_t link, lob_t path))
 {
   on_t on = on_get(mesh, id);
-  if(on) on->path = path;
+  if(!on) return;
+  on_type(&mesh->paths, &on->path_type, NULL, on);
+  on->path = path;
+}
+
+void mesh_on_path_type(mesh_t mesh, char *id, char *type, pipe_t (*path)(link_t link, lob_t path))
+{
+  on_t on = on_get(mesh, id);
+  if(!on || !type) return;
+  on_type(&mesh->paths, &on->path_type, type, on);
+  on->path = path;
 }
 
 pipe_t mesh_path(mesh_t mesh, link_t link, lob_t path)
 {
   on_t on;
   pipe_t pipe;
+  char *type;
   if(!mesh || !link || !path) return NULL;
 
+  if(mesh->paths && (type = lob_get(path,"type")) && (on = xht_get(mesh->paths, type)) && on->path && (pipe = on->path(link, path))) return pipe;
+
   for(on = mesh->on; on; on = on->next)
   {
-    if(on->path) pipe = on->path(link, path);
-    if(pipe) return pipe;
+    if(!on->path || on->path_type) continue;
+    if((pipe = on->path(link, path))) return pipe;
   }
   return LOG("no pipe for path %.*s",path->head_len,path->head);
 }
@@ -162,16 +199,44 @@ void mesh_link(mesh_t mesh, link_t link)
   for(on = mesh->on; on; on = on->next) if(on->link) on->link(link);
 }
 
+void mesh_on_unlink(mesh_t mesh, char *id, void (*unlink)(link_t link))
+{
+  on_t on = on_get(mesh, id);
+  if(on) on->unlink = unlink;
+}
+
+void mesh_unlink(mesh_t mesh, link_t link)
+{
+  on_t on;
+  for(on = mesh->on; on; on = on->next) if(on->unlink) on->unlink(link);
+}
+
 void mesh_on_open(mesh_t mesh, char *id, lob_t (*open)(link_t link, lob_t open))
 {
   on_t on = on_get(mesh, id);
-  if(on) on->open = open;
+  if(!on) return;
+  on_type(&mesh->opens, &on->open_type, NULL, on);
+  on->open = open;
+}
+
+void mesh_on_open_type(mesh_t mesh, char *id, char *type, lob_t (*open)(link_t link, lob_t open))
+{
+  on_t on = on_get(mesh, id);
+  if(!on || !type) return;
+  on_type(&mesh->opens, &on->open_type, type, on);
+  on->open = open;
 }
 
 lob_t mesh_open(mesh_t mesh, link_t link, lob_t open)
 {
   on_t on;
-  for(on = mesh->on; open && on; on = on->next) if(on->open) open = on->open(link, open);
+  char *type;
+  if(!mesh || !open) return open;
+
+  // the handler for this type gets it first
+  if(mesh->opens && (type = lob_get(open,"type")) && (on = xht_get(mesh->opens, type)) && on->open && !(open = on->open(link, open))) return NULL;
+
+  for(on = mesh->on; open && on; on = on->next) if(on->open && !on->open_type) open = on->open(link, open);
   return open;
 }
 
@@ -187,21 +252,111 @@ void mesh_discover(mesh_t mesh, lob_t discovered, pipe_t pipe)
   for(on = mesh->on; on; on = on->next) if(on->discover) on->discover(mesh, discovered, pipe);
 }
 
+// counts a failed mesh_receive by its return code, on the link too if it got that far
+static uint8_t dropped(mesh_t mesh, link_t link, uint8_t code)
+{
+  if(mesh) MESH_COUNT(mesh->stats, drops[code], 1);
+  if(link) MESH_COUNT(link->stats, drops[code], 1);
+  return code;
+}
+
+// once a packet is known to be for a link
+static void link_in(link_t link, lob_t outer)
+{
+  MESH_COUNT(link->stats, packets_in, 1);
+  MESH_COUNT(link->stats, bytes_in, lob_len(outer));
+}
+
+// a decrypted handshake, outer->inner are linked and outer is freed with both
+static uint8_t handshake_in(mesh_t mesh, lob_t outer, lob_t inner, pipe_t pipe)
+{
+  lob_t discovered, key;
+  hashname_t from;
+  link_t link;
+  char hex[3], *paths;
+
+  util_hex(outer->head,1,hex);
+
+  // make sure csid is set on the handshake to get the hashname
+  lob_set_raw(inner,hex,"true",4);
+  from = hashname_key(inner);
+  if(!from)
+  {
+    LOG("no hashname in %.*s",inner->head_len,inner->head);
+    lob_free(outer);
+    return dropped(mesh, NULL, 2);
+  }
+  
+  link = xht_get(mesh->index,from->hashname);
+  if(!link)
+  {
+    LOG("no link for hashname %s",from->hashname);
+    // serialize all the new hashname's info into json for the app to access/handle
+    discovered = lob_new();
+    lob_set(discovered,"hashname",from->hashname);
+    // add the key
+    key = lob_new();
+    lob_set_base32(key,hex,inner->body,inner->body_len);
+    lob_set_raw(discovered,"keys",(char*)key->head,key->head_len);
+    lob_free(key);
+    // add the path if one
+    if(pipe && pipe->path)
+    {
+      paths = malloc(pipe->path->head_len+2);
+      sprintf(paths,"[%s]",lob_json(pipe->path));
+      lob_set_raw(discovered,"paths",paths,pipe->path->head_len+2);
+      free(paths);
+    }
+    mesh_discover(mesh, discovered, pipe);
+    hashname_free(from);
+    lob_free(outer);
+    return dropped(mesh, NULL, 3);
+  }
+  hashname_free(from);
+
+  LOG("incoming handshake for link %s",link->id->hashname);
+  link_in(link, outer);
+  if(!link_handshake(link,inner,outer,pipe)) return dropped(mesh, link, 4);
+  MESH_COUNT(mesh->stats, handshakes_in, 1);
+  MESH_COUNT(link->stats, handshakes_in, 1);
+  return 0;
+}
+
+// internal, a handshake a shard already decrypted with this same identity, takes both
+uint8_t mesh_receive_opened(mesh_t mesh, lob_t outer, lob_t inner, pipe_t pipe)
+{
+  if(!mesh || !outer || !inner || !pipe || outer->head_len != 1)
+  {
+    LOG("bad args");
+    lob_free(outer);
+    lob_free(inner);
+    return dropped(mesh, NULL, 1);
+  }
+  MESH_COUNT(mesh->stats, packets_in, 1);
+  MESH_COUNT(mesh->stats, bytes_in, lob_len(outer));
+
+  lob_free(lob_unlink(outer));
+  lob_link(outer,inner);
+  return handshake_in(mesh, outer, inner, pipe);
+}
+
 // processes incoming packet, it will take ownership of p
 uint8_t mesh_receive(mesh_t mesh, lob_t outer, pipe_t pipe)
 {
-  lob_t inner, discovered, key;
-  hashname_t from;
+  lob_t inner;
   link_t link;
-  char hex[33], *paths;
+  char hex[33];
 
   if(!mesh || !outer || !pipe)
   {
     LOG("bad args");
-    return 1;
+    lob_free(outer);
+    return dropped(mesh, NULL, 1);
   }
+  MESH_COUNT(mesh->stats, packets_in, 1);
+  MESH_COUNT(mesh->stats, bytes_in, lob_len(outer));
   
-  LOG("mesh receiving %s to %s via pipe %s",outer->head_len?"handshake":"channel",mesh->id->hashname,pipe->id);
+  LOG_TRACE("mesh receiving %s to %s via pipe %s",outer->head_len?"handshake":"channel",mesh->id->hashname,pipe->id);
 
   // process handshakes
   if(outer->head_len == 1)
@@ -212,52 +367,13 @@ uint8_t mesh_receive(mesh_t mesh, lob_t outer, pipe_t pipe)
     {
       LOG("%s handshake failed %s",hex,e3x_err());
       lob_free(outer);
-      return 2;
+      MESH_COUNT(mesh->stats, decrypt_fails, 1);
+      return dropped(mesh, NULL, 2);
     }
     
     // couple the two together, outer->inner
     lob_link(outer,inner);
-
-    // make sure csid is set on the handshake to get the hashname
-    lob_set_raw(inner,hex,"true",4);
-    from = hashname_key(inner);
-    if(!from)
-    {
-      LOG("no hashname in %.*s",inner->head_len,inner->head);
-      lob_free(outer);
-      return 2;
-      
-    }
-    
-    link = xht_get(mesh->index,from->hashname);
-    if(!link)
-    {
-      LOG("no link for hashname %s",from->hashname);
-      // serialize all the new hashname's info into json for the app to access/handle
-      discovered = lob_new();
-      lob_set(discovered,"hashname",from->hashname);
-      // add the key
-      key = lob_new();
-      lob_set_base32(key,hex,inner->body,inner->body_len);
-      lob_set_raw(discovered,"keys",(char*)key->head,key->head_len);
-      lob_free(key);
-      // add the path if one
-      if(pipe && pipe->path)
-      {
-        paths = malloc(pipe->path->head_len+2);
-        sprintf(paths,"[%s]",lob_json(pipe->path));
-        lob_set_raw(discovered,"paths",paths,pipe->path->head_len+2);
-        free(paths);
-      }
-      mesh_discover(mesh, discovered, pipe);
-      hashname_free(from);
-      lob_free(outer);
-      return 3;
-    }
-    hashname_free(from);
-
-    LOG("incoming handshake for link %s",link->id->hashname);
-    return link_handshake(link,inner,outer,pipe) ? 0 : 4;
+    return handshake_in(mesh, outer, inner, pipe);
   }
 
   // handle channel packets
@@ -266,7 +382,8 @@ uint8_t mesh_receive(mesh_t mesh, lob_t outer, pipe_t pipe)
     if(outer->body_len < 16)
     {
       LOG("packet too small %d",outer->body_len);
-      return 5;
+      lob_free(outer);
+      return dropped(mesh, NULL, 5);
     }
     util_hex(outer->body, 16, hex);
     link = xht_get(mesh->index, hex);
@@ -274,26 +391,275 @@ uint8_t mesh_receive(mesh_t mesh, lob_t outer, pipe_t pipe)
     {
       LOG("dropping, no link for token %s",hex);
       lob_free(outer);
-      return 6;
+      return dropped(mesh, NULL, 6);
+    }
+    link_in(link, outer);
+
+    // the same outer may come in on more than one pipe
+    if(link_duplicate(link, outer))
+    {
+      LOG("dropping duplicate from %s",link->id->hashname);
+      lob_free(outer);
+      MESH_COUNT(mesh->stats, duplicates, 1);
+      MESH_COUNT(link->stats, duplicates, 1);
+      return 0;
     }
 
+    // the inner reuses the outer's buffer
     inner = exchange3_receive(link->x, outer);
     if(!inner)
     {
       LOG("channel decryption fail for link %s %s",link->id->hashname,e3x_err());
-      lob_free(outer);
-      return 7;
+      MESH_COUNT(mesh->stats, decrypt_fails, 1);
+      MESH_COUNT(link->stats, decrypt_fails, 1);
+      return dropped(mesh, link, 7);
     }
     
-    LOG("channel packet %d bytes from %s",lob_len(inner),link->id->hashname);
-    return link_receive(link,inner,pipe) ? 0 : 8;
+    LOG_TRACE("channel packet %d bytes from %s",lob_len(inner),link->id->hashname);
+    return link_receive(link,inner,pipe) ? 0 : dropped(mesh, link, 8);
     
   }
   
   LOG("dropping unknown outer packet with header %d %.*s",outer->head_len,outer->head_len,outer->head);
   lob_free(outer);
 
-  return 10;
+  return dropped(mesh, NULL, 10);
+}
+
+// hands each decrypted inner to its link, in order
+static uint32_t batch_deliver(lob_t inners[], link_t links[], pipe_t pipes[], uint32_t from, uint32_t to)
+{
+  uint32_t ok = 0;
+  for(; from < to; from++)
+  {
+    if(!inners[from]) continue;
+    if(link_receive(links[from], inners[from], pipes[from])) ok++;
+    else dropped(links[from]->mesh, links[from], 8);
+    inners[from] = NULL;
+  }
+  return ok;
+}
+
+uint32_t mesh_receive_batch(mesh_t mesh, lob_t packets[], pipe_t pipes[], uint32_t count)
+{
+  link_t held[MESH_BATCH], links[MESH_BATCH], link;
+  lob_t inners[MESH_BATCH], outer;
+  uint8_t tokens[MESH_BATCH][16];
+  uint32_t at, len, i, j, holds, done, ok = 0;
+  char hex[33];
+
+  if(!mesh || !packets || !pipes)
+  {
+    for(i = 0; packets && i < count; i++) lob_free(packets[i]);
+    if(mesh) MESH_COUNT(mesh->stats, drops[1], count);
+    LOG("bad args");
+    return 0;
+  }
+
+  for(at = 0; at < count; at += len)
+  {
+    len = count - at;
+    if(len > MESH_BATCH) len = MESH_BATCH;
+    holds = done = 0;
+
+    // each link is looked up once and everything for it is decrypted back to back
+    for(i = 0; i < len; i++)
+    {
+      inners[i] = NULL;
+      outer = packets[at+i];
+
+      // handshakes may change a link's session, so everything before one is delivered first
+      if(!outer || !pipes[at+i] || outer->head_len != 0 || outer->body_len < 16)
+      {
+        ok += batch_deliver(inners, links, pipes+at, done, i);
+        done = i + 1;
+        if(mesh_receive(mesh, outer, pipes[at+i]) == 0) ok++;
+        continue;
+      }
+
+      MESH_COUNT(mesh->stats, packets_in, 1);
+      MESH_COUNT(mesh->stats, bytes_in, lob_len(outer));
+      for(j = 0; j < holds && memcmp(tokens[j], outer->body, 16); j++);
+      if(j == holds)
+      {
+        util_hex(outer->body, 16, hex);
+        if(!(link = xht_get(mesh->index, hex)))
+        {
+          LOG("dropping, no link for token %s",hex);
+          lob_free(outer);
+          dropped(mesh, NULL, 6);
+          continue;
+        }
+        memcpy(tokens[holds], outer->body, 16);
+        held[holds++] = link_hold(link);
+      }
+      links[i] = held[j];
+      link_in(links[i], outer);
+
+      if(link_duplicate(links[i], outer))
+      {
+        lob_free(outer);
+        MESH_COUNT(mesh->stats, duplicates, 1);
+        MESH_COUNT(links[i]->stats, duplicates, 1);
+        ok++;
+        continue;
+      }
+      if(!(inners[i] = exchange3_receive(links[i]->x, outer)))
+      {
+        LOG("channel decryption fail for link %s %s",links[i]->id->hashname,e3x_err());
+        MESH_COUNT(mesh->stats, decrypt_fails, 1);
+        MESH_COUNT(links[i]->stats, decrypt_fails, 1);
+        dropped(mesh, links[i], 7);
+      }
+    }
+    ok += batch_deliver(inners, links, pipes+at, done, len);
+
+    // channel handlers run once per batch and replies go out together
+    for(j = 0; j < holds; j++) link_release(held[j]);
+  }
+
+  return ok;
+}
+
+mesh_stats_t mesh_stats_copy(mesh_stats_t from, mesh_stats_t into)
+{
+  uint32_t *src, *dst, i;
+  if(!from || !into) return LOG("bad args");
+  src = (uint32_t*)from;
+  dst = (uint32_t*)into;
+  for(i = 0; i < sizeof (struct mesh_stats_struct) / sizeof (uint32_t); i++)
+  {
+#ifdef __GNUC__
+    dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+#else
+    dst[i] = src[i];
+#endif
+  }
+  return into;
+}
+
+static char *drop_names[MESH_DROPS] = {NULL, "bad_args", "handshake", "unknown_hashname", "rejected", "too_small", "unknown_token", "decrypt", "channel", NULL, "unknown_header"};
+
+lob_t mesh_stats_lob(mesh_stats_t stats)
+{
+  struct mesh_stats_struct copy;
+  lob_t json;
+  char key[32];
+  uint32_t i;
+  if(!mesh_stats_copy(stats, &copy)) return NULL;
+
+  // counters wrap, so they're reported as unsigned
+  json = lob_new();
+  lob_set_uint(json,"packets_in",copy.packets_in);
+  lob_set_uint(json,"bytes_in",copy.bytes_in);
+  lob_set_uint(json,"packets_out",copy.packets_out);
+  lob_set_uint(json,"bytes_out",copy.bytes_out);
+  lob_set_uint(json,"handshakes_in",copy.handshakes_in);
+  lob_set_uint(json,"handshakes_out",copy.handshakes_out);
+  lob_set_uint(json,"opens",copy.opens);
+  lob_set_uint(json,"opens_unhandled",copy.opens_unhandled);
+  lob_set_uint(json,"decrypt_fails",copy.decrypt_fails);
+  lob_set_uint(json,"duplicates",copy.duplicates);
+  for(i = 0; i < MESH_DROPS; i++)
+  {
+    if(!drop_names[i]) continue;
+    snprintf(key,sizeof(key),"dropped_%s",drop_names[i]);
+    lob_set_uint(json,key,copy.drops[i]);
+  }
+  return json;
+}
+
+lob_t mesh_stats(mesh_t mesh)
+{
+  if(!mesh) return LOG("bad args");
+  return mesh_stats_lob(&mesh->stats);
+}
+
+lob_t mesh_stats_memory(mesh_t mesh)
+{
+  lob_t stats, all;
+  link_t link;
+  uint32_t exchanges = 0, channels = 0, bytes = 0, queued = 0;
+  if(!mesh) return LOG("bad args");
+
+  for(link = mesh->links; link; link = link->next)
+  {
+    if(link->x) exchanges++;
+    channels += link->chans;
+    bytes += link_memory(link);
+    queued += link_queued(link);
+  }
+
+  stats = lob_new();
+  lob_set_int(stats,"links",(int)mesh->links_count);
+  lob_set_int(stats,"links_bytes",(int)(mesh->links_count * sizeof (struct link_struct)));
+  lob_set_int(stats,"exchanges",(int)exchanges);
+  lob_set_int(stats,"channels",(int)channels);
+  lob_set_int(stats,"channels_bytes",(int)bytes);
+  lob_set_int(stats,"channels_queued",(int)queued);
+  all = NULL;
+#ifdef MEMSTAT
+  all = memstat_stats(NULL);
+#endif
+  if(all) lob_set_raw(stats,"process",(char*)all->head,all->head_len);
+  lob_free(all);
+  return stats;
+}
+
+mesh_t mesh_cap(mesh_t mesh, uint32_t max, uint32_t idle)
+{
+  if(!mesh) return LOG("bad args");
+  mesh->links_max = max;
+  mesh->links_idle = idle;
+  return mesh;
+}
+
+// reschedules every dirty link at its next deadline, at least min ms out
+static void mesh_schedule(mesh_t mesh, uint32_t now, uint32_t min)
+{
+  link_t link;
+  uint32_t at;
+  while((link = mesh->dirty))
+  {
+    mesh->dirty = link->dirty_next;
+    link->dirty = 0;
+    if(!link->due) continue;
+    if((at = link_next(link, now)) < min) at = min;
+    at += now;
+    event3_set(mesh->due, link->due, link->id->hashname, at ? at : 1);
+  }
+}
+
+uint32_t mesh_process(mesh_t mesh, uint32_t now)
+{
+  link_t link;
+  lob_t due;
+  uint32_t wait = LINK_KEEPALIVE, until, at;
+  if(!mesh) return wait;
+  if(!now) now = platform_ms();
+
+  // idle ones without channels are reaped oldest first from the tail of the idle list
+  while(mesh->links_idle && (link = mesh->idle_tail) && !link->held && (int32_t)(now - link->used) >= (int32_t)mesh->links_idle)
+  {
+    LOG("reaping idle link %s",link->id->hashname);
+    link_free(link);
+  }
+  if(mesh->links_idle && (link = mesh->idle_tail) && (until = link->used + mesh->links_idle - now) < wait) wait = until;
+
+  // only links that changed or are due are looked at, any freed along the way are unscheduled
+  mesh_schedule(mesh, now, 0);
+  while((due = event3_get(mesh->due, now)))
+  {
+    link = due->arg;
+    link_process(link, now);
+    link_dirty(link);
+  }
+
+  // anything processed here waits for the next call even if it still looks due (the caller's clock may be ahead)
+  mesh_schedule(mesh, now, 1);
+  if((at = event3_at(mesh->due)) && (until = ((int32_t)(at - now) > 0) ? at - now : 0) < wait) wait = until;
+
+  return wait;
 }
 
 /*
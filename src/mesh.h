@@ -5,6 +5,27 @@ typedef struct mesh_struct *mesh_t;
 
 #include "e3x/e3x.h"
 #include "lib/lib.h"
+
+// how many mesh_receive return codes there are, each failure has its own drop counter
+#define MESH_DROPS 11
+
+// packet counters every mesh and link keeps, they only ever go up (wrapping) and are updated lock-free so any thread can read them
+typedef struct mesh_stats_struct
+{
+  uint32_t packets_in, bytes_in, packets_out, bytes_out;
+  uint32_t handshakes_in, handshakes_out; // accepted and sent
+  uint32_t opens, opens_unhandled; // incoming channel opens
+  uint32_t decrypt_fails; // handshakes or channel packets that didn't decrypt
+  uint32_t duplicates; // repeats dropped from a LINK_DUP sender
+  uint32_t drops[MESH_DROPS]; // by mesh_receive's return code
+} *mesh_stats_t;
+
+#ifdef __GNUC__
+#define MESH_COUNT(stats,field,n) __atomic_add_fetch(&(stats).field, (uint32_t)(n), __ATOMIC_RELAXED)
+#else
+#define MESH_COUNT(stats,field,n) ((stats).field += (uint32_t)(n))
+#endif
+
 #include "pipe.h"
 #include "link.h"
 #include "links.h"
@@ -16,7 +37,14 @@ struct mesh_struct
   lob_t keys;
   self3_t self;
   xht_t index;
+  link_t links; // all of them, through link->next
+  event3_t due; // internal, when each link next has something for link_process, by hashname
+  link_t dirty; // internal, links whose timers may have moved since mesh_process last looked, through link->dirty_next
+  link_t idle, idle_tail; // internal, links without channels through link->idle_next, most recently used first
+  uint32_t links_count, links_max, links_idle; // see mesh_cap
   void *on; // internal list of triggers
+  xht_t opens, paths; // typed triggers by their type
+  struct mesh_stats_struct stats;
 };
 
 // pass in a prime for the main index of hashnames+links+channels, 0 to use compiled default
@@ -32,9 +60,43 @@ lob_t mesh_generate(mesh_t mesh);
 // creates a link from the json format of {"hashname":"...","keys":{},"paths":[]}, optional direct pipe too
 link_t mesh_add(mesh_t mesh, lob_t json, pipe_t pipe);
 
+// keep at most max links (0 is unlimited), the least recently used one without channels is freed to make room for a new one
+// links without channels that have had no channel packets for idle ms are freed by mesh_process (0 never)
+mesh_t mesh_cap(mesh_t mesh, uint32_t max, uint32_t idle);
+
 // processes incoming packet, it will take ownership of packet
 uint8_t mesh_receive(mesh_t mesh, lob_t packet, pipe_t pipe);
 
+// internal, for unix/shard.c handing over a handshake it decrypted with this mesh's own identity, takes both
+uint8_t mesh_receive_opened(mesh_t mesh, lob_t outer, lob_t inner, pipe_t pipe);
+
+// most packets mesh_receive_batch resolves and decrypts together, larger batches are done in chunks of this
+#ifndef MESH_BATCH
+#define MESH_BATCH 64
+#endif
+
+// processes many incoming packets at once (takes them all), each link is looked up once and decrypts back to back
+// channel handlers run once per link channel after the whole batch, returns how many were handled without error
+uint32_t mesh_receive_batch(mesh_t mesh, lob_t packets[], pipe_t pipes[], uint32_t count);
+
+// a copy of the counters that's safe to take while another thread is updating them
+mesh_stats_t mesh_stats_copy(mesh_stats_t from, mesh_stats_t into);
+
+// counters as json, each field by name and dropped_* for every mesh_receive failure (bad_args, handshake, unknown_hashname, rejected, too_small, unknown_token, decrypt, channel, unknown_header)
+lob_t mesh_stats_lob(mesh_stats_t stats);
+
+// this mesh's counters as json
+lob_t mesh_stats(mesh_t mesh);
+
+// memory this mesh is using, links/links_bytes, exchanges, channels/channels_bytes (structs and rings) and channels_queued (packet bytes in them)
+// when built with -DMEMSTAT also a "process" object of the memstat_stats totals for all meshes
+lob_t mesh_stats_memory(mesh_t mesh);
+
+// runs any due link timers, handshake retries and keepalives as of now (platform_ms() if 0)
+// returns ms until it needs to be called again, so hosts can sleep that long or until a packet comes in
+// only links that are due or have changed since the last call are visited, so it's cheap to call often with many links
+uint32_t mesh_process(mesh_t mesh, uint32_t now);
+
 // callback when the mesh is free'd
 void mesh_on_free(mesh_t mesh, char *id, void (*free)(mesh_t mesh));
 
@@ -42,6 +104,9 @@ void mesh_on_free(mesh_t mesh, char *id, void (*free)(mesh_t mesh));
 void mesh_on_path(mesh_t mesh, char *id, pipe_t (*path)(link_t link, lob_t path));
 pipe_t mesh_path(mesh_t mesh, link_t link, lob_t path);
 
+// only called for paths of this type, found with one lookup before trying any untyped ones
+void mesh_on_path_type(mesh_t mesh, char *id, char *type, pipe_t (*path)(link_t link, lob_t path));
+
 // callback when an unknown hashname is discovered
 void mesh_on_discover(mesh_t mesh, char *id, link_t (*discover)(mesh_t mesh, lob_t discovered, pipe_t pipe));
 void mesh_discover(mesh_t mesh, lob_t discovered, pipe_t pipe);
@@ -50,10 +115,17 @@ void mesh_discover(mesh_t mesh, lob_t discovered, pipe_t pipe);
 void mesh_on_link(mesh_t mesh, char *id, void (*link)(link_t link));
 void mesh_link(mesh_t mesh, link_t link);
 
+// callback when a link is about to be freed, to release anything kept for it
+void mesh_on_unlink(mesh_t mesh, char *id, void (*unlink)(link_t link));
+void mesh_unlink(mesh_t mesh, link_t link);
+
 // callback when a new incoming channel is requested
 void mesh_on_open(mesh_t mesh, char *id, lob_t (*open)(link_t link, lob_t open));
 lob_t mesh_open(mesh_t mesh, link_t link, lob_t open);
 
+// only called for opens of this channel type, found with one lookup before trying any untyped ones
+void mesh_on_open_type(mesh_t mesh, char *id, char *type, lob_t (*open)(link_t link, lob_t open));
+
 /*
 
 // add hashname as a seed, will automatically trigger a query to it
@@ -73,12 +73,12 @@ pipe_t tcp4_flush(pipe_t pipe)
     while((len = write(to->client, chunks_write(to->chunks), chunks_len(to->chunks))) > 0)
     {
       chunks_written(to->chunks, len);
-      LOG("wrote %d bytes to %s",len,pipe->id);
+      LOG_TRACE("wrote %d bytes to %s",len,pipe->id);
     }
   }
   while((len = read(to->client, buf, 256)) > 0)
   {
-    LOG("reading %d bytes from %s",len,pipe->id);
+    LOG_TRACE("reading %d bytes from %s",len,pipe->id);
     chunks_read(to->chunks, buf, len);
   }
 
@@ -87,7 +87,8 @@ pipe_t tcp4_flush(pipe_t pipe)
 
   if(len < 0 && errno != EWOULDBLOCK && errno != EINPROGRESS)
   {
-    LOG("socket error to %s: %s",pipe->id,strerror(errno));
+    LOG_WARN("socket error to %s: %s",pipe->id,strerror(errno));
+    MESH_COUNT(*pipe, errs, 1);
     close(to->client);
     to->client = 0;
   }
@@ -100,8 +101,9 @@ void tcp4_send(pipe_t pipe, lob_t packet, link_t link)
 {
   pipe_tcp4_t to = tcp4_to(pipe);
   if(!to || !packet || !link) return;
-  LOG("tcp4 to %s",link->id->hashname);
+  LOG_TRACE("tcp4 to %s",link->id->hashname);
 
+  if(pipe->cloaked) chunks_cloak(to->chunks, 1);
   chunks_send(to->chunks, packet);
   tcp4_flush(pipe);
 }
@@ -113,7 +115,7 @@ pipe_t tcp4_free(pipe_t pipe)
   to = (pipe_tcp4_t)pipe->arg;
   if(!to) return LOG("internal error, invalid pipe, leaking it");
 
-  LOG("removing %d");
+  LOG("removing %s",pipe->id);
   xht_set(to->net->pipes,pipe->id,NULL);
   pipe_free(pipe);
   if(to->client > 0) close(to->client);
@@ -163,7 +165,6 @@ pipe_t tcp4_path(link_t link, lob_t path)
   // just sanity check the path first
   if(!link || !path) return NULL;
   if(!(net = xht_get(link->mesh->index, MUID))) return NULL;
-  if(util_cmp("tcp4",lob_get(path,"type"))) return NULL;
   if(!(ip = lob_get(path,"ip"))) return LOG("missing ip");
   if((port = lob_get_int(path,"port")) <= 0) return LOG("missing port");
   return tcp4_pipe(net, ip, port);
@@ -181,15 +182,15 @@ net_tcp4_t net_tcp4_new(mesh_t mesh, lob_t options)
   if(!pipes) pipes = 11; // hashtable for active pipes
 
   // create a udp socket
-  if((sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP) ) < 0 ) return LOG("failed to create socket %s",strerror(errno));
+  if((sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP) ) < 0 ) return LOG_ERROR("failed to create socket %s",strerror(errno));
 
   memset(&sa,0,sizeof(sa));
   sa.sin_family = AF_INET;
   sa.sin_port = htons(port);
   sa.sin_addr.s_addr = htonl(INADDR_ANY);
-  if(bind(sock, (struct sockaddr*)&sa, size) < 0) return LOG("bind failed %s",strerror(errno));
+  if(bind(sock, (struct sockaddr*)&sa, size) < 0) return LOG_ERROR("bind failed %s",strerror(errno));
   getsockname(sock, (struct sockaddr*)&sa, &size);
-  if(listen(sock, 10) < 0) return LOG("listen failed %s",strerror(errno));
+  if(listen(sock, 10) < 0) return LOG_ERROR("listen failed %s",strerror(errno));
   setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const void *)&opt , sizeof(int));
   fcntl(sock, F_SETFL, O_NONBLOCK);
 
@@ -202,7 +203,7 @@ net_tcp4_t net_tcp4_new(mesh_t mesh, lob_t options)
   // connect us to this mesh
   net->mesh = mesh;
   xht_set(mesh->index, MUID, net);
-  mesh_on_path(mesh, MUID, tcp4_path);
+  mesh_on_path_type(mesh, MUID, "tcp4", tcp4_path);
   
   // convenience
   net->path = lob_new();
@@ -1,3 +1,6 @@
+#ifdef __linux__
+#define _GNU_SOURCE // recvmmsg
+#endif
 #include <errno.h>
 #include <string.h>
 #include <unistd.h>
@@ -16,11 +19,31 @@ typedef struct pipe_udp4_struct
 void udp4_send(pipe_t pipe, lob_t packet, link_t link)
 {
   pipe_udp4_t to = (pipe_udp4_t)pipe->arg;
+  uint8_t buf[2048], *raw;
+  uint32_t len;
 
   if(!to || !packet || !link) return;
-  LOG("udp4 to %s",link->id->hashname);
+  LOG_TRACE("udp4 to %s",link->id->hashname);
 
-  if(sendto(to->net->server, lob_raw(packet), lob_len(packet), 0, (struct sockaddr *)&(to->sa), sizeof(struct sockaddr_in)) < 0) LOG("sendto failed: %s",strerror(errno));
+  raw = lob_raw(packet);
+  len = lob_len(packet);
+  if(PIPE_GET(pipe, cloaked))
+  {
+    if(len+8 > sizeof(buf))
+    {
+      LOG("packet too large to cloak: %d",len);
+      MESH_COUNT(*pipe, errs, 1);
+      return;
+    }
+    len = lob_cloak_into(packet, 1, buf);
+    raw = buf;
+  }
+
+  if(sendto(to->net->server, raw, len, 0, (struct sockaddr *)&(to->sa), sizeof(struct sockaddr_in)) < 0)
+  {
+    LOG_WARN("sendto failed: %s",strerror(errno));
+    MESH_COUNT(*pipe, errs, 1);
+  }
 }
 
 // internal, get or create a pipe
@@ -68,7 +91,6 @@ pipe_t udp4_path(link_t link, lob_t path)
   // just sanity check the path first
   if(!link || !path) return NULL;
   if(!(net = xht_get(link->mesh->index, MUID))) return NULL;
-  if(util_cmp("udp4",lob_get(path,"type"))) return NULL;
   if(!(ip = lob_get(path,"ip"))) return LOG("missing ip");
   if((port = lob_get_int(path,"port")) <= 0) return LOG("missing port");
   
@@ -87,13 +109,13 @@ net_udp4_t net_udp4_new(mesh_t mesh, lob_t options)
   if(!pipes) pipes = 11; // hashtable for active pipes
 
   // create a udp socket
-  if((sock = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP) ) < 0 ) return LOG("failed to create socket %s",strerror(errno));
+  if((sock = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP) ) < 0 ) return LOG_ERROR("failed to create socket %s",strerror(errno));
 
   memset(&sa,0,sizeof(sa));
   sa.sin_family = AF_INET;
   sa.sin_port = htons(port);
   sa.sin_addr.s_addr = htonl(INADDR_ANY);
-  if (bind (sock, (struct sockaddr*)&sa, size) < 0) return LOG("bind failed %s",strerror(errno));
+  if (bind (sock, (struct sockaddr*)&sa, size) < 0) return LOG_ERROR("bind failed %s",strerror(errno));
   getsockname(sock, (struct sockaddr*)&sa, &size);
 
   if(!(net = malloc(sizeof (struct net_udp4_struct)))) return LOG("OOM");
@@ -104,8 +126,11 @@ net_udp4_t net_udp4_new(mesh_t mesh, lob_t options)
 
   // connect us to this mesh
   net->mesh = mesh;
-  xht_set(mesh->index, MUID, net);
-  mesh_on_path(mesh, MUID, udp4_path);
+  if(mesh)
+  {
+    xht_set(mesh->index, MUID, net);
+    mesh_on_path_type(mesh, MUID, "udp4", udp4_path);
+  }
   
   // convenience
   net->path = lob_new();
@@ -126,6 +151,81 @@ void net_udp4_free(net_udp4_t net)
   return;
 }
 
+net_udp4_t net_udp4_deliver(net_udp4_t net, uint8_t (*deliver)(void *arg, lob_t packet, pipe_t pipe), void *arg)
+{
+  if(!net) return LOG("bad args");
+  net->deliver = deliver;
+  net->deliver_arg = arg;
+  return net;
+}
+
+// decloak and find the pipe for one datagram
+static lob_t udp4_packet(net_udp4_t net, unsigned char *buf, int len, struct sockaddr_in *sa, pipe_t *pipe)
+{
+  uint8_t cloaked;
+  lob_t packet;
+
+  // cloaked packets are decloaked in place in buf
+  cloaked = buf[0] ? 1 : 0;
+  packet = lob_decloak(buf,len);
+  if(!packet)
+  {
+    LOG("parse error from %s on %d bytes",inet_ntoa(sa->sin_addr),len);
+    return NULL;
+  }
+
+  // create the id and look for existing pipe
+  *pipe = udp4_pipe(net, inet_ntoa(sa->sin_addr), ntohs(sa->sin_port));
+  if(*pipe) PIPE_SET(*pipe, cloaked, cloaked); // reply the same way
+  return packet;
+}
+
+#ifdef __linux__
+
+// waits for one and then takes as many as are already queued in one call
+net_udp4_t net_udp4_receive(net_udp4_t net)
+{
+  unsigned char bufs[NET_UDP4_BATCH][2048];
+  struct sockaddr_in sas[NET_UDP4_BATCH];
+  struct iovec iovs[NET_UDP4_BATCH];
+  struct mmsghdr msgs[NET_UDP4_BATCH];
+  lob_t packets[NET_UDP4_BATCH];
+  pipe_t pipes[NET_UDP4_BATCH];
+  int count, i;
+  uint32_t at = 0;
+
+  if(!net) return LOG("bad args");
+
+  memset(msgs,0,sizeof(msgs));
+  for(i = 0; i < NET_UDP4_BATCH; i++)
+  {
+    iovs[i].iov_base = bufs[i];
+    iovs[i].iov_len = sizeof(bufs[i]);
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    msgs[i].msg_hdr.msg_name = &sas[i];
+    msgs[i].msg_hdr.msg_namelen = sizeof(sas[i]);
+  }
+  count = recvmmsg(net->server, msgs, NET_UDP4_BATCH, MSG_WAITFORONE, NULL);
+
+  // a timeout or a signal handler running isn't an error, the caller just loops again
+  if(count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return net;
+  if(count <= 0) return LOG_WARN("recvmmsg error %s",strerror(errno));
+
+  for(i = 0; i < count; i++)
+  {
+    if(!msgs[i].msg_len) continue;
+    if(!(packets[at] = udp4_packet(net, bufs[i], (int)msgs[i].msg_len, &sas[i], &pipes[at]))) continue;
+    if(net->deliver) net->deliver(net->deliver_arg, packets[at], pipes[at]);
+    else at++;
+  }
+  if(at) mesh_receive_batch(net->mesh, packets, pipes, at);
+
+  return net;
+}
+
+#else
+
 net_udp4_t net_udp4_receive(net_udp4_t net)
 {
   unsigned char buf[2048];
@@ -140,19 +240,15 @@ net_udp4_t net_udp4_receive(net_udp4_t net)
   memset(&sa,0,salen);
   len = recvfrom(net->server, buf, sizeof(buf), 0, (struct sockaddr *)&sa, (socklen_t *)&salen);
 
-  if(len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return net;
-  if(len <= 0) return LOG("recvfrom error %s",strerror(errno));
+  // a timeout or a signal handler running isn't an error, the caller just loops again
+  if(len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return net;
+  if(len <= 0) return LOG_WARN("recvfrom error %s",strerror(errno));
 
-  packet = lob_parse(buf,len);
-  if(!packet)
-  {
-    LOG("parse error from %s on %d bytes",inet_ntoa(sa.sin_addr),len);
-    return net;
-  }
-
-  // create the id and look for existing pipe
-  pipe = udp4_pipe(net, inet_ntoa(sa.sin_addr), ntohs(sa.sin_port));
-  mesh_receive(net->mesh, packet, pipe);
+  if(!(packet = udp4_packet(net, buf, len, &sa, &pipe))) return net;
+  if(net->deliver) net->deliver(net->deliver_arg, packet, pipe);
+  else mesh_receive(net->mesh, packet, pipe);
   
   return net;
 }
+
+#endif
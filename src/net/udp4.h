@@ -8,6 +8,11 @@
 
 #include "mesh.h"
 
+// most datagrams taken per receive (where recvmmsg is available)
+#ifndef NET_UDP4_BATCH
+#define NET_UDP4_BATCH 32
+#endif
+
 // overall server
 typedef struct net_udp4_struct
 {
@@ -16,13 +21,19 @@ typedef struct net_udp4_struct
   mesh_t mesh;
   xht_t pipes;
   lob_t path; // to us
+  uint8_t (*deliver)(void *arg, lob_t packet, pipe_t pipe);
+  void *deliver_arg;
 } *net_udp4_t;
 
-// create a new listening udp server
+// create a new listening udp server, mesh may be NULL when packets only go to a deliver hook
 net_udp4_t net_udp4_new(mesh_t mesh, lob_t options);
 void net_udp4_free(net_udp4_t net);
 
-// receive a packet into this mesh
+// hand every received packet to deliver (which takes it) instead of the mesh, e.g. shards_deliver to spread them over unix/shard.c's threads
+// without a mesh no udp4 path type is registered, so pipes are only ever created by net_udp4_receive's thread and links use the ones they hear from
+net_udp4_t net_udp4_deliver(net_udp4_t net, uint8_t (*deliver)(void *arg, lob_t packet, pipe_t pipe), void *arg);
+
+// receive waiting packets into this mesh (or the deliver hook), blocks for the first unless the socket is non-blocking
 net_udp4_t net_udp4_receive(net_udp4_t net);
 
 #endif
\ No newline at end of file
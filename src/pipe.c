@@ -13,6 +13,7 @@ pipe_t pipe_new(char *type)
 
   if(!(p = malloc(sizeof (struct pipe_struct)))) return NULL;
   memset(p,0,sizeof (struct pipe_struct));
+  MEMSTAT_ADD(MEMSTAT_PIPE, 1, sizeof (struct pipe_struct));
   p->type = strdup(type);
   return p;
 }
@@ -23,6 +24,7 @@ pipe_t pipe_free(pipe_t p)
   if(p->id) free(p->id);
   if(p->path) lob_free(p->path);
   if(p->notify) LOG("pipe free'd leaking notifications");
+  MEMSTAT_ADD(MEMSTAT_PIPE, -1, -(int32_t)sizeof (struct pipe_struct));
   free(p);
   return NULL;
 }
@@ -12,12 +12,22 @@ struct pipe_struct
   char *type;
   char *id;
   uint8_t cloaked, local;
+  uint32_t errs; // transports count send failures here (MESH_COUNT), links steer away from pipes with new ones
   lob_t path;
   lob_t notify; // who to signal for pipe events
   void *arg; // for use by app/network transport
   void (*send)(pipe_t pipe, lob_t packet, link_t link); // deliver this packet via this pipe
 };
 
+// cloaked and errs may be set on a transport's thread while a link reads them on another
+#ifdef __GNUC__
+#define PIPE_GET(pipe,field) __atomic_load_n(&(pipe)->field, __ATOMIC_RELAXED)
+#define PIPE_SET(pipe,field,v) __atomic_store_n(&(pipe)->field, (v), __ATOMIC_RELAXED)
+#else
+#define PIPE_GET(pipe,field) ((pipe)->field)
+#define PIPE_SET(pipe,field,v) ((pipe)->field = (v))
+#endif
+
 pipe_t pipe_new(char *type);
 pipe_t pipe_free(pipe_t p);
 
@@ -4,23 +4,81 @@
 // returns a number that increments in seconds for comparison (epoch or just since boot)
 unsigned long platform_seconds();
 
+// monotonic (never jumps with the wall clock) milliseconds for timers, rtt and pacing, may wrap
+unsigned long platform_ms();
+
+// same clock in microseconds, may wrap
+unsigned long platform_us();
+
 unsigned short platform_short(unsigned short x);
 
 // use the platform's best RNG
 void platform_random_init(void);
 long platform_random(void);
 
-// -1 toggles debug, 0 disable, 1 enable
+// log levels, LOG() is LOG_LEVEL_DEBUG
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+#define LOG_LEVEL_TRACE 5
+
+// anything above this is compiled out, debug builds keep everything and others stop at info
+#ifndef LOG_LEVEL
+#ifdef NOLOG
+#define LOG_LEVEL 0
+#elif defined(DEBUG)
+#define LOG_LEVEL LOG_LEVEL_TRACE
+#else
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+#endif
+
+// -1 toggles debug, 0 disable, 1 enable (up to debug)
 void platform_logging(int enabled);
 
+// sets the runtime level (0 for none), returns the previous one
+int platform_log_level(int level);
+
+// current runtime level, only read by the macros below
+extern int _logging;
+
 // returns NULL for convenient return logging
 void *platform_log(const char *file, int line, const char *function, const char * format, ...);
 
+// levels above LOG_LEVEL are just NULL, the runtime check comes first so a skipped message never evaluates its arguments
 #ifdef NOLOG
-#define LOG(...) NULL
+#define LOG_AT(level, ...) NULL
+#else
+#define LOG_AT(level, fmt, ...) (((level) <= _logging) ? platform_log(__FILE__, __LINE__, __func__, fmt, ## __VA_ARGS__) : NULL)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) NULL
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) NULL
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) NULL
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) NULL
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_TRACE
+#define LOG_TRACE(...) LOG_AT(LOG_LEVEL_TRACE, __VA_ARGS__)
 #else
-#define LOG(fmt, ...) platform_log(__FILE__, __LINE__, __func__, fmt, ## __VA_ARGS__)
+#define LOG_TRACE(...) NULL
 #endif
+#define LOG(...) LOG_DEBUG(__VA_ARGS__)
 
 
 #endif
\ No newline at end of file
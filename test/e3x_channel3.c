@@ -45,6 +45,201 @@ int main(int argc, char **argv)
   fail_unless(channel3_send(chan,outgoing) == 0);
   fail_unless(lob_get_int(channel3_sending(chan),"test") == 42);
   fail_unless(channel3_sending(chan) == NULL);
+
+  // unreliable queues keep order
+  fail_unless(channel3_send(chan,channel3_packet(chan)) == 0);
+  fail_unless(channel3_send(chan,channel3_packet(chan)) == 0);
+  fail_unless(channel3_send(chan,channel3_packet(chan)) == 0);
+  int i;
+  for(i = 0; (outgoing = channel3_sending(chan)); i++) lob_free(outgoing);
+  fail_unless(i == 3);
+  fail_unless(channel3_window(chan,8) == 0);
+
+  // byte accounting and watermark backpressure with hysteresis
+  outgoing = channel3_packet(chan);
+  uint32_t len = lob_len(outgoing);
+  lob_free(outgoing);
+  fail_unless(channel3_size(chan) == 0);
+  channel3_watermarks(chan,len*3,len);
+  for(i = 0; channel3_send(chan,channel3_packet(chan)) == 0; i++);
+  fail_unless(i == 3);
+  fail_unless(channel3_size_out(chan) == len*3);
+  lob_free(channel3_sending(chan));
+  outgoing = channel3_packet(chan);
+  fail_unless(channel3_send(chan,outgoing) == 2); // still above low
+  lob_free(channel3_sending(chan));
+  fail_unless(channel3_size_out(chan) == len);
+  fail_unless(channel3_send(chan,outgoing) == 0);
+  fail_unless(channel3_size(chan) == len*2);
+  for(i = 0; (outgoing = channel3_sending(chan)); i++) lob_free(outgoing);
+  fail_unless(i == 2);
+  fail_unless(channel3_size(chan) == 0);
+  channel3_watermarks(chan,0,0);
+  for(i = 0; i < 10; i++) fail_unless(channel3_receive(chan,channel3_packet(chan)) == 0);
+  fail_unless(channel3_size_in(chan) == len*10);
+  for(i = 0; (incoming = channel3_receiving(chan)); i++) lob_free(incoming);
+  fail_unless(i == 10);
+  fail_unless(channel3_size(chan) == 0);
+  channel3_free(chan);
+
+  // reliable pair, A opens to B
+  lob_t ropen = lob_new();
+  lob_set(ropen,"type","bulk");
+  lob_set_int(ropen,"c",2);
+  lob_set_int(ropen,"seq",0);
+  channel3_t chanA = channel3_new(ropen);
+  channel3_t chanB = channel3_new(ropen);
+  fail_unless(chanA && chanB);
+  fail_unless(channel3_window(chanA,0) == CHANNEL3_WINDOW);
+  fail_unless(channel3_window(chanA,5) == 8); // rounds to a power of two
+  fail_unless(channel3_window(chanB,8) == 8);
+
+  // open is seq 0, fill the window and get backpressure
+  fail_unless(channel3_send(chanA,ropen) == 0);
+  for(i = 1; i < 8; i++)
+  {
+    outgoing = channel3_packet(chanA);
+    lob_set_int(outgoing,"n",i);
+    fail_unless(channel3_send(chanA,outgoing) == 0);
+  }
+  outgoing = channel3_packet(chanA);
+  fail_unless(channel3_send(chanA,outgoing) == 2);
+  fail_unless(channel3_window(chanA,16) == 8); // too late to resize
+
+  // deliver all but seq 2 and 5, out of order
+  lob_t sent[8];
+  for(i = 0; i < 8; i++)
+  {
+    sent[i] = channel3_sending(chanA);
+    fail_unless(lob_get_int(sent[i],"seq") == i);
+    fail_unless(!lob_get(sent[i],"ack"));
+  }
+  fail_unless(channel3_sending(chanA) == NULL);
+  for(i = 7; i >= 0; i--) if(i != 2 && i != 5) fail_unless(channel3_receive(chanB,sent[i]) == 0);
+  fail_unless(channel3_receive(chanB,lob_copy(sent[6])) == 0); // dup
+
+  // only 0 and 1 come out in order
+  incoming = channel3_receiving(chanB);
+  fail_unless(util_cmp(lob_get(incoming,"type"),"bulk") == 0);
+  lob_free(incoming);
+  incoming = channel3_receiving(chanB);
+  fail_unless(lob_get_int(incoming,"n") == 1);
+  lob_free(incoming);
+  fail_unless(channel3_receiving(chanB) == NULL);
+
+  // B acks with the misses, A frees 0-1 and resends 2 and 5
+  lob_t ack = channel3_sending(chanB);
+  fail_unless(ack);
+  fail_unless(lob_get_int(ack,"ack") == 1);
+  fail_unless(util_cmp(lob_get(ack,"miss"),"be") == 0); // bitmap 0x09, 2 and 5 missing after the ack
+  fail_unless(lob_get_len(ack,"miss") == 4);
+  fail_unless(channel3_sending(chanB) == NULL);
+  fail_unless(channel3_receive(chanA,ack) == 0);
+  lob_t resent = channel3_sending(chanA);
+  fail_unless(lob_get_int(resent,"seq") == 2);
+  fail_unless(channel3_receive(chanB,resent) == 0);
+  resent = channel3_sending(chanA);
+  fail_unless(lob_get_int(resent,"seq") == 5);
+  fail_unless(channel3_receive(chanB,resent) == 0);
+  fail_unless(channel3_sending(chanA) == NULL);
+
+  // window has room again
+  fail_unless(channel3_send(chanA,outgoing) == 0);
+  outgoing = channel3_sending(chanA);
+  fail_unless(lob_get_int(outgoing,"seq") == 8);
+  fail_unless(channel3_receive(chanB,outgoing) == 0);
+
+  // everything else arrives in order
+  for(i = 2; (incoming = channel3_receiving(chanB)); i++)
+  {
+    fail_unless(lob_get_int(incoming,"seq") == i);
+    lob_free(incoming);
+  }
+  fail_unless(i == 9);
+
+  // a piggybacked ack clears the rest
+  outgoing = channel3_packet(chanB);
+  fail_unless(channel3_send(chanB,outgoing) == 0);
+  outgoing = channel3_sending(chanB);
+  fail_unless(lob_get_int(outgoing,"seq") == 0);
+  fail_unless(lob_get_int(outgoing,"ack") == 8);
+  fail_unless(!lob_get(outgoing,"miss"));
+  fail_unless(channel3_receive(chanA,outgoing) == 0);
+  incoming = channel3_receiving(chanA);
+  fail_unless(lob_get_int(incoming,"seq") == 0);
+  lob_free(incoming);
+  fail_unless(channel3_size(chanA) == 0);
+  channel3_sync(chanA,1);
+  outgoing = channel3_sending(chanA);
+  fail_unless(outgoing && !lob_get(outgoing,"seq")); // just the ack, nothing left in flight
+  lob_free(outgoing);
+
+  channel3_free(chanA);
+  channel3_free(chanB);
+
+  // bitmap misses across word boundaries of a wider window
+  ropen = lob_new();
+  lob_set(ropen,"type","bulk");
+  lob_set_int(ropen,"c",4);
+  lob_set_int(ropen,"seq",0);
+  chanA = channel3_new(ropen);
+  chanB = channel3_new(ropen);
+  fail_unless(channel3_window(chanA,256) == 256);
+  fail_unless(channel3_window(chanB,256) == 256);
+  uint32_t dropped[] = {1, 63, 64, 65, 127, 128, 200};
+  uint32_t d = 0;
+  for(i = 0; i < 220; i++) fail_unless(channel3_send(chanA,channel3_packet(chanA)) == 0);
+  for(i = 0; (outgoing = channel3_sending(chanA)); i++)
+  {
+    if(d < sizeof(dropped)/sizeof(dropped[0]) && dropped[d] == (uint32_t)i)
+    {
+      d++;
+      lob_free(outgoing);
+      continue;
+    }
+    fail_unless(channel3_receive(chanB,outgoing) == 0);
+  }
+  fail_unless(i == 220);
+  incoming = channel3_receiving(chanB);
+  fail_unless(lob_get_int(incoming,"seq") == 0);
+  lob_free(incoming);
+  fail_unless(channel3_receiving(chanB) == NULL);
+  ack = channel3_sending(chanB);
+  fail_unless(lob_get_int(ack,"ack") == 0);
+  fail_unless(lob_get_len(ack,"miss") < 60); // 200 bits
+  fail_unless(channel3_receive(chanA,ack) == 0);
+  for(d = 0; (resent = channel3_sending(chanA)); d++)
+  {
+    fail_unless(lob_get_int(resent,"seq") == (int)dropped[d]);
+    fail_unless(channel3_receive(chanB,resent) == 0);
+  }
+  fail_unless(d == sizeof(dropped)/sizeof(dropped[0]));
+  for(i = 1; (incoming = channel3_receiving(chanB)); i++) lob_free(incoming);
+  fail_unless(i == 220);
+
+  // the legacy list form is still understood
+  ack = channel3_sending(chanB);
+  fail_unless(lob_get_int(ack,"ack") == 219);
+  lob_free(ack);
+  channel3_free(chanA);
+  chanA = channel3_new(ropen);
+  lob_free(ropen);
+  for(i = 0; i < 4; i++) fail_unless(channel3_send(chanA,channel3_packet(chanA)) == 0);
+  while((outgoing = channel3_sending(chanA))) lob_free(outgoing);
+  ack = lob_new();
+  lob_set_int(ack,"ack",0);
+  lob_set_raw(ack,"miss","[1,3]",5);
+  fail_unless(channel3_receive(chanA,ack) == 0);
+  resent = channel3_sending(chanA);
+  fail_unless(lob_get_int(resent,"seq") == 1);
+  lob_free(resent);
+  resent = channel3_sending(chanA);
+  fail_unless(lob_get_int(resent,"seq") == 3);
+  lob_free(resent);
+  fail_unless(channel3_sending(chanA) == NULL);
+
+  channel3_free(chanA);
+  channel3_free(chanB);
   
   return 0;
 }
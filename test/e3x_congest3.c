@@ -0,0 +1,198 @@
+#include <unistd.h>
+#include "e3x.h"
+#include "util.h"
+#include "platform.h"
+#include "unit_test.h"
+
+// simulated pipe, drops every nth packet
+static lob_t pipe_send(lob_t packet, uint32_t *count, uint32_t nth)
+{
+  if(++(*count) % nth == 0) return lob_free(packet);
+  return packet;
+}
+
+int main(int argc, char **argv)
+{
+  fail_unless(e3x_init(NULL) == 0);
+
+  // window and pacing
+  congest3_t cc = congest3_new();
+  fail_unless(cc);
+  int i;
+  for(i = 0; i < CONGEST3_CWND_INIT; i++)
+  {
+    fail_unless(congest3_sendable(cc,1000,0));
+    congest3_sent(cc,1000,0);
+  }
+  fail_unless(!congest3_sendable(cc,1000,0)); // window full
+  fail_unless(!congest3_sendable(cc,1000,1)); // resends still paced
+  fail_unless(congest3_wait(cc,1000) == congest3_rto(cc));
+  congest3_acked(cc,4,100);
+  lob_t stats = congest3_stats(cc,NULL);
+  fail_unless(lob_get_int(stats,"cwnd") == CONGEST3_CWND_INIT+4); // slow start
+  fail_unless(lob_get_int(stats,"srtt") == 100);
+  fail_unless(lob_get_int(stats,"inflight") == 0);
+  fail_unless(congest3_rto(cc) == 300);
+  lob_free(stats);
+
+  // a burst then paced at cwnd per srtt (8 per 100ms)
+  fail_unless(!congest3_sendable(cc,1000,0)); // the first burst used up the tokens
+  for(i = 0; congest3_sendable(cc,1100,0); i++) congest3_sent(cc,1100,0);
+  fail_unless(i == CONGEST3_BURST);
+  fail_unless(congest3_wait(cc,1100) == 13);
+  fail_unless(!congest3_sendable(cc,1112,0));
+  fail_unless(congest3_sendable(cc,1113,0));
+
+  // multiplicative decrease, once per rtt
+  congest3_lost(cc,1113,0);
+  stats = congest3_stats(cc,NULL);
+  fail_unless(lob_get_int(stats,"cwnd") == 4);
+  fail_unless(lob_get_int(stats,"ssthresh") == 4);
+  lob_free(stats);
+  congest3_lost(cc,1150,0);
+  stats = congest3_stats(cc,NULL);
+  fail_unless(lob_get_int(stats,"cwnd") == 4);
+  fail_unless(lob_get_int(stats,"lost") == 2);
+  lob_free(stats);
+
+  // additive increase above ssthresh
+  congest3_acked(cc,4,100);
+  stats = congest3_stats(cc,NULL);
+  fail_unless(lob_get_int(stats,"cwnd") == 5);
+  lob_free(stats);
+
+  // timeout starts over and backs off the rto
+  uint32_t rto = congest3_rto(cc);
+  congest3_sent(cc,1990,0);
+  congest3_sent(cc,1990,0);
+  stats = congest3_stats(cc,NULL);
+  int inflight = lob_get_int(stats,"inflight");
+  fail_unless(inflight > 0);
+  lob_free(stats);
+  congest3_lost(cc,2000,1);
+  stats = congest3_stats(cc,NULL);
+  fail_unless(lob_get_int(stats,"cwnd") == CONGEST3_CWND_MIN);
+  fail_unless(lob_get_int(stats,"inflight") == inflight); // other channels' packets are still out there
+  fail_unless(lob_get_int(stats,"timeouts") == 1);
+  fail_unless(congest3_rto(cc) == rto*2);
+  lob_free(stats);
+  congest3_free(cc);
+
+  // a channel timing out only takes its own packets out of flight, and acks for them later don't count twice
+  lob_t openC = lob_new();
+  lob_set(openC,"type","bulk");
+  lob_set_int(openC,"c",3);
+  lob_set_int(openC,"seq",0);
+  lob_t openD = lob_copy(openC);
+  lob_set_int(openD,"c",5);
+  channel3_t chanC = channel3_new(openC);
+  channel3_t chanD = channel3_new(openD);
+  channel3_t chanR = channel3_new(openC);
+  fail_unless(chanC && chanD && chanR);
+  cc = congest3_new();
+  channel3_congest(chanC,cc);
+  channel3_congest(chanD,cc);
+  fail_unless(channel3_send(chanC,openC) == 0);
+  fail_unless(channel3_send(chanD,openD) == 0);
+  lob_t packet;
+  while((packet = channel3_sending(chanC))) fail_unless(channel3_receive(chanR,packet) == 0);
+  while((packet = channel3_sending(chanD))) lob_free(packet);
+  stats = congest3_stats(cc,NULL);
+  fail_unless(lob_get_int(stats,"inflight") == 2);
+  lob_free(stats);
+  channel3_sync(chanC,1);
+  stats = congest3_stats(cc,NULL);
+  fail_unless(lob_get_int(stats,"inflight") == 1);
+  lob_free(stats);
+  while((packet = channel3_receiving(chanR))) lob_free(packet);
+  while((packet = channel3_sending(chanR))) fail_unless(channel3_receive(chanC,packet) == 0);
+  fail_unless(channel3_size_out(chanC) == 0); // acked
+  stats = congest3_stats(cc,NULL);
+  fail_unless(lob_get_int(stats,"inflight") == 1); // still chanD's
+  lob_free(stats);
+  channel3_free(chanD);
+  stats = congest3_stats(cc,NULL);
+  fail_unless(lob_get_int(stats,"inflight") == 0);
+  lob_free(stats);
+  channel3_free(chanC);
+  channel3_free(chanR);
+  congest3_free(cc);
+
+  // bulk transfer over a lossy pipe between two reliable channels
+  lob_t open = lob_new();
+  lob_set(open,"type","bulk");
+  lob_set_int(open,"c",1);
+  lob_set_int(open,"seq",0);
+  channel3_t chanA = channel3_new(open);
+  channel3_t chanB = channel3_new(open);
+  fail_unless(chanA && chanB);
+  cc = congest3_new();
+  channel3_congest(chanA,cc);
+  fail_unless(channel3_send(chanA,open) == 0);
+
+  uint32_t sent = 1, received = 0, lossAB = 0, lossBA = 0, stalled = 0, cwnd = 0, loops = 0;
+  uint32_t total = 300, progress = platform_ms();
+  lob_t next = NULL;
+  while(received < total && loops++ < 1000000)
+  {
+    // app keeps the window full
+    while(sent < total)
+    {
+      if(!next)
+      {
+        next = channel3_packet(chanA);
+        lob_set_int(next,"n",sent);
+      }
+      if(channel3_send(chanA,next)) break;
+      next = NULL;
+      sent++;
+    }
+
+    while((packet = channel3_sending(chanA)))
+    {
+      if((packet = pipe_send(packet,&lossAB,7))) fail_unless(channel3_receive(chanB,packet) == 0);
+    }
+    while((packet = channel3_receiving(chanB)))
+    {
+      // always in order
+      if(received) fail_unless(lob_get_int(packet,"n") == (int)received);
+      received++;
+      progress = platform_ms();
+      lob_free(packet);
+    }
+    while((packet = channel3_sending(chanB)))
+    {
+      if((packet = pipe_send(packet,&lossBA,5))) fail_unless(channel3_receive(chanA,packet) == 0);
+    }
+
+    stats = channel3_stats(chanA);
+    fail_unless(lob_get_int(stats,"unacked") <= CHANNEL3_WINDOW);
+    if((uint32_t)lob_get_int(stats,"cwnd") > cwnd) cwnd = lob_get_int(stats,"cwnd");
+    lob_free(stats);
+
+    // stand in for the retransmit timer
+    if((uint32_t)platform_ms() - progress > 5)
+    {
+      channel3_sync(chanA,1);
+      channel3_sync(chanB,1);
+      progress = platform_ms();
+      stalled++;
+    }
+    usleep(100);
+  }
+  fail_unless(received == total);
+  fail_unless(cwnd > CONGEST3_CWND_INIT);
+
+  stats = channel3_stats(chanA);
+  LOG("lossy transfer %s, %u stalls",lob_json(stats),stalled);
+  fail_unless(lob_get_int(stats,"lost") > 0);
+  fail_unless(lob_get_int(stats,"resent") > 0);
+  fail_unless(lob_get_int(stats,"sent") == (int)total);
+  lob_free(stats);
+
+  channel3_free(chanA);
+  channel3_free(chanB);
+  congest3_free(cc);
+
+  return 0;
+}
@@ -1,5 +1,8 @@
 #include "e3x.h"
 #include "util.h"
+#include "chacha.h"
+#include "base32.h"
+#include "platform.h"
 #include "unit_test.h"
 
 int main(int argc, char **argv)
@@ -8,6 +11,21 @@ int main(int argc, char **argv)
   fail_unless(e3x_init(opts) == 0);
   fail_unless(!lob_get(opts,"err"));
   fail_unless(!e3x_err());
+
+  // every primitive is bound and reported
+  lob_t report = cpu3_report();
+  fail_unless(report);
+  fail_unless(lob_get(report,"features"));
+  fail_unless(lob_get(report,"chacha20"));
+  fail_unless(lob_get(report,"base32"));
+  LOG("cpu %s",lob_json(report));
+  lob_free(report);
+
+  // overrides
+  lob_set(opts,"cpu","portable");
+  fail_unless(util_cmp((char*)cpu3_bind(opts,"chacha20",chacha20_impl),"portable") == 0);
+  lob_set(opts,"cpu_base32","bogus");
+  fail_unless(cpu3_bind(opts,"base32",base32_impl));
   
   return 0;
 }
@@ -2,6 +2,8 @@
 #include "util.h"
 #include "unit_test.h"
 #include "platform.h"
+#include "cs1a/aes.h"
+#include "cs1a/sha256.h"
 
 // fixtures
 #define A_KEY "anfpjrveyyloypswpqzlfkjpwynahohffy";
@@ -80,8 +82,42 @@ int main(int argc, char **argv)
 
   lob_t cinnerAB = cs->ephemeral_decrypt(ephemAB,couterBA);
   fail_unless(cinnerAB);
+  fail_unless(cinnerAB == couterBA); // decrypted in place
   fail_unless(util_cmp(lob_get(cinnerAB,"type"),"foo") == 0);
 
+  // the aes and sha256 kernels must all match the portable ones
+  const char *kernel = aes_128_ctr_impl(NULL);
+  fail_unless(kernel);
+  uint8_t key[16], iv1[16], iv2[16], in[1100], out1[1100], out2[1100], h1[32], h2[32];
+  uint32_t len, bad = 0;
+  for(len = 0; len < sizeof(in); len++) in[len] = (uint8_t)(len * 13);
+  memset(key,7,16);
+  for(len = 0; len <= sizeof(in); len += (len < 200) ? 1 : 37)
+  {
+    memset(iv1,0xff,16);
+    iv1[15] = 0xfd; // carries across the whole counter
+    memcpy(iv2,iv1,16);
+    aes_128_ctr_impl("portable");
+    aes_128_ctr(key,len,iv1,in,out1);
+    aes_128_ctr_impl(kernel);
+    aes_128_ctr(key,len,iv2,in,out2);
+    if(memcmp(out1,out2,len) || memcmp(iv1,iv2,16)) bad++;
+  }
+  fail_unless(bad == 0);
+
+  kernel = sha256_impl(NULL);
+  fail_unless(kernel);
+  for(bad = len = 0; len <= sizeof(in); len += (len < 200) ? 1 : 37)
+  {
+    sha256_impl("portable");
+    sha256(in,len,h1,0);
+    sha256_impl(kernel);
+    sha256(in,len,h2,0);
+    if(memcmp(h1,h2,32)) bad++;
+  }
+  fail_unless(bad == 0);
+  LOG("aes %s sha256 %s",aes_128_ctr_impl(NULL),sha256_impl(NULL));
+
   return 0;
 }
 
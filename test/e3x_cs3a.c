@@ -0,0 +1,102 @@
+#include "e3x.h"
+#include "util.h"
+#include "unit_test.h"
+#include "platform.h"
+
+int main(int argc, char **argv)
+{
+  lob_t opts = lob_new();
+  fail_unless(e3x_init(opts) == 0);
+  fail_unless(!e3x_err());
+
+  cipher3_t cs = cipher3_set(0x3a,NULL);
+  fail_unless(cs);
+  cs = cipher3_set(0,"3a");
+  fail_unless(cs);
+  fail_unless(cs->id == CS_3a);
+  
+  uint8_t buf[32];
+  fail_unless(e3x_rand(buf,32));
+
+  char hex[65];
+  util_hex(e3x_hash((uint8_t*)"foo",3,buf),32,hex);
+  fail_unless(strcmp(hex,"2c26b46b68ffc68ff99b453c1d30413413422d706483bfa0f98a5e886266e7ae") == 0);
+
+  lob_t secrets = e3x_generate();
+  fail_unless(secrets);
+  fail_unless(lob_get(secrets,"3a"));
+  lob_t keys = lob_linked(secrets);
+  fail_unless(keys);
+  fail_unless(lob_get(keys,"3a"));
+  LOG("generated key %s secret %s",lob_get(keys,"3a"),lob_get(secrets,"3a"));
+
+  local_t localA = cs->local_new(keys,secrets);
+  fail_unless(localA);
+
+  remote_t remoteA = cs->remote_new(lob_get_base32(keys,"3a"), NULL);
+  fail_unless(remoteA);
+
+  // create another to start testing real packets
+  lob_t secretsB = e3x_generate();
+  fail_unless(lob_linked(secretsB));
+  local_t localB = cs->local_new(lob_linked(secretsB),secretsB);
+  fail_unless(localB);
+  remote_t remoteB = cs->remote_new(lob_get_base32(lob_linked(secretsB),"3a"), NULL);
+  fail_unless(remoteB);
+
+  // generate a message
+  lob_t messageAB = lob_new();
+  lob_set_int(messageAB,"a",42);
+  lob_t outerAB = cs->remote_encrypt(remoteB,localA,messageAB);
+  fail_unless(outerAB);
+  fail_unless(lob_len(outerAB) == 101);
+
+  // decrypt and verify it
+  lob_t innerAB = cs->local_decrypt(localB,outerAB);
+  fail_unless(innerAB);
+  fail_unless(lob_get_int(innerAB,"a") == 42);
+  fail_unless(cs->remote_verify(remoteA,localB,outerAB) == 0);
+
+  // a tampered message must not verify
+  lob_t badAB = lob_copy(outerAB);
+  badAB->body[40] ^= 1;
+  fail_unless(cs->remote_verify(remoteA,localB,badAB) != 0);
+  fail_unless(!cs->local_decrypt(localB,badAB));
+  lob_free(badAB);
+
+  // a low-order key has no shared secret, nothing may be opened or sent with it
+  lob_t lowAB = lob_copy(outerAB);
+  memset(lowAB->body,0,32);
+  fail_unless(!cs->local_decrypt(localB,lowAB));
+  lob_free(lowAB);
+  lob_t zero = lob_new();
+  memset(lob_body(zero,NULL,32),0,32);
+  remote_t remoteZ = cs->remote_new(zero, NULL);
+  fail_unless(remoteZ);
+  fail_unless(cs->remote_verify(remoteZ,localB,outerAB) != 0);
+  fail_unless(!cs->remote_encrypt(remoteZ,localB,messageAB));
+  cs->remote_free(remoteZ);
+  lob_free(zero);
+
+  ephemeral_t ephemBA = cs->ephemeral_new(remoteA,outerAB);
+  fail_unless(ephemBA);
+  
+  lob_t channelBA = lob_new();
+  lob_set(channelBA,"type","foo");
+  lob_t couterBA = cs->ephemeral_encrypt(ephemBA,channelBA);
+  fail_unless(couterBA);
+  fail_unless(lob_len(couterBA) == 74);
+
+  lob_t outerBA = cs->remote_encrypt(remoteA,localB,messageAB);
+  fail_unless(outerBA);
+  ephemeral_t ephemAB = cs->ephemeral_new(remoteB,outerBA);
+  fail_unless(ephemAB);
+
+  lob_t cinnerAB = cs->ephemeral_decrypt(ephemAB,couterBA);
+  fail_unless(cinnerAB);
+  fail_unless(cinnerAB == couterBA); // decrypted in place
+  fail_unless(util_cmp(lob_get(cinnerAB,"type"),"foo") == 0);
+
+  return 0;
+}
+
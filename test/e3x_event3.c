@@ -1,5 +1,8 @@
+#include <unistd.h>
+#include <stdio.h>
 #include "e3x.h"
 #include "util.h"
+#include "platform.h"
 #include "unit_test.h"
 
 int main(int argc, char **argv)
@@ -9,9 +12,161 @@ int main(int argc, char **argv)
   event3_t ev = event3_new(3);
   fail_unless(ev);
   fail_unless(event3_at(ev) == 0);
+  fail_unless(event3_get(ev,100) == NULL);
 
-  // TODO test the rest!
+  // kept in order, same times in the order set
+  lob_t a = lob_new(), b = lob_new(), c = lob_new(), d = lob_new(), e;
+  event3_set(ev,a,"a",30);
+  fail_unless(event3_at(ev) == 30);
+  event3_set(ev,b,"b",10);
+  event3_set(ev,c,"c",20);
+  event3_set(ev,d,"d",20);
+  fail_unless(event3_at(ev) == 10);
+  fail_unless(event3_get(ev,5) == NULL);
+  fail_unless(event3_get(ev,10) == b);
+  fail_unless(util_cmp(lob_get(b,"id"),"b") == 0);
+  fail_unless(event3_get(ev,25) == c);
+  fail_unless(event3_get(ev,25) == d);
+  fail_unless(event3_get(ev,25) == NULL);
+  fail_unless(event3_at(ev) == 30);
+
+  // a gotten one is no longer under its id, so setting it again doesn't touch the old lob
+  event3_set(ev,c,"b",40);
+  fail_unless(event3_at(ev) == 30);
+  lob_free(b);
+
+  // moving the same lob, then replacing it frees the old one
+  event3_set(ev,a,"a",50);
+  fail_unless(event3_at(ev) == 40);
+  e = lob_new();
+  event3_set(ev,e,"a",5);
+  fail_unless(event3_at(ev) == 5);
+  fail_unless(event3_get(ev,60) == e);
+  fail_unless(event3_get(ev,60) == c);
+  fail_unless(event3_at(ev) == 0);
+  lob_free(e);
+
+  // deleting by id frees it
+  event3_set(ev,c,"c",15);
+  event3_set(ev,d,"d",15);
+  event3_set(ev,NULL,"c",0);
+  fail_unless(event3_get(ev,20) == d);
+  fail_unless(event3_at(ev) == 0);
+
+  // a given event with no time isn't kept
+  event3_set(ev,d,"d",0);
+  fail_unless(event3_at(ev) == 0);
+  lob_free(d);
+  event3_free(ev);
+
+  // lots pending over a wide spread of times, cancelled by id and drained in order
+  char ids[1000][8];
+  uint32_t i, last = 0, count = 0;
+  ev = event3_new(3);
+  for(i = 0; i < 1000; i++)
+  {
+    sprintf(ids[i],"%u",i);
+    event3_set(ev,lob_new(),ids[i],1000000 + ((i * 7919) % 1000) * ((i % 3) ? 37 : 40009));
+  }
+  for(i = 0; i < 1000; i += 2) event3_set(ev,NULL,ids[i],0);
+  fail_unless(event3_get(ev,999999) == NULL);
+  while((e = event3_get(ev,0x40000000)))
+  {
+    fail_unless(e->id >= last);
+    fail_unless(atoi(lob_get(e,"id")) % 2 == 1);
+    last = e->id;
+    count++;
+    lob_free(e);
+  }
+  fail_unless(count == 500);
+  fail_unless(event3_at(ev) == 0);
+
+  // times wrap around like a ms clock does
+  event3_free(ev);
+  ev = event3_new(3);
+  fail_unless(event3_get(ev,0xffffff00) == NULL);
+  event3_set(ev,lob_new(),"after",0x10);
+  event3_set(ev,lob_new(),"before",0xfffffff0);
+  fail_unless(event3_at(ev) == 0xfffffff0);
+  fail_unless(event3_get(ev,0xffffffe0) == NULL);
+  e = event3_get(ev,0x20);
+  fail_unless(util_cmp(lob_get(e,"id"),"before") == 0);
+  lob_free(e);
+  fail_unless(event3_at(ev) == 0x10);
+  e = event3_get(ev,0x20);
+  fail_unless(util_cmp(lob_get(e,"id"),"after") == 0);
+  lob_free(e);
+  fail_unless(event3_at(ev) == 0);
+
+  // set for before the last get still comes out first
+  event3_set(ev,lob_new(),"late",10);
+  event3_set(ev,lob_new(),"later",0x1000);
+  fail_unless(event3_at(ev) == 10);
+  e = event3_get(ev,20);
+  fail_unless(util_cmp(lob_get(e,"id"),"late") == 0);
+  lob_free(e);
+  event3_free(ev);
+
+  // the ms clock is monotonic and agrees with the us one
+  uint32_t ms = platform_ms(), us = platform_us();
+  usleep(2000);
+  fail_unless((uint32_t)platform_ms() - ms >= 2);
+  fail_unless((uint32_t)platform_us() - us >= 2000);
+  fail_unless((uint32_t)platform_ms() - ms < 1000);
+
+  // channels schedule their timeouts and retransmits here
+  ev = event3_new(3);
+  lob_t open = lob_new();
+  lob_set(open,"type","test");
+  lob_set_int(open,"c",1);
+  channel3_t idle = channel3_new(open);
+  fail_unless(channel3_timeout(idle,ev,1) == 1);
+  fail_unless(channel3_timeout(idle,ev,0) == 1);
+  lob_set_int(open,"seq",0);
+  lob_set_int(open,"c",3);
+  channel3_t rel = channel3_new(open);
+  lob_free(open);
+  fail_unless(channel3_timeout(rel,ev,5) == 5);
+  fail_unless(channel3_send(rel,channel3_packet(rel)) == 0);
+  lob_t out = channel3_sending(rel);
+  fail_unless(lob_get_int(out,"seq") == 0);
+  lob_free(out);
+  fail_unless(event3_at(ev) > 0);
+  fail_unless(event3_get(ev,(uint32_t)platform_ms()) == NULL);
+
+  // the unacked one's rto and the idle timeout both pass
+  usleep(1100*1000);
+  lob_t event, err;
+  uint32_t expired = 0;
+  while((event = event3_get(ev,(uint32_t)platform_ms())))
+  {
+    if(event->arg == rel)
+    {
+      fail_unless(channel3_expire(rel) == OPENING);
+      out = channel3_sending(rel);
+      fail_unless(lob_get_int(out,"seq") == 0);
+      lob_free(out);
+    }
+    if(event->arg == idle)
+    {
+      fail_unless(channel3_expire(idle) == ENDED);
+      fail_unless(channel3_timeout(idle,ev,0) == 0);
+      err = channel3_receiving(idle);
+      fail_unless(util_cmp(lob_get(err,"err"),"timeout") == 0);
+      fail_unless(lob_get_int(err,"c") == 1);
+      lob_free(err);
+      fail_unless(channel3_size(idle) == 0);
+    }
+    expired++;
+  }
+  fail_unless(expired == 2);
+
+  // the resend is timed again, freeing cancels it
+  fail_unless(event3_at(ev) > (uint32_t)platform_ms());
+  channel3_free(idle);
+  channel3_free(rel);
+  fail_unless(event3_at(ev) == 0);
+  event3_free(ev);
 
   return 0;
 }
-
@@ -1,6 +1,20 @@
 #include "ext.h"
 #include "loopback.h"
 #include "unit_test.h"
+#include <unistd.h>
+
+// keep the sending side's timers going until a block shows up
+lob_t block_wait(mesh_t mesh, link_t link)
+{
+  lob_t got;
+  int i;
+  for(i = 0; i < 5000 && !(got = ext_block_receive(mesh)); i++)
+  {
+    usleep(1000);
+    link_process(link, 0);
+  }
+  return got;
+}
 
 int main(int argc, char **argv)
 {
@@ -9,12 +23,14 @@ int main(int argc, char **argv)
   lob_t secretsA = mesh_generate(meshA);
   fail_unless(secretsA);
   fail_unless(ext_link_auto(meshA));
+  fail_unless(ext_block(meshA));
 
   mesh_t meshB = mesh_new(3);
   fail_unless(meshB);
   lob_t secretsB = mesh_generate(meshB);
   fail_unless(secretsB);
   fail_unless(ext_link_auto(meshB));
+  fail_unless(ext_block(meshB));
 
   net_loopback_t pair = net_loopback_new(meshA,meshB);
   fail_unless(pair);
@@ -26,10 +42,56 @@ int main(int argc, char **argv)
 
   fail_unless(link_sync(linkAB));
 
-  // lob_t block = lob_new();
-  // lob_append(block,NULL,1500);
-//  fail_unless(ext_block_send(linkAB,block));
-//  fail_unless(ext_block_receive(meshB));
+  fail_unless(ext_block_receive(meshB) == NULL);
+
+  // small one fits in a single packet
+  lob_t block = lob_new();
+  lob_set(block,"hello","world");
+  fail_unless(ext_block_send(linkAB,block));
+  lob_t got = block_wait(meshB,linkAB);
+  fail_unless(got);
+  fail_unless(got->arg == linkBA);
+  fail_unless(lob_get_cmp(got,"hello","world") == 0);
+  lob_free(got);
+  fail_unless(ext_block_receive(meshB) == NULL);
+
+  // large ones are fragmented past the channel window and come back whole and in order
+  uint8_t data[100000];
+  uint32_t i;
+  for(i = 0; i < sizeof(data); i++) data[i] = (uint8_t)(i * 7);
+  block = lob_new();
+  lob_set_int(block,"n",1);
+  lob_body(block,data,sizeof(data));
+  fail_unless(ext_block_send(linkAB,block));
+  block = lob_new();
+  lob_set_int(block,"n",2);
+  lob_body(block,data,EXT_BLOCK_FRAG);
+  fail_unless(ext_block_send(linkAB,block));
+  got = block_wait(meshB,linkAB);
+  fail_unless(got);
+  fail_unless(lob_get_int(got,"n") == 1);
+  fail_unless(got->body_len == sizeof(data));
+  fail_unless(memcmp(got->body,data,sizeof(data)) == 0);
+  lob_free(got);
+  got = block_wait(meshB,linkAB);
+  fail_unless(got);
+  fail_unless(lob_get_int(got,"n") == 2);
+  fail_unless(got->body_len == EXT_BLOCK_FRAG);
+  lob_free(got);
+  fail_unless(ext_block_receive(meshB) == NULL);
+
+  // and the other way on its own channel
+  block = lob_new();
+  lob_body(block,data,5000);
+  fail_unless(ext_block_send(linkBA,block));
+  got = block_wait(meshA,linkBA);
+  fail_unless(got);
+  fail_unless(got->arg == linkAB);
+  fail_unless(got->body_len == 5000);
+  lob_free(got);
+
+  mesh_free(meshA);
+  mesh_free(meshB);
 
   return 0;
 }
@@ -17,6 +17,29 @@ int main(int argc, char **argv)
     fail_unless(outlen % 24 == 0);
     fail_unless(outlen == 192);
 
+    // the block kernel must match the portable one
+    unsigned char raw[64], out1[64], out2[64];
+    char enc1[128], enc2[128];
+    unsigned int i, len, bad = 0;
+    for(i = 0; i < sizeof(raw); i++) raw[i] = (unsigned char)(i * 37 + 11);
+    fail_unless(base32_impl(NULL));
+    fail_unless(!base32_impl("bogus"));
+    for(len = 0; len <= sizeof(raw); len++)
+    {
+        base32_impl("portable");
+        base32_encode_into(raw, len, enc1);
+        fail_unless(base32_decode_into(enc1, strlen(enc1), out1) == (int)len);
+        base32_impl("block");
+        base32_encode_into(raw, len, enc2);
+        fail_unless(base32_decode_into(enc2, strlen(enc2), out2) == (int)len);
+        if(strcmp(enc1, enc2) || memcmp(out1, out2, len) || memcmp(out1, raw, len)) bad++;
+    }
+    fail_unless(bad == 0);
+
+    // skipped characters fall back to the portable decoder
+    fail_unless(base32_decode_into("mzxw6-idcmfza", 0, out1) == 7);
+    fail_unless(memcmp(out1, "foo bar", 7) == 0);
+
     return 0;
 }
 
@@ -2,10 +2,15 @@
 #include "util.h"
 #include "unit_test.h"
 
+static const char *kernels[] = {"portable","sse2","avx2"};
+
 int main(int argc, char **argv)
 {
   uint8_t key[32], nonce[8], test[9];
   char hex[65];
+  uint8_t *plain, *scalar, *vector;
+  uint32_t i, len, bad;
+  unsigned int k;
 
   memset(key,0,32);
   memset(nonce,0,8);
@@ -25,6 +30,37 @@ int main(int argc, char **argv)
   fail_unless(chacha20(key,nonce,test,9));
   fail_unless(util_cmp(util_hex(test,9,hex),"ffffffffffffffffff") == 0);
 
+  // every kernel must match the scalar one across block boundaries and odd tails
+  fail_unless(chacha20_impl("portable"));
+  fail_unless(!chacha20_impl("bogus"));
+  plain = malloc(4096);
+  scalar = malloc(4096);
+  vector = malloc(4096);
+  for(i = 0; i < 4096; i++) plain[i] = (uint8_t)(i * 7);
+  for(i = 0; i < 32; i++) key[i] = (uint8_t)i;
+  for(i = 0; i < 8; i++) nonce[i] = (uint8_t)(i + 100);
+  for(k = 1; k < sizeof(kernels)/sizeof(kernels[0]); k++)
+  {
+    if(!chacha20_impl(kernels[k])) continue;
+    bad = 0;
+    for(len = 0; len <= 4096; len += (len < 1100) ? 1 : 61)
+    {
+      chacha20_impl("portable");
+      memcpy(scalar,plain,len);
+      chacha20(key,nonce,scalar,len);
+      chacha20_impl(kernels[k]);
+      memcpy(vector,plain,len);
+      chacha20(key,nonce,vector,len);
+      if(memcmp(scalar,vector,len) != 0) bad++;
+    }
+    fail_unless(bad == 0);
+  }
+
+  if(!chacha20_impl("avx2")) chacha20_impl("sse2");
+
+  free(plain);
+  free(scalar);
+  free(vector);
 
   return 0;
 }
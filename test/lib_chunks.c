@@ -118,6 +118,28 @@ int main(int argc, char **argv)
   chunks_free(c1);
   chunks_free(c2);
 
+  // cloaked stream, receiver mirrors the cloaking back
+  c1 = chunks_new(10);
+  c2 = chunks_new(20);
+  fail_unless(chunks_cloak(c1,2));
+  fail_unless(chunks_send(c1, packet));
+  fail_unless(chunks_len(c1) == 133);
+  while(chunks_len(c1))
+  {
+    len = (chunks_len(c1) < 10) ? chunks_len(c1) : 10;
+    fail_unless((buf = chunks_write(c1)));
+    chunks_read(c2,buf,len);
+    fail_unless(chunks_written(c1,len));
+  }
+  p1 = chunks_receive(c2);
+  fail_unless(p1);
+  fail_unless(p1->body_len == 100);
+  fail_unless(chunks_send(c2, p1));
+  fail_unless(chunks_len(c2) == 118); // includes the ack chunk
+  lob_free(p1);
+  chunks_free(c1);
+  chunks_free(c2);
+
   return 0;
 }
 
@@ -55,6 +55,29 @@ int main(int argc, char **argv)
   lob_set(b,"bar","foo");
   fail_unless(lob_cmp(a,b) != 0);
 
+  // cloaking, multiple rounds and bodies past 255 bytes
+  lob_t plain = lob_new();
+  lob_set(plain,"type","cloak");
+  lob_body(plain,NULL,600);
+  memset(plain->body,42,600);
+  uint8_t *cloaked = lob_cloak(plain,3);
+  fail_unless(cloaked);
+  fail_unless(cloaked[0]);
+  lob_t decloaked = lob_decloak(cloaked,lob_len(plain)+24);
+  fail_unless(decloaked);
+  fail_unless(lob_cmp(plain,decloaked) == 0);
+  lob_free(decloaked);
+  free(cloaked);
+  uint8_t cbuf[1024];
+  fail_unless(lob_cloak_into(plain,1,cbuf) == lob_len(plain)+8);
+  fail_unless((decloaked = lob_decloak(cbuf,lob_len(plain)+8)));
+  fail_unless(lob_cmp(plain,decloaked) == 0);
+  lob_free(decloaked);
+  fail_unless((decloaked = lob_decloak(lob_raw(plain),lob_len(plain))));
+  fail_unless(lob_cmp(plain,decloaked) == 0);
+  lob_free(decloaked);
+  lob_free(plain);
+
   return 0;
 }
 
@@ -0,0 +1,83 @@
+#include "mesh.h"
+#include "unit_test.h"
+
+int main(int argc, char **argv)
+{
+  fail_unless(util_cmp(memstat_name(MEMSTAT_LOB),"lob") == 0);
+  fail_unless(memstat_name(MEMSTAT_KINDS) == NULL);
+
+  // lobs count their struct and packet bytes as they grow and go
+  int32_t count = memstat_count(MEMSTAT_LOB);
+  int64_t bytes = memstat_bytes(MEMSTAT_LOB);
+  lob_t p = lob_new();
+  fail_unless(memstat_count(MEMSTAT_LOB) == count + 1);
+  fail_unless(memstat_bytes(MEMSTAT_LOB) == bytes + (int64_t)sizeof (struct lob_struct) + 2);
+  lob_body(p,NULL,100);
+  fail_unless(memstat_bytes(MEMSTAT_LOB) == bytes + (int64_t)sizeof (struct lob_struct) + 102);
+  lob_set(p,"a","b");
+  lob_t copy = lob_copy(p);
+  fail_unless(memstat_count(MEMSTAT_LOB) == count + 2);
+  lob_free(copy);
+  lob_free(p);
+  fail_unless(memstat_count(MEMSTAT_LOB) == count);
+  fail_unless(memstat_bytes(MEMSTAT_LOB) == bytes);
+
+  xht_t h = xht_new(3);
+  fail_unless(memstat_count(MEMSTAT_XHT) == 1);
+  xht_set(h,"a","1");
+  xht_set(h,"b","2");
+  xht_set(h,"c","3");
+  xht_set(h,"d","4");
+  xht_free(h);
+  fail_unless(memstat_count(MEMSTAT_XHT) == 0);
+  fail_unless(memstat_bytes(MEMSTAT_XHT) == 0);
+
+  // a mesh reports its own links and channels, and the process totals
+  mesh_t mesh = mesh_new(3);
+  fail_unless(mesh);
+  lob_t secrets = mesh_generate(mesh);
+  fail_unless(secrets);
+  lob_t idB = e3x_generate();
+  link_t link = link_keys(mesh, lob_linked(idB));
+  fail_unless(link);
+  lob_t open = lob_set(lob_new(),"type","test");
+  lob_set_int(open,"seq",0);
+  channel3_t c3 = link_channel(link, open);
+  fail_unless(c3);
+  fail_unless(channel3_send(c3, open) == 0);
+  lob_t packet = channel3_packet(c3);
+  fail_unless(lob_body(packet,NULL,500));
+  fail_unless(channel3_send(c3, packet) == 0);
+  fail_unless(memstat_count(MEMSTAT_LINK) == 1);
+  fail_unless(memstat_count(MEMSTAT_EXCHANGE) == 1);
+  fail_unless(memstat_count(MEMSTAT_CHANNEL) == 1);
+  fail_unless(channel3_memory(c3) == memstat_bytes(MEMSTAT_CHANNEL));
+
+  lob_t stats = mesh_stats_memory(mesh);
+  fail_unless(stats);
+  fail_unless(lob_get_int(stats,"links") == 1);
+  fail_unless(lob_get_int(stats,"links_bytes") == (int)sizeof (struct link_struct));
+  fail_unless(lob_get_int(stats,"exchanges") == 1);
+  fail_unless(lob_get_int(stats,"channels") == 1);
+  fail_unless(lob_get_int(stats,"channels_bytes") > (int)channel3_memory(c3));
+  fail_unless(lob_get_int(stats,"channels_queued") >= 500);
+  lob_t all = lob_get_json(stats,"process");
+  fail_unless(all);
+  fail_unless(lob_get_int(all,"link_count") == 1);
+  fail_unless(lob_get_int(all,"channel_count") == 1);
+  fail_unless(lob_get_int(all,"lob_count") > 0);
+  fail_unless(lob_get_int(all,"xht_bytes") > 0);
+  lob_free(all);
+  lob_free(stats);
+
+  // everything the mesh made goes with it
+  mesh_free(mesh);
+  lob_free(secrets);
+  lob_free(idB);
+  fail_unless(memstat_count(MEMSTAT_LINK) == 0);
+  fail_unless(memstat_count(MEMSTAT_EXCHANGE) == 0);
+  fail_unless(memstat_count(MEMSTAT_CHANNEL) == 0);
+  fail_unless(memstat_bytes(MEMSTAT_CHANNEL) == 0);
+
+  return 0;
+}
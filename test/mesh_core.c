@@ -1,6 +1,18 @@
+#include <unistd.h>
 #include "mesh.h"
 #include "unit_test.h"
 
+static int timeouts = 0;
+void handle_test(link_t link, channel3_t c3, void *arg)
+{
+  lob_t p;
+  while((p = channel3_receiving(c3)))
+  {
+    if(util_cmp(lob_get(p,"err"),"timeout") == 0) timeouts++;
+    lob_free(p);
+  }
+}
+
 pipe_t net_test(link_t link, lob_t path)
 {
   fail_unless(path);
@@ -9,6 +21,22 @@ pipe_t net_test(link_t link, lob_t path)
   return pipe;
 }
 
+// typed ones only ever see their type, untyped ones see the rest
+static int typed = 0, untyped = 0;
+static lob_t open_typed(link_t link, lob_t open)
+{
+  fail_unless(lob_get_cmp(open,"type","typed") == 0);
+  typed++;
+  lob_free(open);
+  return NULL;
+}
+
+static lob_t open_untyped(link_t link, lob_t open)
+{
+  untyped++;
+  return open;
+}
+
 int main(int argc, char **argv)
 {
   mesh_t mesh = mesh_new(3);
@@ -17,6 +45,13 @@ int main(int argc, char **argv)
   fail_unless(secrets);
   fail_unless(mesh->self);
   fail_unless(mesh->id);
+
+  // messages above the runtime level don't evaluate their arguments
+  int logged = 0, level = platform_log_level(LOG_LEVEL_WARN);
+  fail_unless(LOG("%d",logged++) == NULL);
+  fail_unless(LOG_TRACE("%d",logged++) == NULL);
+  fail_unless(logged == 0);
+  platform_log_level(level);
   
   lob_t idB = e3x_generate();
   hashname_t hnB = hashname_keys(lob_linked(idB));
@@ -35,6 +70,22 @@ int main(int argc, char **argv)
   lob_set_int(open,"c",exchange3_cid(link->x, NULL));
   channel3_t chan = link_channel(link, open);
   fail_unless(chan);
+  fail_unless(channel3_timeout(chan,link->ev,0) == CHANNEL3_TIMEOUT);
+
+  // idle channels time out to their handler and are removed from the link
+  char uid[9], c[12];
+  strcpy(uid,channel3_uid(chan));
+  strcpy(c,channel3_c(chan));
+  xht_set(link->index,c,xht_get(link->channels,uid));
+  fail_unless(link_handle(link,chan,handle_test,NULL));
+  fail_unless(channel3_timeout(chan,link->ev,1) == 1);
+  fail_unless(link_process(link, 0));
+  fail_unless(xht_get(link->channels,uid));
+  usleep(1100*1000);
+  fail_unless(link_process(link, 0));
+  fail_unless(timeouts == 1);
+  fail_unless(!xht_get(link->channels,uid));
+  fail_unless(!xht_get(link->index,c));
 
   pipe_t pipe = pipe_new("test");
   fail_unless(pipe);
@@ -46,6 +97,97 @@ int main(int argc, char **argv)
   fail_unless(util_cmp(pipe->type,"test") == 0);
   fail_unless(link->pipes);
 
+  mesh_on_open_type(mesh, "typed", "typed", open_typed);
+  mesh_on_open(mesh, "untyped", open_untyped);
+  fail_unless(mesh_open(mesh, link, lob_set(lob_new(),"type","typed")) == NULL);
+  fail_unless(typed == 1 && untyped == 0);
+  lob_t other = mesh_open(mesh, link, lob_set(lob_new(),"type","other"));
+  fail_unless(other);
+  fail_unless(typed == 1 && untyped == 1);
+  lob_free(other);
+
+  // typed paths go straight to their handler
+  mesh_on_path(mesh, "test", NULL);
+  mesh_on_path_type(mesh, "typed", "typed", net_test);
+  fail_unless(!link_path(link,lob_set(lob_new(),"type","test")));
+  pipe = link_path(link,lob_set(lob_new(),"type","typed"));
+  fail_unless(pipe);
+  fail_unless(util_cmp(lob_get(pipe->path,"type"),"typed") == 0);
+
+  // at the cap the least recently used link without channels makes room
+  mesh_t meshC = mesh_new(3);
+  lob_t secretsC = mesh_generate(meshC);
+  fail_unless(secretsC);
+  fail_unless(mesh_cap(meshC, 2, 0));
+  lob_t ids[4];
+  int i;
+  for(i = 0; i < 4; i++) fail_unless((ids[i] = e3x_generate()));
+  link_t pinned = link_keys(meshC, lob_linked(ids[0]));
+  fail_unless(pinned);
+  lob_t open1 = lob_set(lob_new(),"type","test");
+  fail_unless(link_channel(pinned, open1));
+  fail_unless(pinned->chans == 1);
+  link_t evicted = link_keys(meshC, lob_linked(ids[1]));
+  fail_unless(evicted);
+  char hn[53];
+  memcpy(hn, evicted->id->hashname, 53);
+  link_t linkC = link_keys(meshC, lob_linked(ids[2]));
+  fail_unless(linkC);
+  fail_unless(meshC->links_count == 2);
+  fail_unless(!xht_get(meshC->index, hn));
+  fail_unless(xht_get(meshC->index, pinned->id->hashname) == pinned);
+
+  // nothing left to evict
+  lob_t open2 = lob_set(lob_new(),"type","test");
+  fail_unless(link_channel(linkC, open2));
+  fail_unless(!link_keys(meshC, lob_linked(ids[3])));
+  fail_unless(meshC->links_count == 2);
+
+  // idle ones without channels are reaped
+  fail_unless(mesh_cap(meshC, 0, 1));
+  fail_unless(link_keys(meshC, lob_linked(ids[3])));
+  fail_unless(meshC->links_count == 3);
+  usleep(5*1000);
+  mesh_process(meshC, 0);
+  fail_unless(meshC->links_count == 2);
+  fail_unless(meshC->links == linkC || meshC->links == pinned);
+
+  // links without channels are kept in use order, the oldest is evicted first
+  mesh_t meshD = mesh_new(3);
+  lob_t secretsD = mesh_generate(meshD);
+  fail_unless(secretsD);
+  fail_unless(mesh_cap(meshD, 3, 0));
+  link_t first = link_keys(meshD, lob_linked(ids[0]));
+  link_t second = link_keys(meshD, lob_linked(ids[1]));
+  link_t third = link_keys(meshD, lob_linked(ids[2]));
+  fail_unless(first && second && third);
+  fail_unless(meshD->idle == third && meshD->idle_tail == first);
+  lob_t open3 = lob_set(lob_new(),"type","test");
+  fail_unless(link_channel(first, open3));
+  fail_unless(meshD->idle_tail == second && !first->idle_next && !first->idle_prev);
+  memcpy(hn, second->id->hashname, 53);
+  link_t fourth = link_keys(meshD, lob_linked(ids[3]));
+  fail_unless(fourth);
+  fail_unless(!xht_get(meshD->index, hn));
+  fail_unless(meshD->idle == fourth && meshD->idle_tail == third);
+  fail_unless(meshD->links_count == 3);
+
+  // once scheduled, links with nothing due aren't looked at again
+  fail_unless(meshD->dirty);
+  fail_unless(mesh_process(meshD, 0) > 0);
+  fail_unless(!meshD->dirty);
+  fail_unless(event3_at(meshD->due));
+  fail_unless(!event3_get(meshD->due, platform_ms()));
+  mesh_free(meshD);
+  lob_free(open3);
+  lob_free(secretsD);
+
+  // frees the links and their channels
+  mesh_free(meshC);
+  lob_free(open1);
+  lob_free(open2);
+  lob_free(secretsC);
+  for(i = 0; i < 4; i++) lob_free(ids[i]);
 
   return 0;
 }
@@ -0,0 +1,255 @@
+#include <pthread.h>
+#include <unistd.h>
+#include "shard.h"
+#include "unit_test.h"
+
+static shards_t shardsB = NULL;
+static pipe_t pipeAB = NULL, pipeBA = NULL;
+
+// packets from the shard threads wait here for the main thread's meshA
+static pthread_mutex_t inbox_lock = PTHREAD_MUTEX_INITIALIZER;
+static lob_t inbox = NULL, inbox_tail = NULL;
+
+static void send_a(pipe_t pipe, lob_t packet, link_t link)
+{
+  pthread_mutex_lock(&inbox_lock);
+  packet->next = NULL;
+  if(inbox_tail) inbox_tail->next = packet;
+  else inbox = packet;
+  inbox_tail = packet;
+  pthread_mutex_unlock(&inbox_lock);
+}
+
+static void send_b(pipe_t pipe, lob_t packet, link_t link)
+{
+  shards_deliver(shardsB, packet, pipeBA);
+}
+
+static void inbox_process(mesh_t mesh)
+{
+  lob_t packet;
+  for(;;)
+  {
+    pthread_mutex_lock(&inbox_lock);
+    if((packet = inbox) && !(inbox = packet->next)) inbox_tail = NULL;
+    pthread_mutex_unlock(&inbox_lock);
+    if(!packet) return;
+    packet->next = NULL;
+    mesh_receive(mesh, packet, pipeAB);
+  }
+}
+
+// which shard each link came up in
+static mesh_t meshes[2];
+static uint32_t ready[2];
+static void count_link(link_t link)
+{
+  uint32_t i;
+  if(!link_ready(link)) return;
+  for(i = 0; i < 2; i++) if(meshes[i] == link->mesh) __atomic_add_fetch(&ready[i], 1, __ATOMIC_SEQ_CST);
+}
+
+// every packet on a test channel is answered
+static void handle_test(link_t link, channel3_t c3, void *arg)
+{
+  lob_t p;
+  while((p = channel3_receiving(c3)))
+  {
+    link_flush(link, c3, lob_set(channel3_packet(c3),"pong","true"));
+    lob_free(p);
+  }
+}
+
+static lob_t open_test(link_t link, lob_t open)
+{
+  channel3_t c3;
+  if(!(c3 = link_channel(link, open))) return open;
+  link_handle(link, c3, handle_test, NULL);
+  channel3_receive(c3, open);
+  handle_test(link, c3, NULL);
+  return NULL;
+}
+
+static void init_b(mesh_t mesh, uint32_t index, void *arg)
+{
+  meshes[index] = mesh;
+  mesh_on_discover(mesh, "auto", mesh_add);
+  mesh_on_link(mesh, "count", count_link);
+  mesh_on_open(mesh, "test", open_test);
+}
+
+static int pongs = 0;
+static void handle_pong(link_t link, channel3_t c3, void *arg)
+{
+  lob_t p;
+  while((p = channel3_receiving(c3)))
+  {
+    if(lob_get(p,"pong")) pongs++;
+    lob_free(p);
+  }
+}
+
+static uint32_t called = 0;
+static void call_test(mesh_t mesh, void *arg)
+{
+  if(mesh == arg) __atomic_add_fetch(&called, 1, __ATOMIC_SEQ_CST);
+}
+
+// queues calls for another shard from this shard's thread
+static char other[16];
+static void call_relay(mesh_t mesh, void *arg)
+{
+  int i;
+  for(i = 0; i < 100; i++) shards_call(shardsB, other, call_test, arg);
+}
+
+// drops the shard's link to a finished session
+static uint32_t unlinked = 0;
+static void unlink_test(mesh_t mesh, void *arg)
+{
+  link_free(link_get(mesh, arg));
+  free(arg);
+  __atomic_add_fetch(&unlinked, 1, __ATOMIC_SEQ_CST);
+}
+
+// one of shards_stats once it settles on want
+static int token_stat(char *key, int want)
+{
+  int i, val = -1;
+  lob_t stats;
+  for(i = 0; i < 1000 && val != want; i++)
+  {
+    if(i) usleep(1000);
+    stats = shards_stats(shardsB);
+    val = lob_get_int(stats,key);
+    lob_free(stats);
+  }
+  return val;
+}
+
+int main(int argc, char **argv)
+{
+  int i, n, round;
+  char *names[24];
+  mesh_t meshA = mesh_new(3);
+  fail_unless(meshA);
+  lob_t secretsA = mesh_generate(meshA);
+  fail_unless(secretsA);
+
+  lob_t secretsB = e3x_generate();
+  fail_unless(secretsB);
+  shardsB = shards_new(2, 8, secretsB, lob_linked(secretsB), init_b, NULL);
+  fail_unless(shardsB);
+  fail_unless(meshes[0] && meshes[1]);
+  char *hnB = meshes[0]->id->hashname;
+
+  // an id owned by the second shard, channel packets with an unknown token only ever go to the first
+  while(shards_owner(shardsB, meshA->id->hashname) != 1)
+  {
+    mesh_free(meshA);
+    lob_free(secretsA);
+    fail_unless((meshA = mesh_new(3)));
+    fail_unless((secretsA = mesh_generate(meshA)));
+  }
+  uint32_t owner = shards_owner(shardsB, meshA->id->hashname);
+
+  // calls run on the owning shard's thread
+  fail_unless(shards_call(shardsB, meshA->id->hashname, call_test, meshes[owner]) == 0);
+  for(i = 0; i < 1000 && !__atomic_load_n(&called, __ATOMIC_SEQ_CST); i++) usleep(1000);
+  fail_unless(called == 1);
+
+  // any thread can queue at once, here the owner's and this one both fill the other shard's
+  for(i = 0; shards_owner(shardsB, other) == owner; i++) snprintf(other, sizeof(other), "%d", i);
+  fail_unless(shards_call(shardsB, meshA->id->hashname, call_relay, meshes[1 - owner]) == 0);
+  for(i = 0; i < 100; i++) fail_unless(shards_call(shardsB, other, call_test, meshes[1 - owner]) == 0);
+  for(i = 0; i < 1000 && __atomic_load_n(&called, __ATOMIC_SEQ_CST) < 201; i++) usleep(1000);
+  fail_unless(called == 201);
+
+  pipeAB = pipe_new("test");
+  pipeAB->id = strdup("toB");
+  pipeAB->send = send_b;
+  pipeBA = pipe_new("test");
+  pipeBA->id = strdup("toA");
+  pipeBA->send = send_a;
+
+  // sessions come and go in rounds of more at once than it was told to expect, a miss is still only a slot or two after
+  for(round = 0; round < 2; round++)
+  {
+    for(n = 0; n < 24; n++)
+    {
+      mesh_t meshX = mesh_new(3);
+      fail_unless(meshX);
+      lob_t secretsX = mesh_generate(meshX);
+      fail_unless(secretsX);
+      link_t linkX = link_keys(meshX, lob_linked(secretsB));
+      fail_unless(linkX);
+      fail_unless(link_pipe(linkX, pipeAB));
+      for(i = 0; i < 2000 && !link_ready(linkX); i++)
+      {
+        inbox_process(meshX);
+        usleep(1000);
+      }
+      fail_unless(link_ready(linkX));
+      names[n] = strdup(meshX->id->hashname);
+      inbox_process(meshX);
+      mesh_free(meshX);
+      lob_free(secretsX);
+    }
+    fail_unless(token_stat("tokens", 24) == 24);
+    fail_unless(token_stat("token_slots", 64) == 64);
+
+    for(n = 0; n < 24; n++) fail_unless(shards_call(shardsB, names[n], unlink_test, names[n]) == 0);
+    for(i = 0; i < 1000 && __atomic_load_n(&unlinked, __ATOMIC_SEQ_CST) < (uint32_t)(round + 1) * 24; i++) usleep(1000);
+    fail_unless(unlinked == (uint32_t)(round + 1) * 24);
+    fail_unless(token_stat("tokens", 0) == 0);
+    fail_unless(token_stat("token_probes", 1) == 1);
+  }
+  __atomic_store_n(&ready[0], 0, __ATOMIC_SEQ_CST);
+  __atomic_store_n(&ready[1], 0, __ATOMIC_SEQ_CST);
+
+  // handshakes find their way to the owner, which discovers and links back
+  uint32_t heard = __atomic_load_n(&meshes[1 - owner]->stats.packets_in, __ATOMIC_SEQ_CST);
+  link_t link = link_keys(meshA, lob_linked(secretsB));
+  fail_unless(link);
+  fail_unless(util_cmp(link->id->hashname, hnB) == 0);
+  fail_unless(link_pipe(link, pipeAB));
+  for(i = 0; i < 2000 && !link_ready(link); i++)
+  {
+    inbox_process(meshA);
+    usleep(1000);
+  }
+  fail_unless(link_ready(link));
+  for(i = 0; i < 1000 && !__atomic_load_n(&ready[owner], __ATOMIC_SEQ_CST); i++) usleep(1000);
+  fail_unless(ready[owner] > 0);
+  fail_unless(ready[1 - owner] == 0);
+
+  // channel packets are routed by token to the same shard and answered from there
+  lob_t open = lob_new();
+  lob_set(open,"type","test");
+  lob_set_int(open,"seq",0);
+  channel3_t c3 = link_channel(link, open);
+  fail_unless(c3);
+  fail_unless(link_handle(link, c3, handle_pong, NULL));
+  fail_unless(link_flush(link, c3, open));
+  fail_unless(link_flush(link, c3, channel3_packet(c3)));
+  for(i = 0; i < 2000 && pongs < 2; i++)
+  {
+    inbox_process(meshA);
+    mesh_process(meshA, 0);
+    usleep(1000);
+  }
+  fail_unless(pongs == 2);
+
+  // the other shard may have opened some handshakes but passed them all on
+  fail_unless(__atomic_load_n(&meshes[1 - owner]->stats.packets_in, __ATOMIC_SEQ_CST) == heard);
+  fail_unless(__atomic_load_n(&meshes[owner]->stats.packets_in, __ATOMIC_SEQ_CST) > 0);
+
+  shards_free(shardsB);
+  shardsB = NULL;
+  inbox_process(meshA);
+  lob_free(secretsB);
+  mesh_free(meshA);
+  lob_free(secretsA);
+
+  return 0;
+}
@@ -1,5 +1,81 @@
 #include "loopback.h"
 #include "unit_test.h"
+#include <unistd.h>
+
+// counts datagrams on the way through the pair
+void pair_send(pipe_t pipe, lob_t packet, link_t link);
+static int sent = 0;
+static void count_send(pipe_t pipe, lob_t packet, link_t link)
+{
+  sent++;
+  pair_send(pipe, packet, link);
+}
+
+// and on a second pair
+static int sent2 = 0;
+static void count_send2(pipe_t pipe, lob_t packet, link_t link)
+{
+  sent2++;
+  pair_send(pipe, packet, link);
+}
+
+// a pipe that goes nowhere
+static int dead = 0;
+static void dead_send(pipe_t pipe, lob_t packet, link_t link)
+{
+  dead++;
+  lob_free(packet);
+}
+
+// keeps count of which pipe each send took
+static int fast = 0, slow = 0;
+static pipe_t slow_pipe = NULL;
+static void tally_send(pipe_t pipe, lob_t packet, link_t link)
+{
+  if(pipe == slow_pipe) slow++;
+  else fast++;
+  lob_free(packet);
+}
+
+static int received = 0;
+static void handle_test(link_t link, channel3_t c3, void *arg)
+{
+  lob_t p;
+  while((p = channel3_receiving(c3)))
+  {
+    received++;
+    // each one is answered
+    link_flush(link, c3, channel3_packet(c3));
+    lob_free(p);
+  }
+}
+
+static lob_t open_test(link_t link, lob_t open)
+{
+  channel3_t c3;
+  if(!(c3 = link_channel(link, open))) return open;
+  link_handle(link, c3, handle_test, NULL);
+  channel3_receive(c3, open);
+  handle_test(link, c3, NULL);
+  return NULL;
+}
+
+// three packets from one flush, returns how many datagrams went each way
+static uint8_t dup_three = 0;
+static int flush_three(link_t link)
+{
+  lob_t open = lob_new();
+  lob_set(open,"type","test");
+  lob_set_int(open,"c",exchange3_cid(link->x, NULL));
+  channel3_t c3 = link_channel(link, open);
+  fail_unless(c3);
+  if(dup_three) fail_unless(link_dup(link, c3, 1));
+  fail_unless(channel3_send(c3, open) == 0);
+  fail_unless(channel3_send(c3, channel3_packet(c3)) == 0);
+  sent = received = 0;
+  link_flush(link, c3, channel3_packet(c3));
+  return sent;
+}
 
 int main(int argc, char **argv)
 {
@@ -25,6 +101,149 @@ int main(int argc, char **argv)
   fail_unless(link_ready(linkAB));
   fail_unless(link_ready(linkBA));
 
+  // channel packets go out one per datagram by default
+  pair->pipe->send = count_send;
+  mesh_on_open(meshB, "test", open_test);
+  fail_unless(flush_three(linkAB) == 6);
+  fail_unless(received == 3);
+
+  // both sides have to handshake it before packets are coalesced
+  fail_unless(link_batch(linkAB, LINK_BATCH));
+  fail_unless(link_resync(linkAB));
+  fail_unless(linkBA->batch_remote == LINK_BATCH);
+  fail_unless(flush_three(linkAB) == 6);
+  fail_unless(link_batch(linkBA, LINK_BATCH));
+  fail_unless(link_resync(linkBA));
+  fail_unless(linkAB->batch_remote == LINK_BATCH);
+
+  // all three go in one, and the replies come back in one
+  fail_unless(flush_three(linkAB) == 2);
+  fail_unless(received == 3);
+
+  // too big to share a batch, so each reply goes alone too
+  fail_unless(link_batch(linkAB, 32));
+  fail_unless(flush_three(linkAB) == 6);
+  fail_unless(received == 3);
+
+  // a bad batch is dropped, anything framed before the damage is still handled
+  lob_t batch = lob_set_int(lob_new(),"batch",2);
+  lob_t one = lob_set_int(lob_new(),"c",99);
+  uint8_t body[64];
+  body[0] = 0;
+  body[1] = (uint8_t)lob_len(one);
+  memcpy(body+2, lob_raw(one), lob_len(one));
+  body[2+lob_len(one)] = 0xff;
+  body[3+lob_len(one)] = 0xff;
+  lob_body(batch, body, 4+lob_len(one));
+  lob_free(one);
+  fail_unless(link_receive(linkBA, batch, pair->pipe) == linkBA);
+
+  // a newer pipe without any round trip yet doesn't take over from an answered one
+  pipe_t none = pipe_new("none");
+  none->send = dead_send;
+  fail_unless(link_pipe(linkAB, none));
+  fail_unless(dead == 1); // just the handshake
+  fail_unless(flush_three(linkAB) == 6);
+  fail_unless(dead == 1);
+
+  // one with new send errors is passed over until it's heard from again
+  pair->pipe->errs++;
+  fail_unless(flush_three(linkAB) == 0);
+  fail_unless(dead == 4);
+  fail_unless(link_resync(linkBA));
+  fail_unless(dead == 5); // our answering handshake goes to every pipe
+  fail_unless(flush_three(linkAB) == 6);
+  fail_unless(dead == 5);
+
+  // striping spreads sends over both working pairs
+  net_loopback_t pair2 = net_loopback_new(meshA,meshB);
+  fail_unless(pair2);
+  pair2->pipe->send = count_send2;
+  fail_unless(link_paths(linkAB, LINK_STRIPE));
+  sent2 = 0;
+  fail_unless(flush_three(linkAB) + sent2 == 6);
+  fail_unless(sent2 > 0 && sent2 < 6);
+  fail_unless(received == 3);
+
+  // the split follows what each pipe has been delivering, here the first carries three times what the second does
+  lob_t sopen = lob_new();
+  lob_set(sopen,"type","speed");
+  lob_set_int(sopen,"c",exchange3_cid(linkAB->x, NULL));
+  channel3_t speed = link_channel(linkAB, sopen);
+  fail_unless(speed);
+  int i;
+  for(i = 0; i < 64; i++)
+  {
+    lob_t in = lob_set_int(lob_new(),"c",lob_get_int(sopen,"c"));
+    memset(lob_body(in, NULL, 100), 0, 100);
+    fail_unless(link_receive(linkAB, in, (i % 4) ? pair->pipe : pair2->pipe) == linkAB);
+  }
+  pair->pipe->send = pair2->pipe->send = tally_send;
+  slow_pipe = pair2->pipe;
+  for(i = 0; i < 40; i++) fail_unless(link_send(linkAB, lob_new()));
+  fail_unless(fast + slow == 40);
+  fail_unless(slow >= 8 && slow <= 12);
+  pair->pipe->send = count_send;
+  pair2->pipe->send = count_send2;
+  lob_free(sopen);
+
+  // duplicating only sends the channels marked for it on both, the other side handles each once
+  fail_unless(link_paths(linkAB, LINK_DUP));
+  fail_unless(linkBA->dedupe);
+  sent2 = 0;
+  fail_unless(flush_three(linkAB) + sent2 == 6);
+  dup_three = 1;
+  sent2 = 0;
+  fail_unless(flush_three(linkAB) + sent2 == 9); // replies still just take the best
+  dup_three = 0;
+  fail_unless(received == 3);
+  fail_unless(link_paths(linkAB, LINK_BEST));
+  fail_unless(!linkBA->dedupe);
+
+  // every packet, handshake, open and duplicate is counted on both the mesh and the link
+  lob_t stats = mesh_stats(meshB);
+  fail_unless(stats);
+  fail_unless(lob_get_int(stats,"packets_in") > 0 && lob_get_int(stats,"bytes_in") > 0);
+  fail_unless(lob_get_int(stats,"packets_out") > 0 && lob_get_int(stats,"bytes_out") > 0);
+  fail_unless(lob_get_int(stats,"handshakes_in") >= 1);
+  fail_unless(lob_get_int(stats,"opens") >= 1);
+  fail_unless(lob_get_int(stats,"duplicates") == 3);
+  fail_unless(lob_get_int(stats,"dropped_unknown_token") == 0);
+  lob_free(stats);
+  stats = link_stats(linkBA);
+  fail_unless(lob_get_int(stats,"duplicates") == 3);
+  fail_unless(lob_get_int(stats,"packets_in") > 0);
+  lob_free(stats);
+
+  // and drops by why
+  lob_t bogus = lob_new();
+  lob_body(bogus, NULL, 32);
+  fail_unless(mesh_receive(meshB, bogus, none) == 6);
+  lob_t small = lob_new();
+  lob_body(small, NULL, 4);
+  fail_unless(mesh_receive(meshB, small, NULL) == 1);
+  stats = mesh_stats(meshB);
+  fail_unless(lob_get_int(stats,"dropped_unknown_token") == 1);
+  fail_unless(lob_get_int(stats,"dropped_bad_args") == 1);
+  lob_free(stats);
+
+  // mesh_process resends unanswered handshakes and says when it next has something to do
+  uint32_t wait = mesh_process(meshA, 0);
+  fail_unless(wait > 0 && wait <= LINK_RETRY);
+  int before = dead;
+  usleep((wait + 10) * 1000);
+  wait = mesh_process(meshA, 0);
+  fail_unless(dead == before + 1);
+  fail_unless(wait > LINK_RETRY && wait <= LINK_RETRY * 2 + 100); // backed off
+
+  // a caller's clock is used all the way through, what it says is due is done then instead of being reported due again
+  wait = mesh_process(meshA, platform_ms() + LINK_RETRY * 2 + 100);
+  fail_unless(dead == before + 2);
+  fail_unless(wait > 0);
+  fail_unless(mesh_process(meshA, 0) > 0);
+  fail_unless(dead == before + 2);
+  fail_unless(mesh_process(meshB, 0) <= LINK_KEEPALIVE);
+
   return 0;
 }
 
@@ -1,7 +1,56 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/time.h>
 #include "udp4.h"
 #include "platform.h"
 #include "unit_test.h"
 
+// counts how often the handler runs and for how many packets
+static int handled = 0, received = 0;
+static void handle_test(link_t link, channel3_t c3, void *arg)
+{
+  lob_t p;
+  handled++;
+  while((p = channel3_receiving(c3)))
+  {
+    received++;
+    lob_free(p);
+  }
+}
+
+// a deliver hook gets what would have gone to a mesh
+static int delivered = 0;
+static pipe_t delivered_pipe = NULL;
+static uint8_t deliver_test(void *arg, lob_t packet, pipe_t pipe)
+{
+  fail_unless(arg == &delivered);
+  // adding the path may have sent a handshake first
+  if(lob_get_cmp(packet,"hi","there") == 0)
+  {
+    delivered++;
+    delivered_pipe = pipe;
+  }
+  lob_free(packet);
+  return 0;
+}
+
+static volatile sig_atomic_t alarmed = 0;
+static void on_alarm(int sig)
+{
+  alarmed = 1;
+}
+
+static lob_t open_test(link_t link, lob_t open)
+{
+  channel3_t c3;
+  if(!(c3 = link_channel(link, open))) return open;
+  link_handle(link, c3, handle_test, NULL);
+  channel3_receive(c3, open);
+  handle_test(link, c3, NULL);
+  return NULL;
+}
+
 int main(int argc, char **argv)
 {
   mesh_t meshA = mesh_new(3);
@@ -30,15 +79,76 @@ int main(int argc, char **argv)
   fail_unless(linkAB);
   fail_unless(linkBA);
   
-  fail_unless(link_path(linkAB,netB->path));
-  fail_unless(link_path(linkBA,netA->path));
-  
+  pipe_t pipeAB = link_path(linkAB,netB->path);
+  pipe_t pipeBA = link_path(linkBA,netA->path);
+  fail_unless(pipeAB);
+  fail_unless(pipeBA);
+
   link_sync(linkAB);
   net_udp4_receive(netB);
   fail_unless(exchange3_out(linkBA->x,0) >= exchange3_out(linkAB->x,0));
   net_udp4_receive(netA);
   fail_unless(exchange3_out(linkBA->x,0) == exchange3_out(linkAB->x,0));
 
+  // A cloaks, B should decloak and mirror it
+  int tries;
+  pipeAB->cloaked = 1;
+  link_resync(linkAB);
+  fcntl(netB->server, F_SETFL, O_NONBLOCK);
+  for(tries = 0; tries < 10 && !pipeBA->cloaked; tries++) net_udp4_receive(netB);
+  fail_unless(pipeBA->cloaked);
+  pipeAB->cloaked = 0;
+
+  // datagrams already waiting are received as one batch, the handler runs once for all of them
+  mesh_on_open(meshB, "test", open_test);
+  lob_t open = lob_new();
+  lob_set(open,"type","test");
+  lob_set_int(open,"c",exchange3_cid(linkAB->x, NULL));
+  channel3_t c3 = link_channel(linkAB, open);
+  fail_unless(c3);
+  fail_unless(link_flush(linkAB, c3, open));
+  for(tries = 0; tries < 10 && !received; tries++) net_udp4_receive(netB);
+  fail_unless(received == 1);
+  handled = received = 0;
+  int i;
+  for(i = 0; i < 5; i++) fail_unless(link_flush(linkAB, c3, channel3_packet(c3)));
+  net_udp4_receive(netB);
+  fail_unless(received == 5);
+  fail_unless(handled == 1);
+
+  // a net without a mesh hands everything to its deliver hook, with the pipe to reply on
+  net_udp4_t netC = net_udp4_new(NULL, NULL);
+  fail_unless(netC);
+  fail_unless(net_udp4_deliver(netC, deliver_test, &delivered) == netC);
+  pipe_t pipeAC = link_path(linkAB, netC->path);
+  fail_unless(pipeAC);
+  lob_t hi = lob_new();
+  lob_set(hi,"hi","there");
+  pipeAC->send(pipeAC, hi, linkAB);
+  lob_free(hi);
+  fcntl(netC->server, F_SETFL, O_NONBLOCK);
+  for(tries = 0; tries < 10 && !delivered; tries++) net_udp4_receive(netC);
+  fail_unless(delivered == 1);
+  fail_unless(delivered_pipe && delivered_pipe->send);
+  net_udp4_free(netC);
+
+  // a signal during a blocking receive with a timeout just returns, so the caller's loop keeps going
+  struct sigaction sa;
+  memset(&sa,0,sizeof(sa));
+  sa.sa_handler = on_alarm;
+  sigaction(SIGALRM, &sa, NULL);
+  struct timeval tv = {2, 0};
+  fcntl(netB->server, F_SETFL, 0);
+  setsockopt(netB->server, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  struct itimerval it;
+  memset(&it,0,sizeof(it));
+  it.it_value.tv_usec = 20000;
+  setitimer(ITIMER_REAL, &it, NULL);
+  unsigned long start = platform_ms();
+  fail_unless(net_udp4_receive(netB) == netB);
+  fail_unless(alarmed);
+  fail_unless(platform_ms() - start < 2000);
+
   return 0;
 }
 
@@ -13,6 +13,28 @@ unsigned long platform_seconds()
   return (unsigned long)time(0);
 }
 
+// falls back to the wall clock where there's no monotonic one
+static unsigned long long platform_monotonic_us()
+{
+  struct timeval tv;
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+  if(clock_gettime(CLOCK_MONOTONIC, &ts) == 0) return ((unsigned long long)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+#endif
+  gettimeofday(&tv, NULL);
+  return ((unsigned long long)tv.tv_sec * 1000000) + tv.tv_usec;
+}
+
+unsigned long platform_ms()
+{
+  return (unsigned long)(platform_monotonic_us() / 1000);
+}
+
+unsigned long platform_us()
+{
+  return (unsigned long)platform_monotonic_us();
+}
+
 unsigned short platform_short(unsigned short x)
 {
   return ntohs(x);
@@ -36,7 +58,7 @@ long platform_random(void)
 }
 
 #ifdef DEBUG
-int _logging = 1;
+int _logging = LOG_LEVEL_DEBUG;
 #else
 int _logging = 0;
 #endif
@@ -45,18 +67,24 @@ void platform_logging(int enabled)
 {
   if(enabled < 0)
   {
-    _logging ^= 1;
+    _logging = _logging ? 0 : LOG_LEVEL_DEBUG;
   }else{
-    _logging = enabled;    
+    _logging = enabled ? LOG_LEVEL_DEBUG : 0;
   }
   LOG("log output enabled");
 }
 
+int platform_log_level(int level)
+{
+  int was = _logging;
+  _logging = level;
+  return was;
+}
+
 void *platform_log(const char *file, int line, const char *function, const char * format, ...)
 {
   char buffer[256];
   va_list args;
-  if(!_logging) return NULL;
   va_start (args, format);
   vsnprintf (buffer, 256, format, args);
   fprintf(stderr,"%s:%d %s() %s\n", file, line, function, buffer);
@@ -0,0 +1,541 @@
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "shard.h"
+#include "lib/util.h"
+
+#define MUID "unix_shard"
+
+// packets or calls waiting for a shard
+typedef struct shard_item_struct
+{
+  uint32_t seq; // the position it's next free at, or that position+1 once filled
+  lob_t packet;
+  lob_t inner; // a handshake another shard already opened
+  pipe_t pipe;
+  void (*call)(mesh_t mesh, void *arg);
+  void *arg;
+} *shard_item_t;
+
+typedef struct shard_struct
+{
+  shards_t shards;
+  uint32_t index;
+  mesh_t mesh;
+  pthread_t thread;
+  uint8_t started;
+
+  // bounded multi-producer ring, any thread claims a slot by moving tail and only the shard moves head
+  struct shard_item_struct ring[SHARD_QUEUE];
+  uint32_t head, tail;
+
+  // only for sleeping/waking, never held while touching the ring
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  uint8_t sleeping;
+} *shard_t;
+
+// session tokens to shards, linear probing kept under half full with backward shift deletes so a miss ends at a near empty slot
+typedef struct tokens_struct
+{
+  uint32_t size; // power of two
+  struct tokens_struct *old; // the smaller one it grew from, a reader may still be in it so they're only freed with the shards
+  uint64_t slots[]; // the shard+1 in the top byte and the first 7 token bytes below, 0 is empty
+} *tokens_t;
+
+struct shards_struct
+{
+  uint32_t count;
+  shard_t shards;
+  uint32_t next; // handshakes are spread across shards by this
+  uint8_t stop;
+
+  // shards change it (rarely, under the lock) and the receive path reads it lock-free, retrying if the seq moved
+  tokens_t tokens;
+  uint32_t tokens_count;
+  uint32_t tokens_seq; // odd while a change is being made
+  pthread_mutex_t tokens_lock;
+};
+
+#define TOKEN_MASK 0x00ffffffffffffffULL
+
+static uint64_t token_key(uint8_t *token)
+{
+  uint64_t key = 0;
+  uint8_t i;
+  for(i = 0; i < 7; i++) key = (key << 8) | token[i];
+  return key ? key : 1;
+}
+
+static tokens_t tokens_new(uint32_t size, tokens_t old)
+{
+  tokens_t tokens;
+  if(!(tokens = malloc(sizeof (struct tokens_struct) + sizeof (uint64_t) * size))) return LOG("OOM");
+  memset(tokens,0,sizeof (struct tokens_struct) + sizeof (uint64_t) * size);
+  tokens->size = size;
+  tokens->old = old;
+  return tokens;
+}
+
+// the slot for a key, or the empty one it'd go in, only while holding the lock
+static uint32_t token_find(tokens_t tokens, uint64_t key)
+{
+  uint32_t mask = tokens->size - 1, i = (uint32_t)key & mask;
+  while(tokens->slots[i] && (tokens->slots[i] & TOKEN_MASK) != key) i = (i + 1) & mask;
+  return i;
+}
+
+// brackets any change readers could see half done
+static void tokens_change(shards_t shards)
+{
+  __atomic_store_n(&shards->tokens_seq, shards->tokens_seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void tokens_changed(shards_t shards)
+{
+  __atomic_store_n(&shards->tokens_seq, shards->tokens_seq + 1, __ATOMIC_RELEASE);
+}
+
+// shards add their link's tokens as they're made and remove them when rekeyed or freed
+static void token_set(shards_t shards, uint64_t key, uint32_t index)
+{
+  tokens_t tokens, grown;
+  uint32_t i;
+
+  pthread_mutex_lock(&shards->tokens_lock);
+  tokens = shards->tokens;
+
+  // doubled into a new one so readers in the old one are never disturbed
+  if((shards->tokens_count + 1) * 2 > tokens->size && (grown = tokens_new(tokens->size * 2, tokens)))
+  {
+    for(i = 0; i < tokens->size; i++) if(tokens->slots[i]) grown->slots[token_find(grown, tokens->slots[i] & TOKEN_MASK)] = tokens->slots[i];
+    __atomic_store_n(&shards->tokens, grown, __ATOMIC_RELEASE);
+    tokens = grown;
+  }
+
+  i = token_find(tokens, key);
+  if(!tokens->slots[i])
+  {
+    // only if growing failed
+    if(shards->tokens_count + 1 >= tokens->size)
+    {
+      pthread_mutex_unlock(&shards->tokens_lock);
+      LOG("token table full, channel packets for this link will be dropped");
+      return;
+    }
+    shards->tokens_count++;
+  }
+  tokens_change(shards);
+  __atomic_store_n(&tokens->slots[i], ((uint64_t)(index + 1) << 56) | key, __ATOMIC_RELAXED);
+  tokens_changed(shards);
+  pthread_mutex_unlock(&shards->tokens_lock);
+}
+
+// only removes it if it's still this shard's
+static void token_del(shards_t shards, uint64_t key, uint32_t index)
+{
+  tokens_t tokens;
+  uint32_t mask, i, j, home;
+
+  pthread_mutex_lock(&shards->tokens_lock);
+  tokens = shards->tokens;
+  mask = tokens->size - 1;
+  i = j = token_find(tokens, key);
+  if(tokens->slots[i] != (((uint64_t)(index + 1) << 56) | key))
+  {
+    pthread_mutex_unlock(&shards->tokens_lock);
+    return;
+  }
+
+  // backward shift, same as event3's ids
+  tokens_change(shards);
+  shards->tokens_count--;
+  for(;;)
+  {
+    __atomic_store_n(&tokens->slots[i], 0, __ATOMIC_RELAXED);
+    for(;;)
+    {
+      j = (j + 1) & mask;
+      if(!tokens->slots[j]) goto done;
+      home = (uint32_t)(tokens->slots[j] & TOKEN_MASK) & mask;
+      // move it back if its home isn't between the hole and here
+      if(i <= j ? (home <= i || home > j) : (home <= i && home > j)) break;
+    }
+    __atomic_store_n(&tokens->slots[i], tokens->slots[j], __ATOMIC_RELAXED);
+    i = j;
+  }
+done:
+  tokens_changed(shards);
+  pthread_mutex_unlock(&shards->tokens_lock);
+}
+
+// the shard for a token, -1 if unknown
+static int32_t token_get(shards_t shards, uint8_t *token)
+{
+  uint64_t key = token_key(token), cur;
+  uint32_t seq, mask, i, n;
+  int32_t index;
+  tokens_t tokens;
+
+  for(;;)
+  {
+    if((seq = __atomic_load_n(&shards->tokens_seq, __ATOMIC_ACQUIRE)) & 1) continue;
+    tokens = __atomic_load_n(&shards->tokens, __ATOMIC_ACQUIRE);
+    mask = tokens->size - 1;
+    index = -1;
+    for(i = (uint32_t)key & mask, n = 0; n < tokens->size; i = (i + 1) & mask, n++)
+    {
+      if(!(cur = __atomic_load_n(&tokens->slots[i], __ATOMIC_RELAXED))) break;
+      if((cur & TOKEN_MASK) != key) continue;
+      index = (int32_t)(cur >> 56) - 1;
+      break;
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if(__atomic_load_n(&shards->tokens_seq, __ATOMIC_RELAXED) == seq) return index;
+  }
+}
+
+// runs on the shard's thread whenever a link changes, the key it registered is kept in the link's index
+static void shard_on_link(link_t link)
+{
+  shard_t shard = xht_get(link->mesh->index, MUID);
+  uint64_t key, *had;
+  if(!shard || !link->x) return;
+
+  key = token_key(exchange3_token(link->x));
+  if((had = xht_get(link->index, MUID)))
+  {
+    if(*had == key) return;
+    token_del(shard->shards, *had, shard->index);
+  }else{
+    if(!(had = malloc(sizeof (uint64_t)))) return;
+    xht_set(link->index, MUID, had);
+  }
+  *had = key;
+  token_set(shard->shards, key, shard->index);
+}
+
+static void shard_on_unlink(link_t link)
+{
+  shard_t shard = xht_get(link->mesh->index, MUID);
+  uint64_t *had = xht_get(link->index, MUID);
+  if(!had) return;
+  if(shard) token_del(shard->shards, *had, shard->index);
+  xht_set(link->index, MUID, NULL);
+  free(had);
+}
+
+static uint8_t shard_push(shard_t shard, lob_t packet, lob_t inner, pipe_t pipe, void (*call)(mesh_t mesh, void *arg), void *arg)
+{
+  shard_item_t item;
+  uint32_t tail = __atomic_load_n(&shard->tail, __ATOMIC_RELAXED), seq;
+
+  for(;;)
+  {
+    item = &shard->ring[tail & (SHARD_QUEUE - 1)];
+    seq = __atomic_load_n(&item->seq, __ATOMIC_ACQUIRE);
+    if(seq == tail)
+    {
+      // on failure tail is reloaded with what another producer moved it to
+      if(__atomic_compare_exchange_n(&shard->tail, &tail, tail + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+    }else if((int32_t)(seq - tail) < 0){
+      return 1; // still holding an item from the last time around
+    }else{
+      tail = __atomic_load_n(&shard->tail, __ATOMIC_RELAXED);
+    }
+  }
+  item->packet = packet;
+  item->inner = inner;
+  item->pipe = pipe;
+  item->call = call;
+  item->arg = arg;
+  __atomic_store_n(&item->seq, tail + 1, __ATOMIC_SEQ_CST);
+
+  // only costs a lock when it's asleep
+  if(__atomic_load_n(&shard->sleeping, __ATOMIC_SEQ_CST))
+  {
+    pthread_mutex_lock(&shard->lock);
+    pthread_cond_signal(&shard->wake);
+    pthread_mutex_unlock(&shard->lock);
+  }
+  return 0;
+}
+
+// only ever called from the shard's own thread (or once they're all stopped)
+static uint8_t shard_ready(shard_t shard)
+{
+  return __atomic_load_n(&shard->ring[shard->head & (SHARD_QUEUE - 1)].seq, __ATOMIC_SEQ_CST) == shard->head + 1;
+}
+
+static shard_item_t shard_pop(shard_t shard, shard_item_t item)
+{
+  uint32_t head = shard->head;
+  shard_item_t slot = &shard->ring[head & (SHARD_QUEUE - 1)];
+  if(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != head + 1) return NULL;
+  *item = *slot;
+  shard->head = head + 1;
+  __atomic_store_n(&slot->seq, head + SHARD_QUEUE, __ATOMIC_RELEASE);
+  return item;
+}
+
+// a handshake lands on any shard, which opens it once to find the hashname and hands both to the owner
+static void shard_handshake(shard_t shard, lob_t packet, pipe_t pipe)
+{
+  mesh_t mesh = shard->mesh;
+  lob_t inner;
+  hashname_t from;
+  uint32_t index = shard->index;
+  char hex[3];
+
+  util_hex(packet->head,1,hex);
+  if(!(inner = self3_decrypt(mesh->self, packet)))
+  {
+    LOG("%s handshake failed %s",hex,e3x_err());
+    MESH_COUNT(mesh->stats, packets_in, 1);
+    MESH_COUNT(mesh->stats, bytes_in, lob_len(packet));
+    MESH_COUNT(mesh->stats, decrypt_fails, 1);
+    MESH_COUNT(mesh->stats, drops[2], 1);
+    lob_free(packet);
+    return;
+  }
+  lob_set_raw(inner,hex,"true",4);
+  if((from = hashname_key(inner)))
+  {
+    index = shards_owner(shard->shards, from->hashname);
+    hashname_free(from);
+  }
+
+  // no hashname is dropped by the mesh right here
+  if(index == shard->index) mesh_receive_opened(mesh, packet, inner, pipe);
+  else if(shard_push(&shard->shards->shards[index], packet, inner, pipe, NULL, NULL))
+  {
+    LOG("shard %u queue full, dropping",index);
+    lob_free(packet);
+    lob_free(inner);
+  }
+}
+
+static void *shard_run(void *arg)
+{
+  shard_t shard = arg;
+  struct shard_item_struct item;
+  struct timespec ts;
+  uint32_t wait;
+
+  while(!__atomic_load_n(&shard->shards->stop, __ATOMIC_ACQUIRE))
+  {
+    while(shard_pop(shard, &item))
+    {
+      if(item.call) item.call(shard->mesh, item.arg);
+      else if(item.inner) mesh_receive_opened(shard->mesh, item.packet, item.inner, item.pipe);
+      else if(item.packet->head_len == 1) shard_handshake(shard, item.packet, item.pipe);
+      else mesh_receive(shard->mesh, item.packet, item.pipe);
+    }
+
+    // sleep until the next deadline or something is queued
+    if(!(wait = mesh_process(shard->mesh, 0))) continue;
+    pthread_mutex_lock(&shard->lock);
+    __atomic_store_n(&shard->sleeping, 1, __ATOMIC_SEQ_CST);
+    if(!shard_ready(shard) && !__atomic_load_n(&shard->shards->stop, __ATOMIC_SEQ_CST))
+    {
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_sec += wait / 1000;
+      ts.tv_nsec += (long)(wait % 1000) * 1000000;
+      if(ts.tv_nsec >= 1000000000)
+      {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+      }
+      pthread_cond_timedwait(&shard->wake, &shard->lock, &ts);
+    }
+    __atomic_store_n(&shard->sleeping, 0, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&shard->lock);
+  }
+
+  return NULL;
+}
+
+shards_t shards_new(uint32_t count, uint32_t links, lob_t secrets, lob_t keys, void (*init)(mesh_t mesh, uint32_t index, void *arg), void *arg)
+{
+  shards_t shards;
+  shard_t shard;
+  uint32_t i, j, size;
+
+  if(!count || count > 255 || !secrets || !keys) return LOG("bad args");
+
+  if(!(shards = malloc(sizeof (struct shards_struct)))) return LOG("OOM");
+  memset(shards,0,sizeof (struct shards_struct));
+  pthread_mutex_init(&shards->tokens_lock, NULL);
+
+  // twice the links expected keeps it under half full until it has to grow
+  if(!links) links = SHARD_LINKS;
+  for(size = 16; size / 2 < links && size < 0x80000000u; size *= 2);
+  if(!(shards->tokens = tokens_new(size, NULL)) || !(shards->shards = malloc(sizeof (struct shard_struct) * count)))
+  {
+    free(shards->tokens);
+    pthread_mutex_destroy(&shards->tokens_lock);
+    free(shards);
+    return LOG("OOM");
+  }
+  memset(shards->shards,0,sizeof (struct shard_struct) * count);
+  shards->count = count;
+  for(i = 0; i < count; i++)
+  {
+    shard = &shards->shards[i];
+    shard->shards = shards;
+    shard->index = i;
+    for(j = 0; j < SHARD_QUEUE; j++) shard->ring[j].seq = j;
+    pthread_mutex_init(&shard->lock, NULL);
+    pthread_cond_init(&shard->wake, NULL);
+  }
+
+  // all set up before any thread starts
+  for(i = 0; i < count; i++)
+  {
+    shard = &shards->shards[i];
+    if(!(shard->mesh = mesh_new(0)) || mesh_load(shard->mesh, secrets, keys))
+    {
+      shards_free(shards);
+      return LOG("mesh %u failed",i);
+    }
+    xht_set(shard->mesh->index, MUID, shard);
+    mesh_on_link(shard->mesh, MUID, shard_on_link);
+    mesh_on_unlink(shard->mesh, MUID, shard_on_unlink);
+    if(init) init(shard->mesh, i, arg);
+  }
+
+  for(i = 0; i < count; i++)
+  {
+    shard = &shards->shards[i];
+    if(pthread_create(&shard->thread, NULL, shard_run, shard))
+    {
+      shards_free(shards);
+      return LOG("thread %u failed",i);
+    }
+    shard->started = 1;
+  }
+
+  return shards;
+}
+
+void shards_free(shards_t shards)
+{
+  tokens_t tokens;
+  shard_t shard;
+  struct shard_item_struct item;
+  uint32_t i;
+  if(!shards) return;
+
+  __atomic_store_n(&shards->stop, 1, __ATOMIC_SEQ_CST);
+  for(i = 0; i < shards->count; i++)
+  {
+    shard = &shards->shards[i];
+    if(!shard->started) continue;
+    pthread_mutex_lock(&shard->lock);
+    pthread_cond_signal(&shard->wake);
+    pthread_mutex_unlock(&shard->lock);
+    pthread_join(shard->thread, NULL);
+  }
+
+  for(i = 0; i < shards->count; i++)
+  {
+    shard = &shards->shards[i];
+    while(shard_pop(shard, &item))
+    {
+      lob_free(item.packet);
+      lob_free(item.inner);
+    }
+    mesh_free(shard->mesh);
+    pthread_mutex_destroy(&shard->lock);
+    pthread_cond_destroy(&shard->wake);
+  }
+
+  while((tokens = shards->tokens))
+  {
+    shards->tokens = tokens->old;
+    free(tokens);
+  }
+  pthread_mutex_destroy(&shards->tokens_lock);
+  free(shards->shards);
+  free(shards);
+}
+
+lob_t shards_stats(shards_t shards)
+{
+  tokens_t tokens;
+  uint32_t i, run = 0, longest = 0, count;
+  lob_t json;
+
+  if(!shards) return LOG("bad args");
+  pthread_mutex_lock(&shards->tokens_lock);
+  tokens = shards->tokens;
+  count = shards->tokens_count;
+
+  // twice around catches a run that wraps
+  for(i = 0; i < tokens->size * 2 && longest < tokens->size; i++)
+  {
+    run = tokens->slots[i & (tokens->size - 1)] ? run + 1 : 0;
+    if(run > longest) longest = run;
+  }
+  json = lob_new();
+  lob_set_uint(json,"tokens",count);
+  lob_set_uint(json,"token_slots",tokens->size);
+  lob_set_uint(json,"token_probes",longest + 1);
+  pthread_mutex_unlock(&shards->tokens_lock);
+
+  return json;
+}
+
+uint32_t shards_owner(shards_t shards, char *hashname)
+{
+  uint32_t hash = 2166136261u;
+  if(!shards || !hashname) return 0;
+  while(*hashname) hash = (hash ^ (uint8_t)*hashname++) * 16777619u;
+  return hash % shards->count;
+}
+
+uint8_t shards_receive(shards_t shards, lob_t packet, pipe_t pipe)
+{
+  uint32_t index = 0;
+  int32_t owner;
+
+  if(!shards || !packet || !pipe)
+  {
+    lob_free(packet);
+    return 1;
+  }
+
+  // handshakes go to any shard to be opened there, it passes them on to the owner
+  if(packet->head_len == 1) index = __atomic_fetch_add(&shards->next, 1, __ATOMIC_RELAXED) % shards->count;
+
+  // channel packets by the token the owner registered, unknown ones are dropped by any shard
+  if(packet->head_len == 0 && packet->body_len >= 16 && (owner = token_get(shards, packet->body)) >= 0) index = (uint32_t)owner;
+
+  if(shard_push(&shards->shards[index], packet, NULL, pipe, NULL, NULL))
+  {
+    LOG("shard %u queue full, dropping",index);
+    lob_free(packet);
+    return 3;
+  }
+  return 0;
+}
+
+uint8_t shards_deliver(void *shards, lob_t packet, pipe_t pipe)
+{
+  return shards_receive((shards_t)shards, packet, pipe);
+}
+
+uint8_t shards_call(shards_t shards, char *hashname, void (*call)(mesh_t mesh, void *arg), void *arg)
+{
+  uint32_t index;
+  if(!shards || !call) return 1;
+  index = shards_owner(shards, hashname);
+  if(shard_push(&shards->shards[index], NULL, NULL, NULL, call, arg))
+  {
+    LOG("shard %u queue full",index);
+    return 2;
+  }
+  return 0;
+}
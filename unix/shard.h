@@ -0,0 +1,44 @@
+#ifndef shard_h
+#define shard_h
+
+#include "mesh.h"
+
+// runs one identity as several meshes each on its own thread, every link lives in exactly one of them (by hashname)
+// incoming packets are handed to the owning shard through a lock-free multi-producer queue, shards_* may be called from any thread (shards_new/free from one)
+
+typedef struct shards_struct *shards_t;
+
+// most packets/calls waiting on any one shard before new ones are dropped (power of two)
+#ifndef SHARD_QUEUE
+#define SHARD_QUEUE 1024
+#endif
+
+// links expected across all the shards when shards_new is given 0, only sizes the token table to start with
+#ifndef SHARD_LINKS
+#define SHARD_LINKS 1024
+#endif
+
+// creates count meshes loaded with the same secrets/keys, init is called with each (before its thread starts) to add extensions and triggers
+// links is about how many to expect at once (0 for SHARD_LINKS), the table routing channel packets by token grows past it as needed
+shards_t shards_new(uint32_t count, uint32_t links, lob_t secrets, lob_t keys, void (*init)(mesh_t mesh, uint32_t index, void *arg), void *arg);
+
+// stops and joins every thread, then frees the meshes
+void shards_free(shards_t shards);
+
+// the token table's {"tokens":live,"token_slots":size,"token_probes":most slots a lookup can look at}
+lob_t shards_stats(shards_t shards);
+
+// which shard a hashname's link belongs in
+uint32_t shards_owner(shards_t shards, char *hashname);
+
+// an incoming packet is passed to the shard that owns its link (always takes it), 0 if queued
+// handshakes are spread across shards and decrypted once there to find the owner, channel packets go by their token
+uint8_t shards_receive(shards_t shards, lob_t packet, pipe_t pipe);
+
+// the same as a transport's deliver hook, e.g. net_udp4_deliver(net, shards_deliver, shards) on a net made without a mesh
+uint8_t shards_deliver(void *shards, lob_t packet, pipe_t pipe);
+
+// run this on the thread of the shard owning the hashname (to add links, open channels, etc), 0 if queued
+uint8_t shards_call(shards_t shards, char *hashname, void (*call)(mesh_t mesh, void *arg), void *arg);
+
+#endif
@@ -0,0 +1,335 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "e3x.h"
+#include "lob.h"
+#include "chacha.h"
+#include "platform.h"
+
+// times every cipher3_t function of each compiled cipher set over a range of packet sizes, then chacha20 kernels and event3 timer rates
+// usage: bench [-j] [ms per measurement], -j prints one json object per line
+
+#define BATCH 64
+
+static uint32_t _sizes[] = {32, 64, 128, 256, 512, 1024, 1400};
+static uint32_t _pending[] = {1000, 100000, 1000000}; // events already scheduled
+static uint32_t _budget = 200; // ms per measurement
+static int _json = 0;
+
+typedef struct bench_struct
+{
+  cipher3_t cs;
+  lob_t keysA, secretsA, keysB, secretsB;
+  local_t localA;
+  local_t localB;
+  remote_t remoteA;
+  remote_t remoteB;
+  ephemeral_t ephemAB;
+  ephemeral_t ephemBA;
+  lob_t inner, outer, couter;
+  uint32_t size;
+  uint8_t scratch[1400];
+  void *in[BATCH], *out[BATCH];
+} *bench_t;
+
+// prep and done are untimed, op is timed and stores any result in b->out[i]
+typedef void (*bench_fn_t)(bench_t b, int i);
+
+static uint64_t bench_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+static void bench_run(bench_t b, char *name, uint32_t size, bench_fn_t prep, bench_fn_t op, bench_fn_t done)
+{
+  uint64_t start, total = 0, ops = 0;
+  double ns, persec;
+  int i;
+
+  while(total < (uint64_t)_budget * 1000000)
+  {
+    for(i = 0; i < BATCH; i++)
+    {
+      b->in[i] = b->out[i] = NULL;
+      if(prep) prep(b, i);
+    }
+    start = bench_ns();
+    for(i = 0; i < BATCH; i++) op(b, i);
+    total += bench_ns() - start;
+    ops += BATCH;
+    for(i = 0; i < BATCH; i++) if(done) done(b, i);
+  }
+
+  ns = (double)total / ops;
+  persec = 1000000000.0 / ns;
+  if(_json)
+  {
+    printf("{\"cs\":\"%s\",\"op\":\"%s\",\"size\":%u,\"ops\":%llu,\"ns_op\":%.1f,\"ops_sec\":%.1f,\"bytes_sec\":%.1f}\n",
+      b->cs->hex, name, size, (unsigned long long)ops, ns, persec, persec * size);
+  }else{
+    printf("%-3s %-18s %5u %12.0f ops/s %12.0f ns/op %14.0f B/s\n", b->cs->hex, name, size, persec, ns, persec * size);
+  }
+  fflush(stdout);
+}
+
+// generic cleanup helpers
+static void done_lob(bench_t b, int i) { lob_free(b->in[i]); lob_free(b->out[i]); }
+static void done_local(bench_t b, int i) { b->cs->local_free(b->out[i]); }
+static void done_remote(bench_t b, int i) { b->cs->remote_free(b->out[i]); }
+static void done_ephemeral(bench_t b, int i) { b->cs->ephemeral_free(b->out[i]); }
+
+static void op_rand(bench_t b, int i) { b->cs->rand(b->scratch, b->size); }
+static void op_hash(bench_t b, int i) { uint8_t hash[32]; b->cs->hash(b->scratch, b->size, hash); }
+
+static void prep_generate(bench_t b, int i) { b->in[i] = lob_new(); b->out[i] = lob_new(); }
+static void op_generate(bench_t b, int i) { b->cs->generate(b->in[i], b->out[i]); }
+
+static void op_local_new(bench_t b, int i) { b->out[i] = b->cs->local_new(b->keysA, b->secretsA); }
+static void prep_remote_new(bench_t b, int i) { b->in[i] = lob_get_base32(b->keysA, b->cs->hex); }
+static void op_remote_new(bench_t b, int i) { b->out[i] = b->cs->remote_new(b->in[i], NULL); }
+static void done_remote_new(bench_t b, int i) { lob_free(b->in[i]); done_remote(b, i); }
+
+static void op_remote_encrypt(bench_t b, int i) { b->out[i] = b->cs->remote_encrypt(b->remoteB, b->localA, b->inner); }
+static void prep_outer(bench_t b, int i) { b->in[i] = lob_copy(b->outer); }
+static void op_local_decrypt(bench_t b, int i) { b->out[i] = b->cs->local_decrypt(b->localB, b->in[i]); }
+static void op_remote_verify(bench_t b, int i) { b->cs->remote_verify(b->remoteA, b->localB, b->in[i]); }
+static void op_ephemeral_new(bench_t b, int i) { b->out[i] = b->cs->ephemeral_new(b->remoteA, b->in[i]); }
+static void done_ephemeral_new(bench_t b, int i) { lob_free(b->in[i]); done_ephemeral(b, i); }
+static void op_ephemeral_encrypt(bench_t b, int i) { b->out[i] = b->cs->ephemeral_encrypt(b->ephemBA, b->inner); }
+static void prep_couter(bench_t b, int i) { b->in[i] = lob_copy(b->couter); }
+static void op_ephemeral_decrypt(bench_t b, int i) { b->out[i] = b->cs->ephemeral_decrypt(b->ephemAB, b->in[i]); }
+static void done_ephemeral_decrypt(bench_t b, int i) { lob_free(b->out[i]); } // the outer was consumed
+
+// two identities with sessions in both directions
+static bench_t bench_new(cipher3_t cs)
+{
+  bench_t b;
+  lob_t outerBA, key;
+
+  if(!(b = malloc(sizeof(struct bench_struct)))) return LOG("OOM");
+  memset(b,0,sizeof (struct bench_struct));
+  b->cs = cs;
+
+  b->keysA = lob_new();
+  b->secretsA = lob_link(NULL, b->keysA);
+  b->keysB = lob_new();
+  b->secretsB = lob_link(NULL, b->keysB);
+  if(cs->generate(b->keysA, b->secretsA) || cs->generate(b->keysB, b->secretsB)) return LOG("generate failed for %s",cs->hex);
+  b->localA = cs->local_new(b->keysA, b->secretsA);
+  b->localB = cs->local_new(b->keysB, b->secretsB);
+  key = lob_get_base32(b->keysA, cs->hex);
+  b->remoteA = cs->remote_new(key, NULL);
+  lob_free(key);
+  key = lob_get_base32(b->keysB, cs->hex);
+  b->remoteB = cs->remote_new(key, NULL);
+  lob_free(key);
+  if(!b->localA || !b->localB || !b->remoteA || !b->remoteB) return LOG("identity setup failed for %s",cs->hex);
+
+  // a handshake each way gives both sides an ephemeral
+  b->inner = lob_new();
+  lob_set(b->inner,"type","bench");
+  b->outer = cs->remote_encrypt(b->remoteB, b->localA, b->inner);
+  outerBA = cs->remote_encrypt(b->remoteA, b->localB, b->inner);
+  b->ephemBA = cs->ephemeral_new(b->remoteA, b->outer);
+  b->ephemAB = cs->ephemeral_new(b->remoteB, outerBA);
+  lob_free(outerBA);
+  if(!b->ephemAB || !b->ephemBA) return LOG("ephemeral setup failed for %s",cs->hex);
+
+  return b;
+}
+
+static void bench_free(bench_t b)
+{
+  if(!b) return;
+  b->cs->ephemeral_free(b->ephemAB);
+  b->cs->ephemeral_free(b->ephemBA);
+  b->cs->remote_free(b->remoteA);
+  b->cs->remote_free(b->remoteB);
+  b->cs->local_free(b->localA);
+  b->cs->local_free(b->localB);
+  lob_free(b->secretsA);
+  lob_free(b->secretsB);
+  lob_free(b->inner);
+  lob_free(b->outer);
+  lob_free(b->couter);
+  free(b);
+}
+
+// size the inner packet so the whole encoded packet is size bytes
+static void bench_size(bench_t b, uint32_t size)
+{
+  b->size = size;
+  lob_body(b->inner, NULL, size - (lob_len(b->inner) - b->inner->body_len));
+  e3x_rand(b->inner->body, b->inner->body_len);
+  lob_free(b->outer);
+  lob_free(b->couter);
+  b->outer = b->cs->remote_encrypt(b->remoteB, b->localA, b->inner);
+  b->couter = b->cs->ephemeral_encrypt(b->ephemBA, b->inner);
+}
+
+// chacha20 throughput of each kernel this cpu has, over the same packet sizes
+static void bench_chacha(void)
+{
+  char *kernels[] = {"portable", "sse2", "avx2"};
+  uint8_t key[32], nonce[8], bytes[1400];
+  uint64_t start, total, ops;
+  uint32_t k, s, i;
+  double ns, persec;
+
+  for(i = 0; i < 32; i++) key[i] = (uint8_t)i;
+  memset(nonce,0,sizeof(nonce));
+  memset(bytes,0,sizeof(bytes));
+  for(k = 0; k < sizeof(kernels)/sizeof(kernels[0]); k++)
+  {
+    if(!chacha20_impl(kernels[k])) continue;
+    for(s = 0; s < sizeof(_sizes)/sizeof(_sizes[0]); s++)
+    {
+      total = ops = 0;
+      while(total < (uint64_t)_budget * 1000000)
+      {
+        start = bench_ns();
+        for(i = 0; i < BATCH; i++) chacha20(key, nonce, bytes, _sizes[s]);
+        total += bench_ns() - start;
+        ops += BATCH;
+      }
+
+      ns = (double)total / ops;
+      persec = 1000000000.0 / ns;
+      if(_json)
+      {
+        printf("{\"op\":\"chacha20_%s\",\"size\":%u,\"ops\":%llu,\"ns_op\":%.1f,\"ops_sec\":%.1f,\"bytes_sec\":%.1f}\n",
+          kernels[k], _sizes[s], (unsigned long long)ops, ns, persec, persec * _sizes[s]);
+      }else{
+        printf("%-3s %-18s %5u %12.0f ops/s %12.0f ns/op %14.0f B/s\n", "cc", kernels[k], _sizes[s], persec, ns, persec * _sizes[s]);
+      }
+      fflush(stdout);
+    }
+  }
+
+  // back to the best one
+  if(!chacha20_impl("avx2")) chacha20_impl("sse2");
+}
+
+// event3 schedule/cancel/fire rates with a number of events already pending far ahead
+static void bench_events(uint32_t pending)
+{
+  event3_t ev;
+  lob_t batch[BATCH];
+  uint32_t at[BATCH];
+  char (*ids)[12];
+  uint64_t start, total, ops;
+  uint32_t now = 1000, i, op;
+  char *names[] = {"event_schedule", "event_cancel", "event_fire"};
+  double ns;
+
+  if(!(ids = malloc(sizeof(*ids) * (pending + BATCH)))) return;
+  ev = event3_new(pending + BATCH);
+  for(i = 0; i < pending + BATCH; i++) sprintf(ids[i],"%u",i);
+  for(i = 0; i < pending; i++) event3_set(ev, lob_new(), ids[i], now + 100000 + (uint32_t)(rand() % 1000000));
+
+  for(op = 0; op < 3; op++)
+  {
+    total = ops = 0;
+    while(total < (uint64_t)_budget * 1000000)
+    {
+      // untimed, fresh events over the next minute (or due now to fire), cancel/fire need them scheduled first
+      now++;
+      for(i = 0; i < BATCH; i++)
+      {
+        batch[i] = lob_new();
+        at[i] = (op == 2) ? now : now + (uint32_t)(rand() % 60000);
+        if(op) event3_set(ev, batch[i], ids[pending + i], at[i]);
+      }
+
+      start = bench_ns();
+      if(op == 0) for(i = 0; i < BATCH; i++) event3_set(ev, batch[i], ids[pending + i], at[i]);
+      if(op == 1) for(i = 0; i < BATCH; i++) event3_set(ev, NULL, ids[pending + i], 0);
+      if(op == 2) for(i = 0; i < BATCH; i++) batch[i] = event3_get(ev, now);
+      total += bench_ns() - start;
+      ops += BATCH;
+
+      if(op == 0) for(i = 0; i < BATCH; i++) event3_set(ev, NULL, ids[pending + i], 0);
+      if(op == 2) for(i = 0; i < BATCH; i++) lob_free(batch[i]);
+    }
+
+    ns = (double)total / ops;
+    if(_json)
+    {
+      printf("{\"op\":\"%s\",\"pending\":%u,\"ops\":%llu,\"ns_op\":%.1f,\"ops_sec\":%.1f}\n",
+        names[op], pending, (unsigned long long)ops, ns, 1000000000.0 / ns);
+    }else{
+      printf("%-3s %-18s %7u %12.0f ops/s %12.0f ns/op\n", "ev3", names[op], pending, 1000000000.0 / ns, ns);
+    }
+    fflush(stdout);
+  }
+
+  event3_free(ev);
+  free(ids);
+}
+
+int main(int argc, char *argv[])
+{
+  lob_t options;
+  bench_t b;
+  cipher3_t cs;
+  uint32_t s;
+  int i;
+
+  for(i = 1; i < argc; i++)
+  {
+    if(strcmp(argv[i],"-j") == 0) _json = 1;
+    else if(atoi(argv[i]) > 0) _budget = atoi(argv[i]);
+    else{
+      printf("Usage: bench [-j] [ms per measurement]\n");
+      return -1;
+    }
+  }
+
+  platform_logging(0);
+  options = lob_new();
+  if(e3x_init(options))
+  {
+    printf("e3x init failed: %s\n",e3x_err());
+    return -1;
+  }
+
+  for(i = 0; i < CS_MAX; i++)
+  {
+    if(!(cs = cipher3_sets[i])) continue;
+    if(!(b = bench_new(cs)))
+    {
+      printf("bench setup failed for %s\n",cs->hex);
+      continue;
+    }
+
+    bench_run(b, "generate", 0, prep_generate, op_generate, done_lob);
+    bench_run(b, "local_new", 0, NULL, op_local_new, done_local);
+    bench_run(b, "remote_new", 0, prep_remote_new, op_remote_new, done_remote_new);
+    bench_run(b, "ephemeral_new", 0, prep_outer, op_ephemeral_new, done_ephemeral_new);
+
+    for(s = 0; s < sizeof(_sizes)/sizeof(_sizes[0]); s++)
+    {
+      bench_size(b, _sizes[s]);
+      if(cs->rand) bench_run(b, "rand", _sizes[s], NULL, op_rand, NULL);
+      if(cs->hash) bench_run(b, "hash", _sizes[s], NULL, op_hash, NULL);
+      bench_run(b, "remote_encrypt", _sizes[s], NULL, op_remote_encrypt, done_lob);
+      bench_run(b, "local_decrypt", _sizes[s], prep_outer, op_local_decrypt, done_lob);
+      bench_run(b, "remote_verify", _sizes[s], prep_outer, op_remote_verify, done_lob);
+      bench_run(b, "ephemeral_encrypt", _sizes[s], NULL, op_ephemeral_encrypt, done_lob);
+      bench_run(b, "ephemeral_decrypt", _sizes[s], prep_couter, op_ephemeral_decrypt, done_ephemeral_decrypt);
+    }
+
+    bench_free(b);
+  }
+
+  bench_chacha();
+
+  for(i = 0; i < (int)(sizeof(_pending)/sizeof(_pending[0])); i++) bench_events(_pending[i]);
+
+  lob_free(options);
+  return 0;
+}
@@ -4,20 +4,30 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <signal.h>
 
 #include "mesh.h"
 #include "util_unix.h"
 #include "udp4.h"
 #include "tcp4.h"
 
+// kill -USR1 prints the mesh's packet counters
+static volatile sig_atomic_t dump = 0;
+static void on_usr1(int sig)
+{
+  dump = 1;
+}
+
 int main(int argc, char *argv[])
 {
-  lob_t id, options;
+  struct sigaction sa;
+  lob_t id, options, stats;
   mesh_t mesh;
   net_udp4_t udp4;
   net_tcp4_t tcp4;
   char *paths;
   int port = 0, len;
+  uint32_t wait;
 
   if(argc==2)
   {
@@ -35,7 +45,6 @@ int main(int argc, char *argv[])
   lob_set_int(options,"port",port);
 
   udp4 = net_udp4_new(mesh, options);
-  util_sock_timeout(udp4->server,100);
 
   tcp4 = net_tcp4_new(mesh, options);
 
@@ -45,7 +54,25 @@ int main(int argc, char *argv[])
   lob_set_raw(id,"paths",paths,len);
   printf("%s\n",lob_json(id));
 
-  while(net_udp4_receive(udp4) && net_tcp4_loop(tcp4));
+  // the receive returns early when this interrupts it, the loop then picks up the dump
+  memset(&sa,0,sizeof(sa));
+  sa.sa_handler = on_usr1;
+  sigaction(SIGUSR1, &sa, NULL);
+
+  // block on udp until a packet or the mesh's next deadline, tcp4 pipes are only polled so it's capped
+  do
+  {
+    if(dump)
+    {
+      dump = 0;
+      stats = mesh_stats(mesh);
+      printf("%s\n",lob_json(stats));
+      fflush(stdout);
+      lob_free(stats);
+    }
+    wait = mesh_process(mesh, 0);
+    util_sock_timeout(udp4->server, wait ? ((wait < 100) ? wait : 100) : 1);
+  }while(net_udp4_receive(udp4) && net_tcp4_loop(tcp4));
 
   /*
   if(util_loadjson(s) != 0 || (sock = util_server(0,1000)) <= 0)